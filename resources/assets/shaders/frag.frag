@@ -1,83 +1,116 @@
-#version 410 core
+#version 430 core
 out vec4 oFragColor;
 
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
+flat in uint MaterialIndex;
 
+// Must match MaterialData in material.h
 struct Material {
-    sampler2D texture_diffuse;
-    sampler2D texture_specular;
+    uint diffuseArray;
+    uint diffuseLayer;
+    uint specularArray;
+    uint specularLayer;
     float shininess;
+    float padding0;
+    float padding1;
+    float padding2;
 };
 
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight {
-    vec3 position;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+// Must match MATERIAL_BUFFER_BINDING in material.h
+layout (std430, binding = 2) readonly buffer Materials {
+    Material materials[];
 };
+// Defined from MaterialManager::maxArrayCount, which depends on the GPU's texture units
+#ifndef MATERIAL_TEXTURE_ARRAYS
+#define MATERIAL_TEXTURE_ARRAYS 16
+#endif
+// Each array gets the texture unit of its index, starting from 0 (see MaterialManager::bind)
+layout (binding = 0) uniform sampler2DArray materialTextures[MATERIAL_TEXTURE_ARRAYS];
 
-#define NR_POINT_LIGHTS 1
+#include "resources/assets/shaders/lights.glsl"
 
 uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform Material material;
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
+// Sampled once in main, rather than by every light
+Material material;
+vec3 diffuseColor;
+vec3 specularColor;
+
+uint GetCluster();
+vec3 CalcLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcDirLight(Light light, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcSpotLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir);
+
+// Variants (see LitShaderFeature in state.h):
+//   ALPHA_TEST         Discard fragments whose diffuse texture is transparent. Without it, the early depth test can skip shading
+//   WIREFRAME          Flat edges, with no texturing or lighting
+//   DEBUG_NORMALS      Show the surface normal instead of lighting
+//   DEBUG_LIGHT_COUNT  Show how many lights shade each cluster instead of lighting
 void main()
 {
+#ifdef WIREFRAME
+    oFragColor = vec4(0.0, 1.0, 0.0, 1.0);
+#else
+    material = materials[MaterialIndex];
+    // The array indices come from the draw's base instance, so they're dynamically uniform as GLSL requires
+    vec4 diffuseSample = texture(materialTextures[material.diffuseArray], vec3(TexCoord, material.diffuseLayer));
+#ifdef ALPHA_TEST
     // TODO: Transparency blending
-    if (texture(material.texture_diffuse, TexCoord).a < 0.5)
+    if (diffuseSample.a < 0.5)
         discard;
+#endif
+    diffuseColor = diffuseSample.rgb;
+    specularColor = texture(materialTextures[material.specularArray], vec3(TexCoord, material.specularLayer)).rgb;
 
     vec3 norm = normalize(Normal);
+#if defined(DEBUG_NORMALS)
+    oFragColor = vec4(norm * 0.5 + 0.5, 1.0);
+#elif defined(DEBUG_LIGHT_COUNT)
+    // Blue for no lights, through green, to red for 32 or more
+    float heat = clamp(float(globalLightCount + clusters[GetCluster()].y) / 32.0, 0.0, 1.0);
+    oFragColor = vec4(clamp(vec3(heat * 2.0 - 1.0, 1.0 - abs(heat * 2.0 - 1.0), 1.0 - heat * 2.0), 0.0, 1.0), 1.0);
+#else
     vec3 viewDir = normalize(viewPos - FragPos);
 
-    vec3 result;
-    result += CalcDirLight(dirLight, norm, viewDir);
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-    result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
-    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+    vec3 result = vec3(0.0);
+    for (uint i = 0; i < globalLightCount; i++)
+        result += CalcLight(lights[lightIndices[i]], norm, FragPos, viewDir);
+    // Only the lights that reach this fragment's cluster
+    uvec2 cluster = clusters[GetCluster()];
+    for (uint i = 0; i < cluster.y; i++)
+        result += CalcLight(lights[lightIndices[cluster.x + i]], norm, FragPos, viewDir);
 
     oFragColor = vec4(result, 1.0);
+#endif
+#endif
+}
+
+// finds the cluster this fragment is in, matching LightClusters in light_clusters.cpp
+uint GetCluster()
+{
+    // Linear view depth from the depth buffer value
+    float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+    float depth = 2.0 * clusterNear * clusterFar / (clusterFar + clusterNear - ndcDepth * (clusterFar - clusterNear));
+    uint slice = uint(clamp(log(depth) * clusterDepthScale + clusterDepthBias, 0.0, float(CLUSTER_GRID_Z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterScreenSize * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y)),
+        uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    return tile.x + tile.y * CLUSTER_GRID_X + slice * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+}
+
+vec3 CalcLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    if (light.type == LIGHT_DIRECTIONAL)
+        return CalcDirLight(light, normal, viewDir);
+    if (light.type == LIGHT_POINT)
+        return CalcPointLight(light, normal, fragPos, viewDir);
+    return CalcSpotLight(light, normal, fragPos, viewDir);
 }
 
 // calculates the color when using a directional light.
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+vec3 CalcDirLight(Light light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -86,14 +119,14 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse, TexCoord));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular, TexCoord));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     return (ambient + diffuse + specular);
 }
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
@@ -105,9 +138,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse, TexCoord));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular, TexCoord));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -115,7 +148,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 }
 
 // calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcSpotLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
@@ -131,9 +164,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse, TexCoord));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular, TexCoord));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
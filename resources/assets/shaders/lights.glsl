@@ -0,0 +1,53 @@
+// Light and light cluster buffers, shared by the lit shaders and the light clustering compute shader
+
+// Must match LightType in light.h
+#define LIGHT_DIRECTIONAL 0u
+#define LIGHT_POINT 1u
+#define LIGHT_SPOT 2u
+
+// Must match LightData in light.h
+struct Light {
+    vec3 position;
+    uint type;
+    vec3 direction;
+    float cutOff;
+    vec3 ambient;
+    float outerCutOff;
+    vec3 diffuse;
+    float constant;
+    vec3 specular;
+    float linear;
+    float quadratic;
+    float range;
+    float padding0;
+    float padding1;
+};
+
+// Must match LIGHT_BUFFER_BINDING in light.h
+layout (std430, binding = 3) readonly buffer Lights {
+    uint lightCount;
+    Light lights[];
+};
+
+// Must match the CLUSTER_GRID_* defines in light_clusters.h
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+
+// Must match ClusterHeader and LIGHT_CLUSTER_BUFFER_BINDING in light_clusters.h
+layout (std430, binding = 4) buffer LightClusters {
+    vec2 clusterScreenSize;
+    float clusterDepthScale;
+    float clusterDepthBias;
+    float clusterNear;
+    float clusterFar;
+    uint globalLightCount;  // Lights that reach every cluster, listed first in lightIndices
+    uint clusterPadding;
+    uvec2 clusters[];  // Offset into lightIndices and light count of each cluster
+};
+
+// Must match LIGHT_INDEX_BUFFER_BINDING in light_clusters.h
+layout (std430, binding = 5) buffer LightIndices {
+    uint lightIndexCount;
+    uint lightIndices[];
+};
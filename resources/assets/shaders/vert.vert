@@ -1,8 +1,10 @@
-#version 410 core
+#version 460 core
 out vec4 VertexColor;
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragPos;
+// The draw's base instance, which the engine sets to the material index. See Mesh::draw
+flat out uint MaterialIndex;
 
 in vec3 iPos;
 in vec3 iNormal;
@@ -14,8 +16,12 @@ layout(std140) uniform Matrices
     mat4 projection;
     mat4 view;
 };
-uniform mat4 model;
-uniform mat3 mTransposed;
+// Must match TransformData and TRANSFORM_BLOCK_BINDING in scene.h. Written per draw into the frame's ring buffer
+layout(std140, binding = 1) uniform Transform
+{
+    mat4 model;
+    mat3 mTransposed;
+};
 
 void main() {
     FragPos = vec3(model * vec4(iPos, 1.0));
@@ -24,5 +30,6 @@ void main() {
     gl_Position = projection * view * vec4(FragPos, 1.0);
 
     TexCoord = iTexCoord;
+    MaterialIndex = uint(gl_BaseInstance);
     VertexColor = iColor;
 }
@@ -0,0 +1,39 @@
+#version 460 core
+out vec4 VertexColor;
+out vec2 TexCoord;
+out vec3 Normal;
+out vec3 FragPos;
+// The draw's base instance, which the engine sets to the material index. See Mesh::draw
+flat out uint MaterialIndex;
+
+in vec3 iPos;
+in vec3 iNormal;
+in vec2 iTexCoord;
+in vec4 iColor;
+
+layout(std140) uniform Matrices
+{
+    mat4 projection;
+    mat4 view;
+};
+
+struct Instance {
+    mat4 model;
+    mat3 mTransposed;
+};
+layout(std430, binding = 1) readonly buffer Instances
+{
+    Instance instances[];
+};
+
+void main() {
+    Instance instance = instances[gl_InstanceID];
+    FragPos = vec3(instance.model * vec4(iPos, 1.0));
+    Normal = instance.mTransposed * iNormal;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+
+    TexCoord = iTexCoord;
+    MaterialIndex = uint(gl_BaseInstance);
+    VertexColor = iColor;
+}
@@ -0,0 +1,94 @@
+// Compares how fast every image in the texture set decodes with stb_image, and from the cooked image format.
+// Usage: image_benchmark [directory], from the repository root. Defaults to resources/assets/textures
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <stb_image.h>
+
+#include <engine/loader/cooked_image.h>
+#include <engine/loader/generic.h>
+#include <engine/util/thread_pool.h>
+
+// Each image is decoded repeatedly until this much time has passed, so small images still give stable timings
+#define MIN_SECONDS_PER_IMAGE 0.2
+
+using Clock = std::chrono::steady_clock;
+
+/*!
+ * @return The average seconds per call of `decode`
+ */
+template<typename F>
+double timeDecode(F &&decode) {
+    int iterations = 0;
+    const Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    do {
+        decode();
+        iterations++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < MIN_SECONDS_PER_IMAGE);
+    return elapsed / iterations;
+}
+
+int main(const int argc, char **argv) {
+    const std::string directory = argc > 1 ? argv[1] : "resources/assets/textures";
+
+    std::vector<std::filesystem::path> paths;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+        const std::string extension = entry.path().extension().string();
+        if (entry.is_regular_file() && (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga"))
+            paths.push_back(entry.path());
+    }
+    if (error || paths.empty()) {
+        std::fprintf(stderr, "No images found in \"%s\"\n", directory.c_str());
+        return 1;
+    }
+
+    std::printf("Cooked images decode on %zu workers + the calling thread\n\n", Engine::ThreadPool::shared().threadCount());
+    std::printf("%-52s %10s %10s %10s %10s %10s\n", "Image", "Pixel KiB", "File KiB", "Cooked KiB", "stb ms", "Cooked ms");
+
+    double totalMiB = 0.0, totalStbSeconds = 0.0, totalCookedSeconds = 0.0;
+    for (const std::filesystem::path &path : paths) {
+        const auto file = Engine::Loader::readBinaryFile(path.string());
+        const auto source = Engine::Loader::decodeImage(path.string());
+        if (!file.has_value() || !source.has_value()) {
+            std::fprintf(stderr, "Skipping \"%s\", which failed to load\n", path.string().c_str());
+            continue;
+        }
+        const std::vector<unsigned char> cooked = Engine::Loader::encodeCookedImage(source.value());
+
+        // Make sure the format round trips before timing it
+        const auto roundTrip = Engine::Loader::decodeCookedImage(cooked);
+        if (!roundTrip.has_value() || std::memcmp(roundTrip->pixels.get(), source->pixels.get(), source->byteSize()) != 0) {
+            std::fprintf(stderr, "Cooked image of \"%s\" doesn't match the source\n", path.string().c_str());
+            return 1;
+        }
+
+        const double stbSeconds = timeDecode([&file] {
+            int width, height, channelCount;
+            stbi_uc *pixels = stbi_load_from_memory(file->data(), static_cast<int>(file->size()), &width, &height, &channelCount, 0);
+            stbi_image_free(pixels);
+        });
+        const double cookedSeconds = timeDecode([&cooked] {
+            (void)Engine::Loader::decodeCookedImage(cooked);
+        });
+
+        const double mib = static_cast<double>(source->byteSize()) / (1024.0 * 1024.0);
+        totalMiB += mib;
+        totalStbSeconds += stbSeconds;
+        totalCookedSeconds += cookedSeconds;
+        std::printf("%-52s %10zu %10zu %10zu %10.3f %10.3f\n", path.string().c_str(), source->byteSize() / 1024,
+            file->size() / 1024, cooked.size() / 1024, stbSeconds * 1000.0, cookedSeconds * 1000.0);
+    }
+
+    std::printf("\nDecoding %.2f MiB of pixels:\n", totalMiB);
+    std::printf("    stb_image: %8.3f ms per MiB, %8.1f MiB/s\n", totalStbSeconds * 1000.0 / totalMiB, totalMiB / totalStbSeconds);
+    std::printf("    Cooked:    %8.3f ms per MiB, %8.1f MiB/s (%.1fx)\n", totalCookedSeconds * 1000.0 / totalMiB,
+        totalMiB / totalCookedSeconds, totalStbSeconds / totalCookedSeconds);
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Times assigning lights to clusters on the CPU as the light count grows, against testing every light against every cluster.
+// Usage: light_benchmark [max lights], defaults to 4096
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include <engine/manager/light.h>
+#include <engine/render/light_clusters.h>
+#include <engine/util/thread_pool.h>
+
+// Each light count is clustered repeatedly until this much time has passed, so small counts still give stable timings
+#define MIN_SECONDS_PER_COUNT 0.2
+// The game camera's projection
+#define FOV_Y_DEGREES 45.0f
+#define ASPECT_RATIO (16.0f / 9.0f)
+#define CLIP_NEAR 0.1f
+#define CLIP_FAR 100.0f
+
+using Clock = std::chrono::steady_clock;
+using Engine::Manager::LightData;
+using Engine::Manager::LightType;
+
+/*!
+ * @return The average seconds per call of `body`
+ */
+template<typename F>
+double timeRepeated(F &&body) {
+    int iterations = 0;
+    const Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    do {
+        body();
+        iterations++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < MIN_SECONDS_PER_COUNT);
+    return elapsed / iterations;
+}
+
+/*!
+ * @return Point lights scattered through a level-sized box around the camera, plus the game's directional light
+ */
+std::vector<LightData> makeLights(const size_t count, std::mt19937 &random) {
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> height(0.0f, 10.0f);
+    std::uniform_real_distribution<float> colour(0.2f, 1.0f);
+    std::uniform_real_distribution<float> falloff(0.5f, 1.0f);
+
+    std::vector<LightData> lights;
+    LightData sun{.type = LightType::DIRECTIONAL, .direction = {-0.2f, -1.0f, -0.3f}, .ambient = glm::vec3(0.5f), .diffuse = glm::vec3(0.4f)};
+    sun.range = Engine::Manager::getLightRange(sun);
+    lights.push_back(sun);
+    for (size_t i = 1; i < count; i++) {
+        LightData light{
+            .position = {position(random), height(random), position(random)},
+            .type = LightType::POINT,
+            .diffuse = {colour(random), colour(random), colour(random)},
+            .constant = 1.0f,
+            .linear = 0.7f * falloff(random),
+            .quadratic = 1.8f * falloff(random),
+        };
+        light.range = Engine::Manager::getLightRange(light);
+        lights.push_back(light);
+    }
+    return lights;
+}
+
+/*!
+ * @return Whether a sphere in view space is entirely outside one of the view frustum's sides
+ */
+bool isOutsideFrustum(const glm::vec3 &center, const float radius) {
+    const float tanHalfFovY = std::tan(glm::radians(FOV_Y_DEGREES) * 0.5f);
+    const float tanHalfFovX = tanHalfFovY * ASPECT_RATIO;
+    // Inward normals of the left, right, bottom and top planes, which all pass through the camera
+    const glm::vec3 planes[] = {
+        glm::normalize(glm::vec3(1.0f, 0.0f, -tanHalfFovX)), glm::normalize(glm::vec3(-1.0f, 0.0f, -tanHalfFovX)),
+        glm::normalize(glm::vec3(0.0f, 1.0f, -tanHalfFovY)), glm::normalize(glm::vec3(0.0f, -1.0f, -tanHalfFovY)),
+    };
+    for (const glm::vec3 &normal : planes)
+        if (glm::dot(normal, center) < -radius)
+            return true;
+    return false;
+}
+
+/*!
+ * @return Whether testing every light against every cluster gives the same clusters.
+ * Clustering also skips lights entirely outside the view frustum, which can still touch the bounding boxes of the edge clusters.
+ */
+bool matchesBruteForce(const LightClusters &clusters, const std::vector<LightData> &lights, const glm::mat4 &view) {
+    const std::vector<ClusterBounds> &bounds = clusters.getBounds();
+    const std::vector<uint32_t> &indices = clusters.getIndices();
+    for (size_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+        const glm::uvec2 range = clusters.getClusters()[cluster];
+        const std::vector<uint32_t> assigned(indices.begin() + range.x, indices.begin() + range.x + range.y);
+        size_t next = 0;
+        for (size_t i = 0; i < lights.size(); i++) {
+            if (lights[i].type == LightType::DIRECTIONAL || std::isinf(lights[i].range) || lights[i].range <= 0.0f)
+                continue;
+            const glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            const glm::vec3 offset = glm::max(glm::vec3(bounds[cluster].min) - center, 0.0f) + glm::max(center - glm::vec3(bounds[cluster].max), 0.0f);
+            const bool reaches = glm::dot(offset, offset) <= lights[i].range * lights[i].range;
+            // Both lists are in light order
+            const bool isAssigned = next < assigned.size() && assigned[next] == i;
+            if (isAssigned)
+                next++;
+            if (isAssigned != reaches && (isAssigned || !isOutsideFrustum(center, lights[i].range)))
+                return false;
+        }
+        if (next != assigned.size())
+            return false;
+    }
+    return true;
+}
+
+int main(const int argc, char **argv) {
+    const size_t maxLights = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4096;
+
+    LightClusters clusters;
+    clusters.setProjection(glm::radians(FOV_Y_DEGREES), ASPECT_RATIO, CLIP_NEAR, CLIP_FAR);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::mt19937 random(1234);
+
+    std::printf("%d clusters, assigned on %zu workers + the calling thread\n\n", CLUSTER_COUNT, Engine::ThreadPool::shared().threadCount());
+    std::printf("%8s %12s %14s %12s %16s\n", "Lights", "Clustered ms", "Brute force ms", "Indices", "Lights/fragment");
+
+    for (size_t count = 1; count <= maxLights; count *= 2) {
+        const std::vector<LightData> lights = makeLights(count, random);
+        clusters.assign(lights, view);
+        if (!matchesBruteForce(clusters, lights, view)) {
+            std::fprintf(stderr, "Clusters for %zu lights don't match testing every light against every cluster\n", count);
+            return 1;
+        }
+
+        const double clusteredSeconds = timeRepeated([&] {
+            clusters.assign(lights, view);
+        });
+        // The brute force check is far slower, so only time it once
+        const Clock::time_point start = Clock::now();
+        (void)matchesBruteForce(clusters, lights, view);
+        const double bruteForceSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        const size_t indexCount = clusters.getIndices().size();
+        const double averageLights = static_cast<double>(indexCount - clusters.getGlobalLightCount()) / CLUSTER_COUNT
+            + static_cast<double>(clusters.getGlobalLightCount());
+        std::printf("%8zu %12.3f %14.3f %12zu %16.2f\n", count, clusteredSeconds * 1000.0, bruteForceSeconds * 1000.0,
+            indexCount, averageLights);
+    }
+    return 0;
+}
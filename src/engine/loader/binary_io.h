@@ -0,0 +1,151 @@
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Engine::Loader {
+    /*!
+     * Minimal helper for writing cooked asset files.
+     * Values are written in native byte order, since the cache never leaves the machine that wrote it.
+     * Everything goes to a temporary file next to the destination, which only replaces it on `commit`,
+     * so readers (and other threads cooking the same file) never see a partly written file, and neither does the next run after a crash.
+     */
+    class BinaryWriter {
+    private:
+        std::string filePath;
+        // Unique per thread, so threads writing the same file don't write into each other's
+        std::string tempPath;
+        std::ofstream file;
+        bool committed = false;
+
+    public:
+        explicit BinaryWriter(const std::string &filePath)
+            : filePath(filePath), tempPath(filePath + ".tmp." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()))),
+              file(tempPath, std::ios::binary | std::ios::trunc) {}
+        /*!
+         * @brief Delete the temporary file if the write wasn't committed
+         */
+        ~BinaryWriter() {
+            if (committed)
+                return;
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+        }
+
+        [[nodiscard]] bool good() const { return file.good(); }
+        /*!
+         * @brief Finish writing, and replace the destination with what was written
+         * @return Whether every write succeeded and the destination was replaced. If not, the destination is left as it was
+         */
+        bool commit() {
+            file.close();
+            if (file.fail())
+                return false;
+            std::error_code error;
+            std::filesystem::rename(tempPath, filePath, error);
+            if (error)
+                return false;
+            committed = true;
+            return true;
+        }
+
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        void write(const T &value) {
+            file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        void writeArray(const T *values, const size_t count) {
+            file.write(reinterpret_cast<const char *>(values), static_cast<std::streamsize>(count * sizeof(T)));
+        }
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        void writeVector(const std::vector<T> &values) {
+            write(static_cast<uint64_t>(values.size()));
+            writeArray(values.data(), values.size());
+        }
+        void writeString(const std::string &value) {
+            write(static_cast<uint32_t>(value.size()));
+            file.write(value.data(), static_cast<std::streamsize>(value.size()));
+        }
+    };
+
+    /*!
+     * Counterpart to `BinaryWriter`. Reads fail softly: check `good()` after reading a batch of values.
+     * Counts read from the file are checked against its size before anything is allocated, so a corrupt file is just a failed read.
+     */
+    class BinaryReader {
+    private:
+        std::ifstream file;
+        size_t fileSize = 0;
+
+    public:
+        explicit BinaryReader(const std::string &filePath) : file(filePath, std::ios::binary | std::ios::ate) {
+            if (file.good())
+                fileSize = static_cast<size_t>(file.tellg());
+            file.seekg(0);
+        }
+
+        [[nodiscard]] bool good() const { return file.good(); }
+        /*!
+         * @brief Fail every read from here on
+         */
+        void fail() { file.setstate(std::ios::failbit); }
+        /*!
+         * @return The bytes left to read, or 0 after a failed read
+         */
+        [[nodiscard]] size_t remaining() {
+            if (!good())
+                return 0;
+            const std::streamoff position = file.tellg();
+            return position >= 0 && static_cast<size_t>(position) < fileSize ? fileSize - static_cast<size_t>(position) : 0;
+        }
+
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        T read() {
+            T value{};
+            file.read(reinterpret_cast<char *>(&value), sizeof(T));
+            return value;
+        }
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        void readArray(T *values, const size_t count) {
+            file.read(reinterpret_cast<char *>(values), static_cast<std::streamsize>(count * sizeof(T)));
+        }
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        std::vector<T> readVector() {
+            const auto count = read<uint64_t>();
+            if (!good() || count > remaining() / sizeof(T)) {
+                fail();
+                return {};
+            }
+            std::vector<T> values(count);
+            readArray(values.data(), values.size());
+            return values;
+        }
+        /*!
+         * @brief Skip over bytes without reading them
+         */
+        void skip(const size_t bytes) {
+            file.seekg(static_cast<std::streamoff>(bytes), std::ios::cur);
+        }
+        std::string readString() {
+            const auto length = read<uint32_t>();
+            if (!good() || length > remaining()) {
+                fail();
+                return {};
+            }
+            std::string value(length, '\0');
+            file.read(value.data(), length);
+            return value;
+        }
+    };
+}
+
+#endif
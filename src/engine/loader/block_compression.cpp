@@ -0,0 +1,415 @@
+#include "block_compression.h"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <gl/glew.h>
+
+#include <engine/util/thread_pool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace Engine::Loader {
+    // 4x4 RGBA pixels, row by row
+    using Block = std::array<unsigned char, 64>;
+    using Color = std::array<int, 4>;
+
+    size_t getBlockBytes(const BlockFormat format) {
+        switch (format) {
+            case BlockFormat::BC1:
+            case BlockFormat::BC4:
+                return 8;
+            default:
+                return 16;
+        }
+    }
+
+    unsigned int getBlockGlFormat(const BlockFormat format) {
+        switch (format) {
+            case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+            case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+            case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        }
+        return 0;
+    }
+
+    size_t getCompressedSize(const BlockFormat format, const int width, const int height) {
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+    }
+
+    BlockFormat chooseBlockFormat(const int channelCount, const bool highQuality) {
+        switch (channelCount) {
+            case 1: return BlockFormat::BC4;
+            case 2: return BlockFormat::BC5;
+            case 3: return highQuality ? BlockFormat::BC7 : BlockFormat::BC1;
+            default: return highQuality ? BlockFormat::BC7 : BlockFormat::BC3;
+        }
+    }
+
+#pragma region Helpers
+    void getBlockBounds(const Block &block, Color &minColor, Color &maxColor) {
+#ifdef __SSE2__
+        // Each register holds four pixels, so reduce the four registers, then the pixels within the result
+        const auto *pixels = reinterpret_cast<const __m128i *>(block.data());
+        const __m128i p0 = _mm_loadu_si128(pixels), p1 = _mm_loadu_si128(pixels + 1);
+        const __m128i p2 = _mm_loadu_si128(pixels + 2), p3 = _mm_loadu_si128(pixels + 3);
+        __m128i lo = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+        __m128i hi = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+
+        const auto loBits = static_cast<uint32_t>(_mm_cvtsi128_si32(lo));
+        const auto hiBits = static_cast<uint32_t>(_mm_cvtsi128_si32(hi));
+        for (int c = 0; c < 4; c++) {
+            minColor[c] = static_cast<int>(loBits >> (c * 8) & 0xFF);
+            maxColor[c] = static_cast<int>(hiBits >> (c * 8) & 0xFF);
+        }
+#else
+        minColor = {255, 255, 255, 255};
+        maxColor = {0, 0, 0, 0};
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                minColor[c] = std::min<int>(minColor[c], block[i * 4 + c]);
+                maxColor[c] = std::max<int>(maxColor[c], block[i * 4 + c]);
+            }
+        }
+#endif
+    }
+
+    /*!
+     * @brief Turn the bounding box of a block into the diagonal that best follows its colours
+     * @note The bounds alone always give the diagonal from (min, min, min) to (max, max, max).
+     *  Channels that are anticorrelated with the channel with the largest range are flipped
+     */
+    void orientBounds(const Block &block, Color &minColor, Color &maxColor, const int channelCount) {
+        int reference = 0;
+        for (int c = 1; c < channelCount; c++)
+            if (maxColor[c] - minColor[c] > maxColor[reference] - minColor[reference])
+                reference = c;
+
+        Color mean{};
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < channelCount; c++)
+                mean[c] += block[i * 4 + c];
+
+        for (int c = 0; c < channelCount; c++) {
+            if (c == reference)
+                continue;
+            // Scaled by 16 twice, which doesn't change the sign
+            int covariance = 0;
+            for (int i = 0; i < 16; i++)
+                covariance += (block[i * 4 + c] * 16 - mean[c]) * (block[i * 4 + reference] * 16 - mean[reference]);
+            if (covariance < 0)
+                std::swap(minColor[c], maxColor[c]);
+        }
+    }
+
+    /*!
+     * Writes values least significant bit first, as BC7 expects. The output must be zeroed beforehand.
+     */
+    struct BitWriter {
+        unsigned char *out;
+        int position = 0;
+
+        void write(const uint32_t value, const int bitCount) {
+            for (int i = 0; i < bitCount; i++, position++)
+                if (value >> i & 1)
+                    out[position / 8] |= static_cast<unsigned char>(1 << position % 8);
+        }
+    };
+
+    void writeLittleEndian(unsigned char *out, const uint64_t value, const int byteCount) {
+        for (int i = 0; i < byteCount; i++)
+            out[i] = static_cast<unsigned char>(value >> (i * 8));
+    }
+#pragma endregion
+
+
+#pragma region BC1
+    uint16_t packRgb565(const Color &color) {
+        return static_cast<uint16_t>((color[0] * 31 + 127) / 255 << 11 | (color[1] * 63 + 127) / 255 << 5 | (color[2] * 31 + 127) / 255);
+    }
+
+    Color unpackRgb565(const uint16_t packed) {
+        const int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+        return {r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 255};
+    }
+
+    /*!
+     * @brief Pick the closest palette entry for every pixel
+     * @param color0 Must be greater than `color1`, or equal to it, so the block uses the four colour palette
+     * @return The total squared error of the block
+     */
+    int selectColorIndices(const Block &block, const uint16_t color0, const uint16_t color1, uint32_t &indices) {
+        std::array<Color, 4> palette = {unpackRgb565(color0), unpackRgb565(color1)};
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        int error = 0;
+        indices = 0;
+        for (int i = 0; i < 16; i++) {
+            int bestIndex = 0, bestError = INT_MAX;
+            // With equal endpoints every entry is the same, and the last two would be black in the three colour palette
+            for (int index = 0; index < (color0 == color1 ? 1 : 4); index++) {
+                int pixelError = 0;
+                for (int c = 0; c < 3; c++) {
+                    const int delta = block[i * 4 + c] - palette[index][c];
+                    pixelError += delta * delta;
+                }
+                if (pixelError < bestError) {
+                    bestError = pixelError;
+                    bestIndex = index;
+                }
+            }
+            indices |= static_cast<uint32_t>(bestIndex) << (i * 2);
+            error += bestError;
+        }
+        return error;
+    }
+
+    /*!
+     * @brief Find the endpoints that minimize the squared error for the current indices
+     * @return Whether the endpoints could be solved for (they can't if every pixel uses the same endpoint)
+     */
+    bool refineColorEndpoints(const Block &block, const uint32_t indices, Color &color0, Color &color1) {
+        constexpr std::array<float, 4> weights = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+        // Least squares over color = (1 - t) * color0 + t * color1
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        std::array<float, 3> ax{}, bx{};
+        for (int i = 0; i < 16; i++) {
+            const float t = weights[indices >> (i * 2) & 3];
+            aa += (1.0f - t) * (1.0f - t);
+            ab += (1.0f - t) * t;
+            bb += t * t;
+            for (int c = 0; c < 3; c++) {
+                ax[c] += (1.0f - t) * block[i * 4 + c];
+                bx[c] += t * block[i * 4 + c];
+            }
+        }
+
+        const float determinant = aa * bb - ab * ab;
+        if (determinant < 1e-6f)
+            return false;
+        for (int c = 0; c < 3; c++) {
+            color0[c] = std::clamp(static_cast<int>((ax[c] * bb - bx[c] * ab) / determinant + 0.5f), 0, 255);
+            color1[c] = std::clamp(static_cast<int>((bx[c] * aa - ax[c] * ab) / determinant + 0.5f), 0, 255);
+        }
+        return true;
+    }
+
+    void encodeColorBlock(const Block &block, unsigned char *out) {
+        Color minColor, maxColor;
+        getBlockBounds(block, minColor, maxColor);
+        orientBounds(block, minColor, maxColor, 3);
+
+        // Pull the endpoints in slightly, since the extremes are usually outliers
+        for (int c = 0; c < 3; c++) {
+            const int inset = (maxColor[c] - minColor[c]) / 16;
+            minColor[c] += inset;
+            maxColor[c] -= inset;
+        }
+
+        uint16_t color0 = packRgb565(maxColor), color1 = packRgb565(minColor);
+        if (color0 < color1)
+            std::swap(color0, color1);
+        uint32_t indices;
+        int error = selectColorIndices(block, color0, color1, indices);
+
+        Color refined0 = maxColor, refined1 = minColor;
+        if (error > 0 && refineColorEndpoints(block, indices, refined0, refined1)) {
+            uint16_t refinedColor0 = packRgb565(refined0), refinedColor1 = packRgb565(refined1);
+            if (refinedColor0 < refinedColor1)
+                std::swap(refinedColor0, refinedColor1);
+            uint32_t refinedIndices;
+            const int refinedError = selectColorIndices(block, refinedColor0, refinedColor1, refinedIndices);
+            if (refinedError < error) {
+                color0 = refinedColor0;
+                color1 = refinedColor1;
+                indices = refinedIndices;
+            }
+        }
+
+        writeLittleEndian(out, color0, 2);
+        writeLittleEndian(out + 2, color1, 2);
+        writeLittleEndian(out + 4, indices, 4);
+    }
+#pragma endregion
+
+
+#pragma region BC4
+    void encodeSingleChannelBlock(const Block &block, const int channel, unsigned char *out) {
+        int minValue = 255, maxValue = 0;
+        for (int i = 0; i < 16; i++) {
+            minValue = std::min<int>(minValue, block[i * 4 + channel]);
+            maxValue = std::max<int>(maxValue, block[i * 4 + channel]);
+        }
+
+        // With value0 > value1, the palette interpolates 6 values between them
+        uint64_t indices = 0;
+        if (maxValue > minValue) {
+            std::array<int, 8> palette = {maxValue, minValue};
+            for (int index = 2; index < 8; index++)
+                palette[index] = ((8 - index) * maxValue + (index - 1) * minValue + 3) / 7;
+
+            for (int i = 0; i < 16; i++) {
+                int bestIndex = 0, bestError = INT_MAX;
+                for (int index = 0; index < 8; index++) {
+                    const int error = std::abs(block[i * 4 + channel] - palette[index]);
+                    if (error < bestError) {
+                        bestError = error;
+                        bestIndex = index;
+                    }
+                }
+                indices |= static_cast<uint64_t>(bestIndex) << (i * 3);
+            }
+        }
+
+        out[0] = static_cast<unsigned char>(maxValue);
+        out[1] = static_cast<unsigned char>(minValue);
+        writeLittleEndian(out + 2, indices, 6);
+    }
+#pragma endregion
+
+
+#pragma region BC7
+    constexpr std::array<int, 16> BC7_WEIGHTS = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    int selectBc7Indices(const Block &block, const Color &endpoint0, const Color &endpoint1, std::array<int, 16> &indices) {
+        std::array<Color, 16> palette;
+        for (int index = 0; index < 16; index++)
+            for (int c = 0; c < 4; c++)
+                palette[index][c] = ((64 - BC7_WEIGHTS[index]) * endpoint0[c] + BC7_WEIGHTS[index] * endpoint1[c] + 32) >> 6;
+
+        int error = 0;
+        for (int i = 0; i < 16; i++) {
+            int bestIndex = 0, bestError = INT_MAX;
+            for (int index = 0; index < 16; index++) {
+                int pixelError = 0;
+                for (int c = 0; c < 4; c++) {
+                    const int delta = block[i * 4 + c] - palette[index][c];
+                    pixelError += delta * delta;
+                }
+                if (pixelError < bestError) {
+                    bestError = pixelError;
+                    bestIndex = index;
+                }
+            }
+            indices[i] = bestIndex;
+            error += bestError;
+        }
+        return error;
+    }
+
+    /*!
+     * @brief Encode a block with BC7 mode 6: one subset, RGBA endpoints with 7 bits per channel plus a shared p-bit each,
+     *  and 4 bit indices
+     */
+    void encodeBc7Block(const Block &block, unsigned char *out) {
+        Color minColor, maxColor;
+        getBlockBounds(block, minColor, maxColor);
+        orientBounds(block, minColor, maxColor, 4);
+
+        // Try every combination of p-bits, quantizing the endpoints to the nearest value with that low bit
+        std::array<Color, 2> bestQuantized{};
+        std::array<int, 2> bestPBits{};
+        std::array<int, 16> bestIndices{};
+        int bestError = INT_MAX;
+        for (int pBits = 0; pBits < 4; pBits++) {
+            const std::array<int, 2> p = {pBits & 1, pBits >> 1};
+            std::array<Color, 2> quantized, endpoints;
+            for (int c = 0; c < 4; c++) {
+                quantized[0][c] = std::clamp((minColor[c] - p[0] + 1) >> 1, 0, 127);
+                quantized[1][c] = std::clamp((maxColor[c] - p[1] + 1) >> 1, 0, 127);
+                endpoints[0][c] = quantized[0][c] << 1 | p[0];
+                endpoints[1][c] = quantized[1][c] << 1 | p[1];
+            }
+
+            std::array<int, 16> indices;
+            const int error = selectBc7Indices(block, endpoints[0], endpoints[1], indices);
+            if (error < bestError) {
+                bestError = error;
+                bestQuantized = quantized;
+                bestPBits = p;
+                bestIndices = indices;
+            }
+        }
+
+        // The top bit of the first index is implied to be 0, so swap the endpoints if it isn't
+        if (bestIndices[0] >= 8) {
+            std::swap(bestQuantized[0], bestQuantized[1]);
+            std::swap(bestPBits[0], bestPBits[1]);
+            for (int &index : bestIndices)
+                index = 15 - index;
+        }
+
+        std::memset(out, 0, 16);
+        BitWriter writer{out};
+        writer.write(1 << 6, 7);  // Mode 6 is written as six zeros followed by a one
+        for (int c = 0; c < 4; c++) {
+            writer.write(bestQuantized[0][c], 7);
+            writer.write(bestQuantized[1][c], 7);
+        }
+        writer.write(bestPBits[0], 1);
+        writer.write(bestPBits[1], 1);
+        writer.write(bestIndices[0], 3);
+        for (int i = 1; i < 16; i++)
+            writer.write(bestIndices[i], 4);
+    }
+#pragma endregion
+
+
+    void encodeBlock(const Block &block, const BlockFormat format, unsigned char *out) {
+        switch (format) {
+            case BlockFormat::BC1:
+                encodeColorBlock(block, out);
+                break;
+            case BlockFormat::BC3:
+                encodeSingleChannelBlock(block, 3, out);
+                encodeColorBlock(block, out + 8);
+                break;
+            case BlockFormat::BC4:
+                encodeSingleChannelBlock(block, 0, out);
+                break;
+            case BlockFormat::BC5:
+                encodeSingleChannelBlock(block, 0, out);
+                encodeSingleChannelBlock(block, 1, out + 8);
+                break;
+            case BlockFormat::BC7:
+                encodeBc7Block(block, out);
+                break;
+        }
+    }
+
+    std::vector<unsigned char> compressImage(const unsigned char *rgba, const int width, const int height, const BlockFormat format) {
+        const int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+        const size_t blockBytes = getBlockBytes(format);
+        std::vector<unsigned char> compressed(getCompressedSize(format, width, height));
+
+        ThreadPool::shared().parallelFor(blocksHigh, [&](const size_t blockY) {
+            Block block;
+            for (int blockX = 0; blockX < blocksWide; blockX++) {
+                for (int y = 0; y < 4; y++) {
+                    const int sourceY = std::min(static_cast<int>(blockY) * 4 + y, height - 1);
+                    for (int x = 0; x < 4; x++) {
+                        const int sourceX = std::min(blockX * 4 + x, width - 1);
+                        std::memcpy(&block[(y * 4 + x) * 4], rgba + (static_cast<size_t>(sourceY) * width + sourceX) * 4, 4);
+                    }
+                }
+                encodeBlock(block, format, compressed.data() + (blockY * blocksWide + blockX) * blockBytes);
+            }
+        });
+        return compressed;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Engine::Loader {
+    /*!
+     * GPU block compression formats. Each encodes 4x4 pixel blocks into 8 or 16 bytes.
+     */
+    enum class BlockFormat : uint32_t {
+        BC1,  // RGB, 8 bytes per block
+        BC3,  // RGBA, BC1 colour plus a BC4 alpha block, 16 bytes per block
+        BC4,  // Single channel, 8 bytes per block
+        BC5,  // Two channels, two BC4 blocks, 16 bytes per block
+        BC7   // RGBA at higher quality, 16 bytes per block. Only mode 6 is used
+    };
+
+    [[nodiscard]] size_t getBlockBytes(BlockFormat format);
+    /*!
+     * @return The OpenGL internal format of a block format
+     */
+    [[nodiscard]] unsigned int getBlockGlFormat(BlockFormat format);
+    /*!
+     * @brief Get the size of an image of the given size once compressed
+     */
+    [[nodiscard]] size_t getCompressedSize(BlockFormat format, int width, int height);
+
+    /*!
+     * @brief Pick the format to compress an image with
+     * @param channelCount The channel count of the source image
+     * @param highQuality Whether to use BC7 rather than BC1 or BC3 for colour images
+     */
+    [[nodiscard]] BlockFormat chooseBlockFormat(int channelCount, bool highQuality);
+
+    /*!
+     * @brief Compress an RGBA8 image
+     * @param rgba Tightly packed RGBA pixels. Formats with fewer channels read the first channels
+     * @return The compressed blocks, row by row
+     * @note Rows of blocks are encoded in parallel on the shared thread pool (safe to call from one of its tasks).
+     *  Edge blocks of images that aren't a multiple of 4 in size repeat the last row and column
+     */
+    std::vector<unsigned char> compressImage(const unsigned char *rgba, int width, int height, BlockFormat format);
+}
+
+#endif
@@ -0,0 +1,267 @@
+#include "cooked_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <engine/logging.h>
+#include <engine/util/thread_pool.h>
+
+#define COOKED_IMAGE_MAGIC 0x514C4C4Cu  // "LLLQ"
+#define COOKED_IMAGE_VERSION 1u
+// Bands are at least this many pixels, so small images aren't split into bands too small to be worth a task
+#define COOKED_IMAGE_BAND_PIXELS 65536
+
+// The QOI opcodes. The 2 bit ones are tags in the top bits of the byte
+#define OP_INDEX 0x00
+#define OP_DIFF 0x40
+#define OP_LUMA 0x80
+#define OP_RUN 0xC0
+#define OP_RGB 0xFE
+#define OP_RGBA 0xFF
+#define OP_MASK 0xC0
+#define MAX_RUN 62
+
+namespace Engine::Loader {
+    struct CookedImageHeader {
+        uint32_t magic;
+        uint32_t version;
+        int32_t width, height, channelCount;
+        int32_t bandRows;
+        uint32_t bandCount;
+    };
+
+    struct Rgba {
+        uint8_t r, g, b, a;
+
+        bool operator==(const Rgba &) const = default;
+    };
+
+    int getIndexPosition(const Rgba pixel) {
+        return (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+    }
+
+    // Images with fewer than 4 channels are coded as RGBA, with the missing colour channels 0 and alpha 255
+    template<int Channels>
+    Rgba loadPixel(const unsigned char *pixel) {
+        Rgba rgba{pixel[0], 0, 0, 255};
+        if constexpr (Channels >= 2) rgba.g = pixel[1];
+        if constexpr (Channels >= 3) rgba.b = pixel[2];
+        if constexpr (Channels >= 4) rgba.a = pixel[3];
+        return rgba;
+    }
+
+    template<int Channels>
+    void storePixel(unsigned char *pixel, const Rgba rgba) {
+        if constexpr (Channels == 4) {
+            std::memcpy(pixel, &rgba, 4);
+        } else {
+            pixel[0] = rgba.r;
+            if constexpr (Channels >= 2) pixel[1] = rgba.g;
+            if constexpr (Channels >= 3) pixel[2] = rgba.b;
+        }
+    }
+
+    template<int Channels>
+    void encodeBand(const unsigned char *pixels, const size_t pixelCount, std::vector<unsigned char> &out) {
+        Rgba index[64]{};
+        Rgba previous{0, 0, 0, 255};
+        int run = 0;
+        out.reserve(pixelCount * (Channels + 1) / 2);
+
+        for (size_t i = 0; i < pixelCount; i++) {
+            const Rgba pixel = loadPixel<Channels>(pixels + i * Channels);
+            if (pixel == previous) {
+                if (++run == MAX_RUN) {
+                    out.push_back(OP_RUN | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out.push_back(OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            const int position = getIndexPosition(pixel);
+            if (index[position] == pixel) {
+                out.push_back(OP_INDEX | position);
+            } else {
+                index[position] = pixel;
+                if (pixel.a == previous.a) {
+                    const auto dr = static_cast<int8_t>(pixel.r - previous.r);
+                    const auto dg = static_cast<int8_t>(pixel.g - previous.g);
+                    const auto db = static_cast<int8_t>(pixel.b - previous.b);
+                    const int drDg = dr - dg, dbDg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                    } else if (drDg >= -8 && drDg <= 7 && dg >= -32 && dg <= 31 && dbDg >= -8 && dbDg <= 7) {
+                        out.push_back(OP_LUMA | (dg + 32));
+                        out.push_back((drDg + 8) << 4 | (dbDg + 8));
+                    } else {
+                        out.insert(out.end(), {OP_RGB, pixel.r, pixel.g, pixel.b});
+                    }
+                } else {
+                    out.insert(out.end(), {OP_RGBA, pixel.r, pixel.g, pixel.b, pixel.a});
+                }
+            }
+            previous = pixel;
+        }
+        if (run > 0)
+            out.push_back(OP_RUN | (run - 1));
+    }
+
+    /*!
+     * @return Whether the band decoded to exactly `pixelCount` pixels without reading past its end
+     */
+    template<int Channels>
+    bool decodeBand(const unsigned char *data, const size_t size, unsigned char *pixels, const size_t pixelCount) {
+        Rgba index[64]{};
+        Rgba pixel{0, 0, 0, 255};
+        size_t position = 0;
+
+        for (size_t i = 0; i < pixelCount;) {
+            if (position >= size)
+                return false;
+            const unsigned char op = data[position++];
+
+            if (op == OP_RGB || op == OP_RGBA) {
+                const size_t length = op == OP_RGB ? 3 : 4;
+                if (position + length > size)
+                    return false;
+                pixel.r = data[position];
+                pixel.g = data[position + 1];
+                pixel.b = data[position + 2];
+                if (op == OP_RGBA)
+                    pixel.a = data[position + 3];
+                position += length;
+            } else {
+                switch (op & OP_MASK) {
+                    case OP_INDEX:
+                        pixel = index[op];
+                        break;
+                    case OP_DIFF:
+                        pixel.r += ((op >> 4) & 0x03) - 2;
+                        pixel.g += ((op >> 2) & 0x03) - 2;
+                        pixel.b += (op & 0x03) - 2;
+                        break;
+                    case OP_LUMA: {
+                        if (position >= size)
+                            return false;
+                        const unsigned char next = data[position++];
+                        const int dg = (op & 0x3F) - 32;
+                        pixel.r += dg - 8 + ((next >> 4) & 0x0F);
+                        pixel.g += dg;
+                        pixel.b += dg - 8 + (next & 0x0F);
+                        break;
+                    }
+                    default: {  // OP_RUN
+                        const size_t run = (op & 0x3F) + 1;
+                        if (i + run > pixelCount)
+                            return false;
+                        for (size_t j = 0; j < run; j++)
+                            storePixel<Channels>(pixels + (i + j) * Channels, pixel);
+                        i += run;
+                        continue;  // A run repeats the previous pixel, which is already indexed
+                    }
+                }
+            }
+
+            index[getIndexPosition(pixel)] = pixel;
+            storePixel<Channels>(pixels + i * Channels, pixel);
+            i++;
+        }
+        return position == size;
+    }
+
+    void encodeBand(const int channelCount, const unsigned char *pixels, const size_t pixelCount, std::vector<unsigned char> &out) {
+        switch (channelCount) {
+            case 1: encodeBand<1>(pixels, pixelCount, out); break;
+            case 2: encodeBand<2>(pixels, pixelCount, out); break;
+            case 3: encodeBand<3>(pixels, pixelCount, out); break;
+            default: encodeBand<4>(pixels, pixelCount, out); break;
+        }
+    }
+
+    bool decodeBand(const int channelCount, const unsigned char *data, const size_t size, unsigned char *pixels, const size_t pixelCount) {
+        switch (channelCount) {
+            case 1: return decodeBand<1>(data, size, pixels, pixelCount);
+            case 2: return decodeBand<2>(data, size, pixels, pixelCount);
+            case 3: return decodeBand<3>(data, size, pixels, pixelCount);
+            default: return decodeBand<4>(data, size, pixels, pixelCount);
+        }
+    }
+
+    std::vector<unsigned char> encodeCookedImage(const Image &image) {
+        const int bandRows = std::max(COOKED_IMAGE_BAND_PIXELS / std::max(image.width, 1), 1);
+        const auto bandCount = static_cast<uint32_t>((image.height + bandRows - 1) / bandRows);
+        const size_t rowBytes = static_cast<size_t>(image.width) * image.channelCount;
+
+        std::vector<std::vector<unsigned char>> bands(bandCount);
+        ThreadPool::shared().parallelFor(bandCount, [&](const size_t band) {
+            const int firstRow = static_cast<int>(band) * bandRows;
+            const int rows = std::min(bandRows, image.height - firstRow);
+            encodeBand(image.channelCount, image.pixels.get() + firstRow * rowBytes,
+                static_cast<size_t>(image.width) * rows, bands[band]);
+        });
+
+        // The header, then where each band ends (relative to the first band), then the bands
+        const CookedImageHeader header{COOKED_IMAGE_MAGIC, COOKED_IMAGE_VERSION, image.width, image.height, image.channelCount, bandRows, bandCount};
+        std::vector<unsigned char> data(sizeof(header) + bandCount * sizeof(uint64_t));
+        std::memcpy(data.data(), &header, sizeof(header));
+        uint64_t end = 0;
+        for (uint32_t band = 0; band < bandCount; band++) {
+            end += bands[band].size();
+            std::memcpy(data.data() + sizeof(header) + band * sizeof(uint64_t), &end, sizeof(end));
+        }
+        data.reserve(data.size() + end);
+        for (const std::vector<unsigned char> &band : bands)
+            data.insert(data.end(), band.begin(), band.end());
+        return data;
+    }
+
+    std::expected<Image, std::string> decodeCookedImage(const std::span<const unsigned char> data) {
+        CookedImageHeader header{};
+        if (data.size() < sizeof(header))
+            return UNEXPECTED_REF("Cooked image is truncated");
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (header.magic != COOKED_IMAGE_MAGIC || header.version != COOKED_IMAGE_VERSION)
+            return UNEXPECTED_REF("Not a cooked image, or an outdated one");
+        if (header.width <= 0 || header.height <= 0 || header.channelCount < 1 || header.channelCount > 4 || header.bandRows <= 0
+            || header.bandCount != static_cast<uint32_t>((header.height + header.bandRows - 1) / header.bandRows))
+            return UNEXPECTED_REF("Cooked image has an invalid header");
+
+        const size_t bandsOffset = sizeof(header) + header.bandCount * sizeof(uint64_t);
+        if (data.size() < bandsOffset)
+            return UNEXPECTED_REF("Cooked image is truncated");
+        std::vector<uint64_t> bandEnds(header.bandCount);
+        std::memcpy(bandEnds.data(), data.data() + sizeof(header), header.bandCount * sizeof(uint64_t));
+        if (!std::ranges::is_sorted(bandEnds) || bandEnds.back() != data.size() - bandsOffset)
+            return UNEXPECTED_REF("Cooked image has invalid band offsets");
+
+        Image image;
+        image.width = header.width;
+        image.height = header.height;
+        image.channelCount = header.channelCount;
+        // Images are freed by stb_image, which uses free
+        image.pixels.reset(static_cast<unsigned char *>(std::malloc(image.byteSize())));
+        if (image.pixels == nullptr)
+            return UNEXPECTED_REF("Failed to allocate a cooked image");
+
+        const size_t rowBytes = static_cast<size_t>(image.width) * image.channelCount;
+        std::atomic<bool> corrupt = false;
+        ThreadPool::shared().parallelFor(header.bandCount, [&](const size_t band) {
+            const int firstRow = static_cast<int>(band) * header.bandRows;
+            const int rows = std::min(header.bandRows, image.height - firstRow);
+            const uint64_t begin = band > 0 ? bandEnds[band - 1] : 0;
+            if (!decodeBand(image.channelCount, data.data() + bandsOffset + begin, bandEnds[band] - begin,
+                    image.pixels.get() + firstRow * rowBytes, static_cast<size_t>(image.width) * rows))
+                corrupt = true;
+        });
+        if (corrupt)
+            return UNEXPECTED_REF("Cooked image is corrupt");
+        return image;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef COOKED_IMAGE_H
+#define COOKED_IMAGE_H
+
+#include <expected>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "texture.h"
+
+namespace Engine::Loader {
+    /*!
+     * Encode an image in the cooked image format: a QOI style byte stream, split into bands of rows that are encoded independently.
+     * It's larger than a PNG, but decodes several times faster, and its bands decode in parallel.
+     * @return The contents of the cooked image file.
+     */
+    std::vector<unsigned char> encodeCookedImage(const Image &image);
+    /*!
+     * Decode an image written by `encodeCookedImage`, with its bands spread across the shared thread pool.
+     * @return The image, or an error message if the data is corrupt or from another version.
+     * @note Safe to call from worker threads (including tasks of the shared pool).
+     */
+    std::expected<Image, std::string> decodeCookedImage(std::span<const unsigned char> data);
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include "equirectangular.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numbers>
+#include <gl/glew.h>
+
+#include <engine/loader/shader/compute_shader.h>
+#include <engine/util/thread_pool.h>
+
+#include "texture.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Must match the local size in equirectangular_to_cube.comp
+#define EQUIRECTANGULAR_GROUP_SIZE 8
+
+namespace Engine::Loader {
+    int getCubeMapFaceSize(const int equirectangularWidth) {
+        return std::max(equirectangularWidth / 4, 1);
+    }
+
+    /*!
+     * @brief Get the direction a cubemap texel looks in, following the face orientations of the OpenGL spec
+     * @param s The horizontal position on the face, from -1 to 1
+     * @param t The vertical position on the face, from -1 (the first row) to 1
+     */
+    void getFaceDirection(const int face, const float s, const float t, float &x, float &y, float &z) {
+        switch (face) {
+            case 0: x = 1.0f; y = -t; z = -s; break;   // +X
+            case 1: x = -1.0f; y = -t; z = s; break;   // -X
+            case 2: x = s; y = 1.0f; z = t; break;     // +Y
+            case 3: x = s; y = -1.0f; z = -t; break;   // -Y
+            case 4: x = s; y = -t; z = 1.0f; break;    // +Z
+            default: x = -s; y = -t; z = -1.0f; break; // -Z
+        }
+    }
+
+    /*!
+     * @brief Blend the four texels around a point of the panorama. The panorama wraps around horizontally, and clamps vertically
+     * @param u The horizontal position in texels, offset so texel centres are at whole numbers
+     * @param v The vertical position in texels, offset the same way
+     */
+    uint32_t sampleBilinear(const unsigned char *rgba, const int width, const int height, const float u, const float v) {
+        const float floorU = std::floor(u), floorV = std::floor(v);
+        int x0 = static_cast<int>(floorU) % width;
+        if (x0 < 0)
+            x0 += width;
+        const int x1 = x0 + 1 == width ? 0 : x0 + 1;
+        const int y0 = std::clamp(static_cast<int>(floorV), 0, height - 1);
+        const int y1 = std::min(static_cast<int>(floorV) + 1, height - 1);
+        // 8 bit fixed point weights, so both paths blend the same way
+        const int weightX = static_cast<int>((u - floorU) * 256.0f), weightY = std::clamp(static_cast<int>((v - floorV) * 256.0f), 0, 256);
+
+        uint32_t t00, t10, t01, t11;
+        std::memcpy(&t00, rgba + (static_cast<size_t>(y0) * width + x0) * 4, 4);
+        std::memcpy(&t10, rgba + (static_cast<size_t>(y0) * width + x1) * 4, 4);
+        std::memcpy(&t01, rgba + (static_cast<size_t>(y1) * width + x0) * 4, 4);
+        std::memcpy(&t11, rgba + (static_cast<size_t>(y1) * width + x1) * 4, 4);
+#ifdef __SSE2__
+        // Blend every channel of a pair of texels at once, in 16 bits. 255 * 256 + 128 still fits
+        const __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(128);
+        const __m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(t00)), _mm_cvtsi32_si128(static_cast<int>(t10))), zero);
+        const __m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(t01)), _mm_cvtsi32_si128(static_cast<int>(t11))), zero);
+        __m128i blended = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16(static_cast<short>(256 - weightY))),
+            _mm_mullo_epi16(bottom, _mm_set1_epi16(static_cast<short>(weightY))));
+        blended = _mm_srli_epi16(_mm_add_epi16(blended, half), 8);
+        // Left texel in the low half, right texel in the high half
+        const __m128i weightsX = _mm_set_epi16(
+            static_cast<short>(weightX), static_cast<short>(weightX), static_cast<short>(weightX), static_cast<short>(weightX),
+            static_cast<short>(256 - weightX), static_cast<short>(256 - weightX), static_cast<short>(256 - weightX), static_cast<short>(256 - weightX));
+        blended = _mm_mullo_epi16(blended, weightsX);
+        blended = _mm_add_epi16(blended, _mm_srli_si128(blended, 8));
+        blended = _mm_srli_epi16(_mm_add_epi16(blended, half), 8);
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(blended, zero)));
+#else
+        uint32_t result = 0;
+        for (int c = 0; c < 4; c++) {
+            const int shift = c * 8;
+            const int left = ((t00 >> shift & 0xFF) * (256 - weightY) + (t01 >> shift & 0xFF) * weightY + 128) >> 8;
+            const int right = ((t10 >> shift & 0xFF) * (256 - weightY) + (t11 >> shift & 0xFF) * weightY + 128) >> 8;
+            result |= static_cast<uint32_t>((left * (256 - weightX) + right * weightX + 128) >> 8) << shift;
+        }
+        return result;
+#endif
+    }
+
+#ifdef __SSE2__
+    /*!
+     * @brief `getFaceDirection` for four horizontally adjacent texels
+     */
+    void getFaceDirections(const int face, const __m128 s, const float t, __m128 &x, __m128 &y, __m128 &z) {
+        const __m128 one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+        const __m128 minusS = _mm_sub_ps(_mm_setzero_ps(), s), plusT = _mm_set1_ps(t), minusT = _mm_set1_ps(-t);
+        switch (face) {
+            case 0: x = one; y = minusT; z = minusS; break;
+            case 1: x = minusOne; y = minusT; z = s; break;
+            case 2: x = s; y = one; z = plusT; break;
+            case 3: x = s; y = minusOne; z = minusT; break;
+            case 4: x = s; y = minusT; z = one; break;
+            default: x = minusS; y = minusT; z = minusOne; break;
+        }
+    }
+
+    /*!
+     * @brief atan2 of four pairs at once, accurate to about 1e-5 radians
+     */
+    __m128 atan2Ps(const __m128 y, const __m128 x) {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 absY = _mm_andnot_ps(signMask, y), absX = _mm_andnot_ps(signMask, x);
+
+        // Fold everything into atan(a) with 0 <= a <= 1
+        const __m128 swap = _mm_cmpgt_ps(absY, absX);
+        const __m128 numerator = _mm_min_ps(absX, absY);
+        const __m128 denominator = _mm_max_ps(_mm_max_ps(absX, absY), _mm_set1_ps(1e-30f));
+        const __m128 a = _mm_div_ps(numerator, denominator);
+        const __m128 a2 = _mm_mul_ps(a, a);
+
+        __m128 polynomial = _mm_set1_ps(-0.01172120f);
+        polynomial = _mm_add_ps(_mm_mul_ps(polynomial, a2), _mm_set1_ps(0.05265332f));
+        polynomial = _mm_add_ps(_mm_mul_ps(polynomial, a2), _mm_set1_ps(-0.11643287f));
+        polynomial = _mm_add_ps(_mm_mul_ps(polynomial, a2), _mm_set1_ps(0.19354346f));
+        polynomial = _mm_add_ps(_mm_mul_ps(polynomial, a2), _mm_set1_ps(-0.33262347f));
+        polynomial = _mm_add_ps(_mm_mul_ps(polynomial, a2), _mm_set1_ps(0.99997726f));
+        __m128 angle = _mm_mul_ps(polynomial, a);
+
+        // Unfold: atan(1/a) = pi/2 - atan(a), then mirror into the quadrant of (x, y)
+        const __m128 halfPi = _mm_set1_ps(std::numbers::pi_v<float> / 2.0f);
+        angle = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(halfPi, angle)), _mm_andnot_ps(swap, angle));
+        const __m128 negativeX = _mm_cmplt_ps(x, _mm_setzero_ps());
+        angle = _mm_or_ps(_mm_and_ps(negativeX, _mm_sub_ps(_mm_set1_ps(std::numbers::pi_v<float>), angle)), _mm_andnot_ps(negativeX, angle));
+        return _mm_or_ps(angle, _mm_and_ps(signMask, y));
+    }
+#endif
+
+    void equirectangularToCubeMap(const unsigned char *rgba, const int width, const int height, const int faceSize, const std::span<unsigned char *const, 6> faces) {
+        // Texel centres of the panorama are at whole numbers
+        const float uScale = static_cast<float>(width) / (2.0f * std::numbers::pi_v<float>);
+        const float vScale = static_cast<float>(height) / std::numbers::pi_v<float>;
+        const float uOffset = static_cast<float>(width) * 0.5f - 0.5f, vOffset = static_cast<float>(height) * 0.5f - 0.5f;
+        const float texelSize = 2.0f / static_cast<float>(faceSize);
+
+        ThreadPool::shared().parallelFor(static_cast<size_t>(6) * faceSize, [&](const size_t row) {
+            const int face = static_cast<int>(row / faceSize), y = static_cast<int>(row % faceSize);
+            const float t = (static_cast<float>(y) + 0.5f) * texelSize - 1.0f;
+            auto *target = reinterpret_cast<uint32_t *>(faces[face]) + static_cast<size_t>(y) * faceSize;
+
+            int x = 0;
+#ifdef __SSE2__
+            // Find where four texels land in the panorama at once, then blend each one
+            alignas(16) float us[4], vs[4];
+            const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            for (; x + 4 <= faceSize; x += 4) {
+                const __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets), _mm_set1_ps(texelSize)), _mm_set1_ps(1.0f));
+                __m128 directionX, directionY, directionZ;
+                getFaceDirections(face, s, t, directionX, directionY, directionZ);
+
+                const __m128 longitude = atan2Ps(directionZ, directionX);
+                const __m128 horizontal = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(directionX, directionX), _mm_mul_ps(directionZ, directionZ)));
+                const __m128 latitude = atan2Ps(directionY, horizontal);
+                _mm_store_ps(us, _mm_add_ps(_mm_mul_ps(longitude, _mm_set1_ps(uScale)), _mm_set1_ps(uOffset)));
+                _mm_store_ps(vs, _mm_sub_ps(_mm_set1_ps(vOffset), _mm_mul_ps(latitude, _mm_set1_ps(vScale))));
+                for (int lane = 0; lane < 4; lane++)
+                    target[x + lane] = sampleBilinear(rgba, width, height, us[lane], vs[lane]);
+            }
+#endif
+            for (; x < faceSize; x++) {
+                float dx, dy, dz;
+                getFaceDirection(face, (static_cast<float>(x) + 0.5f) * texelSize - 1.0f, t, dx, dy, dz);
+                const float longitude = std::atan2(dz, dx);
+                const float latitude = std::atan2(dy, std::sqrt(dx * dx + dz * dz));
+                target[x] = sampleBilinear(rgba, width, height, longitude * uScale + uOffset, vOffset - latitude * vScale);
+            }
+        });
+    }
+
+    unsigned int equirectangularToCubeMapGpu(const unsigned int equirectangularTexture, const int faceSize, const ComputeShader &shader) {
+        unsigned int cubeMap;
+        glGenTextures(1, &cubeMap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, getMipLevelCount(faceSize, faceSize), GL_RGBA8, faceSize, faceSize);
+        setCubeMapParameters();
+
+        shader.use();
+        shader.setInt("equirectangular", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, equirectangularTexture);
+        // Bilinear, wrapping around horizontally like the CPU path. The panorama is only used for this, so its parameters can change
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // Layered, so every face can be written as a layer of a cube image
+        glBindImageTexture(0, cubeMap, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+        const auto groups = static_cast<GLuint>((faceSize + EQUIRECTANGULAR_GROUP_SIZE - 1) / EQUIRECTANGULAR_GROUP_SIZE);
+        glDispatchCompute(groups, groups, 6);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        return cubeMap;
+    }
+}
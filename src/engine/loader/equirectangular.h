@@ -0,0 +1,35 @@
+#ifndef EQUIRECTANGULAR_H
+#define EQUIRECTANGULAR_H
+
+#include <span>
+
+namespace Engine {
+    class ComputeShader;
+}
+
+namespace Engine::Loader {
+    /*!
+     * @return The cubemap face size that keeps a panorama's horizontal resolution, since each face covers a quarter of it
+     */
+    [[nodiscard]] int getCubeMapFaceSize(int equirectangularWidth);
+
+    /*!
+     * @brief Project an equirectangular (latitude/longitude) panorama onto the six faces of a cubemap, with bilinear filtering
+     * @param rgba Tightly packed RGBA pixels of the panorama. The top row looks straight up (+Y), and the centre looks down +X
+     * @param faces Where to write the `faceSize` * `faceSize` RGBA pixels of each face,
+     *  in the order of the `GL_TEXTURE_CUBE_MAP_*` targets (+X, -X, +Y, -Y, +Z, -Z)
+     * @note Rows are converted in parallel on the shared thread pool (safe to call from one of its tasks)
+     */
+    void equirectangularToCubeMap(const unsigned char *rgba, int width, int height, int faceSize, std::span<unsigned char *const, 6> faces);
+
+    /*!
+     * @brief Project an equirectangular panorama onto a new cubemap on the GPU, then generate its mipmaps
+     * @param equirectangularTexture The panorama, as a 2D texture
+     * @param shader equirectangular_to_cube.comp, which writes every face of a cubemap image
+     * @return The cubemap's texture ID, with immutable RGBA8 storage
+     * @attention It is YOUR responsibility to free the memory allocated by opengl.
+     */
+    unsigned int equirectangularToCubeMapGpu(unsigned int equirectangularTexture, int faceSize, const ComputeShader &shader);
+}
+
+#endif
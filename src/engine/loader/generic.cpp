@@ -1,4 +1,5 @@
 #include "generic.h"
+#include <filesystem>
 #include <fstream>
 #include <engine/logging.h>
 
@@ -19,4 +20,44 @@ namespace Engine::Loader {
         std::string fileContents((std::istreambuf_iterator(file)), std::istreambuf_iterator<char>());
         return fileContents;
     }
+
+    std::expected<std::vector<unsigned char>, std::string> readBinaryFile(const std::string &filePath) {
+        std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+            return UNEXPECTED_REF("Failed to open file: " + filePath);
+
+        std::vector<unsigned char> fileContents(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(fileContents.data()), static_cast<std::streamsize>(fileContents.size()));
+        if (!file.good())
+            return UNEXPECTED_REF("Failed to read file: " + filePath);
+        return fileContents;
+    }
+
+    std::string getCachePath(const std::string &sourcePath, const std::string &suffix) {
+        // Keep the cache relative, even if the source path isn't
+        return (std::filesystem::path(CACHE_DIR) / std::filesystem::path(sourcePath).relative_path()).string() + suffix;
+    }
+
+    bool isCacheFresh(const std::string &cachePath, const std::string &sourcePath) {
+        std::error_code error;
+        const auto cacheTime = std::filesystem::last_write_time(cachePath, error);
+        if (error)
+            return false;
+        const auto sourceTime = std::filesystem::last_write_time(sourcePath, error);
+        // If the source is gone, the cache is all we have
+        return error || cacheTime >= sourceTime;
+    }
+
+    std::expected<void, std::string> createParentDirectories(const std::string &filePath) {
+        const auto parent = std::filesystem::path(filePath).parent_path();
+        if (parent.empty())
+            return {};
+
+        std::error_code error;
+        std::filesystem::create_directories(parent, error);
+        if (error)
+            return UNEXPECTED_REF("Failed to create directory \"" + parent.string() + "\": " + error.message());
+        return {};
+    }
 }
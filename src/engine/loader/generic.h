@@ -2,10 +2,32 @@
 #define GENERIC_H
 #include <expected>
 #include <string>
+#include <vector>
+
+// Where cooked assets (partitioned worlds, compressed textures...) are written
+#define CACHE_DIR "cache/"
 
 namespace Engine::Loader {
     std::expected<std::string, std::string> readTextFile(const char* filePath);
     std::expected<std::string, std::string> readTextFile(const std::string &filePath);
+    std::expected<std::vector<unsigned char>, std::string> readBinaryFile(const std::string &filePath);
+
+    /*!
+     * @brief Get the path a cooked version of a source asset should be stored at
+     * @param sourcePath The path of the source asset
+     * @param suffix Appended to the cooked file name, usually to set its extension
+     * @return A path inside `CACHE_DIR` mirroring the source path
+     */
+    std::string getCachePath(const std::string &sourcePath, const std::string &suffix);
+    /*!
+     * @return Whether `cachePath` exists and is at least as new as `sourcePath`
+     */
+    bool isCacheFresh(const std::string &cachePath, const std::string &sourcePath);
+    /*!
+     * @brief Create all parent directories of a file path
+     * @return An error message if the directories couldn't be created
+     */
+    std::expected<void, std::string> createParentDirectories(const std::string &filePath);
 }
 
 #endif //GENERIC_H
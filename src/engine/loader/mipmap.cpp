@@ -0,0 +1,263 @@
+#include "mipmap.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+
+#include <engine/util/thread_pool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// In destination texels. Two lobes of sinc is sharp, while the window keeps ringing down
+#define KAISER_RADIUS 2.0f
+#define KAISER_ALPHA 4.0f
+// Resolution of the table linear values are re-encoded to sRGB with
+#define SRGB_ENCODE_TABLE_SIZE 4096
+#define ALPHA_HISTOGRAM_SIZE 1024
+
+namespace Engine::Loader {
+    MipOptions getMipOptions(const int channelCount, const TextureUsage usage) {
+        const bool diffuse = usage == TextureUsage::DIFFUSE;
+        MipOptions options;
+        options.srgb = diffuse && channelCount >= 3;
+        options.alphaCutoff = diffuse && channelCount == 4 ? ALPHA_CUTOUT_THRESHOLD : 0.0f;
+        return options;
+    }
+
+    struct SrgbTables {
+        std::array<float, 256> decode;
+        std::array<unsigned char, SRGB_ENCODE_TABLE_SIZE> encode;
+
+        SrgbTables() {
+            for (int i = 0; i < 256; i++) {
+                const float value = static_cast<float>(i) / 255.0f;
+                decode[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+            }
+            for (int i = 0; i < SRGB_ENCODE_TABLE_SIZE; i++) {
+                const float value = (static_cast<float>(i) + 0.5f) / SRGB_ENCODE_TABLE_SIZE;
+                const float encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+                encode[i] = static_cast<unsigned char>(std::lround(std::clamp(encoded, 0.0f, 1.0f) * 255.0f));
+            }
+        }
+    };
+
+    const SrgbTables &getSrgbTables() {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    float besselI0(const float x) {
+        // The power series converges quickly for the small arguments the window uses
+        float sum = 1.0f, term = 1.0f;
+        for (int k = 1; k < 20; k++) {
+            term *= (x / (2.0f * static_cast<float>(k))) * (x / (2.0f * static_cast<float>(k)));
+            sum += term;
+        }
+        return sum;
+    }
+
+    float kaiserSinc(const float t) {
+        if (std::abs(t) >= KAISER_RADIUS)
+            return 0.0f;
+        const float sinc = t == 0.0f ? 1.0f : std::sin(std::numbers::pi_v<float> * t) / (std::numbers::pi_v<float> * t);
+        const float ratio = t / KAISER_RADIUS;
+        return sinc * besselI0(KAISER_ALPHA * std::sqrt(1.0f - ratio * ratio)) / besselI0(KAISER_ALPHA);
+    }
+
+    // The source texels a destination texel is filtered from, along one axis
+    struct FilterTaps {
+        std::vector<int> indices;
+        std::vector<float> weights;
+    };
+
+    /*!
+     * @brief Compute the normalised filter weights of every destination texel along one axis
+     */
+    std::vector<FilterTaps> computeFilterTaps(const int sourceSize, const int targetSize, const MipFilter filter, const bool wrap) {
+        const float scale = static_cast<float>(sourceSize) / static_cast<float>(targetSize);
+        std::vector<FilterTaps> taps(targetSize);
+        for (int x = 0; x < targetSize; x++) {
+            const float begin = static_cast<float>(x) * scale, end = static_cast<float>(x + 1) * scale;
+            int first, last;
+            if (filter == MipFilter::BOX) {
+                first = static_cast<int>(std::floor(begin));
+                last = static_cast<int>(std::ceil(end)) - 1;
+            } else {
+                const float centre = (begin + end) * 0.5f;
+                first = static_cast<int>(std::floor(centre - KAISER_RADIUS * scale));
+                last = static_cast<int>(std::ceil(centre + KAISER_RADIUS * scale));
+            }
+
+            float total = 0.0f;
+            for (int i = first; i <= last; i++) {
+                // Box weights are how much of the source texel the destination texel covers, which handles odd sizes exactly
+                const float weight = filter == MipFilter::BOX
+                    ? std::max(std::min(static_cast<float>(i + 1), end) - std::max(static_cast<float>(i), begin), 0.0f)
+                    : kaiserSinc((static_cast<float>(i) + 0.5f - (begin + end) * 0.5f) / scale);
+                if (weight == 0.0f)
+                    continue;
+
+                int index = i;
+                if (wrap)
+                    index = (i % sourceSize + sourceSize) % sourceSize;
+                else
+                    index = std::clamp(i, 0, sourceSize - 1);
+                taps[x].indices.push_back(index);
+                taps[x].weights.push_back(weight);
+                total += weight;
+            }
+            for (float &weight : taps[x].weights)
+                weight /= total;
+        }
+        return taps;
+    }
+
+    /*!
+     * @brief Resample an RGBA float image with a separable filter: first along rows, then along columns
+     */
+    std::vector<float> resample(const std::vector<float> &source, const int width, const int height,
+            const int targetWidth, const int targetHeight, const MipOptions &options) {
+        const std::vector<FilterTaps> tapsX = computeFilterTaps(width, targetWidth, options.filter, options.wrap);
+        const std::vector<FilterTaps> tapsY = computeFilterTaps(height, targetHeight, options.filter, options.wrap);
+
+        std::vector<float> horizontal(static_cast<size_t>(targetWidth) * height * 4);
+        ThreadPool::shared().parallelFor(height, [&](const size_t y) {
+            const float *row = source.data() + y * width * 4;
+            float *target = horizontal.data() + y * targetWidth * 4;
+            for (int x = 0; x < targetWidth; x++) {
+                const FilterTaps &taps = tapsX[x];
+#ifdef __SSE2__
+                // A texel is four floats, so each tap is a single multiply-add
+                __m128 sum = _mm_setzero_ps();
+                for (size_t i = 0; i < taps.indices.size(); i++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + taps.indices[i] * 4), _mm_set1_ps(taps.weights[i])));
+                _mm_storeu_ps(target + x * 4, sum);
+#else
+                float sum[4] = {};
+                for (size_t i = 0; i < taps.indices.size(); i++)
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += row[taps.indices[i] * 4 + c] * taps.weights[i];
+                std::copy_n(sum, 4, target + x * 4);
+#endif
+            }
+        });
+
+        // Columns are filtered a whole row at a time, so every tap reads contiguous memory
+        const size_t rowFloats = static_cast<size_t>(targetWidth) * 4;
+        std::vector<float> result(rowFloats * targetHeight);
+        ThreadPool::shared().parallelFor(targetHeight, [&](const size_t y) {
+            float *target = result.data() + y * rowFloats;
+            const FilterTaps &taps = tapsY[y];
+            for (size_t i = 0; i < taps.indices.size(); i++) {
+                const float *row = horizontal.data() + taps.indices[i] * rowFloats;
+                const float weight = taps.weights[i];
+                size_t j = 0;
+#ifdef __SSE2__
+                const __m128 weights = _mm_set1_ps(weight);
+                for (; j + 4 <= rowFloats; j += 4)
+                    _mm_storeu_ps(target + j, _mm_add_ps(_mm_loadu_ps(target + j), _mm_mul_ps(_mm_loadu_ps(row + j), weights)));
+#endif
+                for (; j < rowFloats; j++)
+                    target[j] += row[j] * weight;
+            }
+        });
+        return result;
+    }
+
+    std::vector<float> decodeLevel(const unsigned char *pixels, const int width, const int height, const int channelCount, const bool srgb) {
+        const std::array<float, 256> &decode = getSrgbTables().decode;
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+        std::vector<float> rgba(pixelCount * 4);
+        for (size_t i = 0; i < pixelCount; i++) {
+            const unsigned char *source = pixels + i * channelCount;
+            float *target = rgba.data() + i * 4;
+            for (int c = 0; c < 4; c++) {
+                if (c >= channelCount)
+                    target[c] = c == 3 ? 1.0f : 0.0f;
+                else if (srgb && c < 3)
+                    target[c] = decode[source[c]];
+                else
+                    target[c] = static_cast<float>(source[c]) / 255.0f;
+            }
+        }
+        return rgba;
+    }
+
+    MipLevel encodeLevel(const std::vector<float> &rgba, const int width, const int height, const int channelCount, const bool srgb, const float alphaScale) {
+        const std::array<unsigned char, SRGB_ENCODE_TABLE_SIZE> &encode = getSrgbTables().encode;
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+        MipLevel level{width, height, std::vector<unsigned char>(pixelCount * channelCount)};
+        for (size_t i = 0; i < pixelCount; i++) {
+            const float *source = rgba.data() + i * 4;
+            unsigned char *target = level.pixels.data() + i * channelCount;
+            for (int c = 0; c < channelCount; c++) {
+                // Sharper filters overshoot, so clamp
+                const float value = std::clamp(c == 3 ? source[c] * alphaScale : source[c], 0.0f, 1.0f);
+                if (srgb && c < 3)
+                    target[c] = encode[std::min(static_cast<int>(value * SRGB_ENCODE_TABLE_SIZE), SRGB_ENCODE_TABLE_SIZE - 1)];
+                else
+                    target[c] = static_cast<unsigned char>(std::lround(value * 255.0f));
+            }
+        }
+        return level;
+    }
+
+    /*!
+     * @brief Find the scale that makes the same fraction of a level's alpha pass the alpha test as in the top level
+     * @param coverage The fraction of texels that pass the test in the top level
+     */
+    float getAlphaCoverageScale(const std::vector<float> &rgba, const float cutoff, const float coverage) {
+        // Find the alpha value that `coverage` of the texels are above, then scale that value up (or down) to the cutoff
+        std::array<size_t, ALPHA_HISTOGRAM_SIZE> histogram{};
+        const size_t pixelCount = rgba.size() / 4;
+        for (size_t i = 0; i < pixelCount; i++)
+            histogram[std::min(static_cast<size_t>(std::max(rgba[i * 4 + 3], 0.0f) * ALPHA_HISTOGRAM_SIZE), static_cast<size_t>(ALPHA_HISTOGRAM_SIZE - 1))]++;
+
+        const auto wanted = static_cast<size_t>(std::lround(coverage * static_cast<float>(pixelCount)));
+        if (wanted == 0)
+            return 1.0f;  // Nothing passed to begin with
+        size_t passing = 0;
+        for (int bin = ALPHA_HISTOGRAM_SIZE - 1; bin >= 0; bin--) {
+            passing += histogram[bin];
+            if (passing >= wanted) {
+                const float threshold = static_cast<float>(bin) / ALPHA_HISTOGRAM_SIZE;
+                return threshold > 0.0f ? cutoff / threshold : 1.0f;
+            }
+        }
+        return 1.0f;
+    }
+
+    std::vector<MipLevel> generateMipChain(const unsigned char *pixels, int width, int height, const int channelCount, const MipOptions &options) {
+        const bool srgb = options.srgb && channelCount >= 3;
+        const bool preserveCoverage = options.alphaCutoff > 0.0f && channelCount == 4;
+
+        float coverage = 0.0f;
+        if (preserveCoverage) {
+            const auto cutoff = static_cast<unsigned char>(std::ceil(options.alphaCutoff * 255.0f));
+            const size_t pixelCount = static_cast<size_t>(width) * height;
+            size_t passing = 0;
+            for (size_t i = 0; i < pixelCount; i++)
+                passing += pixels[i * 4 + 3] >= cutoff;
+            coverage = static_cast<float>(passing) / static_cast<float>(pixelCount);
+        }
+
+        std::vector<MipLevel> levels;
+        std::vector<float> current = decodeLevel(pixels, width, height, channelCount, srgb);
+        while (width > 1 || height > 1) {
+            const int targetWidth = std::max(width / 2, 1), targetHeight = std::max(height / 2, 1);
+            std::vector<float> next = resample(current, width, height, targetWidth, targetHeight, options);
+
+            // Only the stored level is scaled, so the error doesn't compound down the chain
+            const float alphaScale = preserveCoverage ? getAlphaCoverageScale(next, options.alphaCutoff, coverage) : 1.0f;
+            levels.push_back(encodeLevel(next, targetWidth, targetHeight, channelCount, srgb, alphaScale));
+
+            current = std::move(next);
+            width = targetWidth;
+            height = targetHeight;
+        }
+        return levels;
+    }
+}
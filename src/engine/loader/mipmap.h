@@ -0,0 +1,59 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <vector>
+
+// frag.frag discards fragments whose diffuse alpha is below this
+#define ALPHA_CUTOUT_THRESHOLD 0.5f
+
+namespace Engine::Loader {
+    enum class MipFilter {
+        BOX,  // Averages each 2x2 block. Cheap, but aliases
+        KAISER  // A Kaiser windowed sinc, which keeps detail sharp without ringing much
+    };
+
+    /*!
+     * What a texture is sampled as, which decides how its mip chain is filtered.
+     */
+    enum class TextureUsage {
+        DIFFUSE,  // sRGB colour, whose alpha is a cutout (see frag.frag)
+        SPECULAR  // Linear intensities, where alpha is just another channel
+    };
+
+    struct MipOptions {
+        MipFilter filter = MipFilter::KAISER;
+        // Whether the colour channels are sRGB encoded, and should be filtered in linear space so levels don't darken
+        bool srgb = true;
+        // Whether the image tiles, so the filter wraps around its edges rather than clamping to them
+        bool wrap = true;
+        // If positive, the alpha of each level is scaled so the fraction of texels passing this alpha test matches the top level.
+        // Otherwise cutouts like foliage thin out and vanish in the distance
+        float alphaCutoff = 0.0f;
+    };
+
+    /*!
+     * A single level of a mip chain, with the channel count of the image it was generated from.
+     */
+    struct MipLevel {
+        int width, height;
+        std::vector<unsigned char> pixels;
+    };
+
+    /*!
+     * Get the options suited to an image's channels and usage: diffuse colour images are treated as sRGB,
+     * and diffuse images with alpha preserve their alpha test coverage. Specular images are filtered as linear data.
+     */
+    MipOptions getMipOptions(int channelCount, TextureUsage usage);
+
+    /*!
+     * Generate every mip level below an image, down to 1x1.
+     * Each level is filtered from the one above it, with rows spread across the shared thread pool.
+     * @param pixels Tightly packed pixels, with 8 bits per channel.
+     * @param channelCount 1 to 4. With fewer than 3 channels, `options.srgb` is ignored, and alpha is only the 4th channel.
+     * @return The levels, largest first, excluding the top level itself.
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads (including tasks of the shared pool).
+     */
+    std::vector<MipLevel> generateMipChain(const unsigned char *pixels, int width, int height, int channelCount, const MipOptions &options);
+}
+
+#endif
@@ -1,5 +1,9 @@
 #include "scene.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <assimp/cimport.h>
 #include <engine/logging.h>
@@ -8,10 +12,12 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <engine/util/geometry.h>
+#include <engine/util/thread_pool.h>
 #include <glm/ext/matrix_transform.hpp>
 
+#include <engine/render/ring_buffer.h>
+
 #include "shader/graphics_shader.h"
-#include "engine/manager/texture.h"
 
 #ifndef NDEBUG
 #include <chrono>
@@ -32,11 +38,9 @@
 
 namespace Engine::Loader {
 #pragma region Loading
-    std::expected<Node, std::string> processNode(const aiNode *loadedNode);
-    std::expected<Mesh, std::string> processMesh(const aiMesh *loadedMesh);
-    std::expected<Material, std::string> processMaterial(const aiMaterial *loadedMaterial);
+    std::expected<Mesh, std::string> processMesh(const aiMesh *loadedMesh, bool keepGeometry, size_t &releasedCpuBytes);
 
-    std::expected<Scene, std::string> loadScene(const std::string &path) {
+    std::expected<Scene, std::string> loadScene(const std::string &path, const SceneLoadOptions &options) {
 #ifndef NDEBUG
         const auto start = std::chrono::high_resolution_clock::now();
 #endif
@@ -49,8 +53,6 @@ namespace Engine::Loader {
         if (!loadedNode || loadedNode->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !loadedNode->mRootNode)
             return std::unexpected(std::string("Failed to load scene: ") + importer.GetErrorString());
 
-        if (loadedNode->mNumTextures > 0)
-            logWarn("Embedded textures are not supported");
         if (loadedNode->mNumLights > 0)
             logWarn("Lights are not supported");
         if (loadedNode->mNumCameras > 0)
@@ -63,13 +65,19 @@ namespace Engine::Loader {
         if (!rootNode.has_value())
             return std::unexpected(FW_UNEXP(rootNode, "Failed to load node tree"));
 
+        // Decoded while the importer still owns the compressed data, so it never has to be copied
+        std::expected<std::vector<EmbeddedTexture>, std::string> embeddedTextures = processEmbeddedTextures(loadedNode, path);
+        if (!embeddedTextures.has_value())
+            return std::unexpected(FW_UNEXP(embeddedTextures, "Failed to load embedded textures"));
+
         std::vector<Mesh> meshes;
         std::vector<Material> materials;
+        size_t releasedCpuBytes = 0;
 
         // Load all the meshes
         meshes.reserve(loadedNode->mNumMeshes);
         for (unsigned int i = 0; i < loadedNode->mNumMeshes; i++) {
-            std::expected<Mesh, std::string> mesh = processMesh(loadedNode->mMeshes[i]);
+            std::expected<Mesh, std::string> mesh = processMesh(loadedNode->mMeshes[i], options.keepGeometry, releasedCpuBytes);
             if (!mesh.has_value())
                 return std::unexpected(FW_UNEXP(mesh, "Failed to load mesh "+std::to_string(i)+));
             meshes.push_back(std::move(mesh.value()));
@@ -81,21 +89,88 @@ namespace Engine::Loader {
             std::expected<Material, std::string> material = processMaterial(loadedNode->mMaterials[i]);
             if (!material.has_value())
                 return std::unexpected(FW_UNEXP(material, "Failed to load material "+std::to_string(i)+));
+            resolveEmbeddedTexturePath(loadedNode, path, material->diffusePath);
+            resolveEmbeddedTexturePath(loadedNode, path, material->specularPath);
             materials.push_back(material.value());
         }
 
 #ifndef NDEBUG
-        logDebug("Loaded scene \"%s\" in %d ms", path.c_str(),
-            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count());
+        logDebug("Loaded scene \"%s\" in %d ms (released %zu KiB of CPU geometry)", path.c_str(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count(),
+            releasedCpuBytes / 1024);
 #else
-        logDebug("Loaded scene \"%s\"", path.c_str());
+        logDebug("Loaded scene \"%s\" (released %zu KiB of CPU geometry)", path.c_str(), releasedCpuBytes / 1024);
 #endif
 
-        return Scene{
+        Scene scene{
             rootNode.value(),
             std::move(meshes),
             materials,
         };
+        scene.embeddedTextures = std::move(embeddedTextures.value());
+        scene.releasedCpuBytes = releasedCpuBytes;
+        return scene;
+    }
+
+    std::string getEmbeddedTextureKey(const std::string &scenePath, const unsigned int index) {
+        // Assimp refers to embedded textures as "*<index>", so this reads as the texture inside the scene file
+        return scenePath + "*" + std::to_string(index);
+    }
+
+    std::expected<Image, std::string> decodeEmbeddedTexture(const aiTexture *texture) {
+        // A height of 0 means the texels are a compressed image file, `mWidth` bytes long
+        if (texture->mHeight == 0)
+            return decodeImage(std::span(reinterpret_cast<const unsigned char *>(texture->pcData), texture->mWidth));
+
+        Image image;
+        image.width = static_cast<int>(texture->mWidth);
+        image.height = static_cast<int>(texture->mHeight);
+        image.channelCount = 4;
+        // Images are freed by stb_image, which uses free
+        image.pixels.reset(static_cast<unsigned char *>(std::malloc(image.byteSize())));
+        if (image.pixels == nullptr)
+            return UNEXPECTED_REF("Failed to allocate an embedded texture");
+
+        const size_t texelCount = static_cast<size_t>(image.width) * image.height;
+        for (size_t i = 0; i < texelCount; i++) {
+            const aiTexel &texel = texture->pcData[i];
+            unsigned char *pixel = image.pixels.get() + i * 4;
+            pixel[0] = texel.r;
+            pixel[1] = texel.g;
+            pixel[2] = texel.b;
+            pixel[3] = texel.a;
+        }
+        return image;
+    }
+
+    std::expected<std::vector<EmbeddedTexture>, std::string> processEmbeddedTextures(const aiScene *loadedScene, const std::string &path) {
+        std::vector<EmbeddedTexture> textures(loadedScene->mNumTextures);
+        std::vector<std::string> errors(loadedScene->mNumTextures);
+        std::atomic<bool> failed = false;
+        ThreadPool::shared().parallelFor(loadedScene->mNumTextures, [&](const size_t i) {
+            std::expected<Image, std::string> image = decodeEmbeddedTexture(loadedScene->mTextures[i]);
+            if (!image.has_value()) {
+                errors[i] = image.error();
+                failed = true;
+                return;
+            }
+            textures[i] = {getEmbeddedTextureKey(path, static_cast<unsigned int>(i)), std::move(image.value())};
+        });
+
+        if (failed) {
+            const auto error = std::ranges::find_if(errors, [](const std::string &message) { return !message.empty(); });
+            return std::unexpected(FILE_REF + "Failed to decode embedded texture " + std::to_string(error - errors.begin()) + NL_INDENT + *error);
+        }
+        return textures;
+    }
+
+    void resolveEmbeddedTexturePath(const aiScene *loadedScene, const std::string &scenePath, std::string &texturePath) {
+        if (texturePath.empty())
+            return;
+        // Matches both "*<index>" and formats that refer to embedded textures by their original file name
+        const auto [texture, index] = loadedScene->GetEmbeddedTextureAndIndex(texturePath.c_str());
+        if (texture != nullptr && index >= 0)
+            texturePath = getEmbeddedTextureKey(scenePath, static_cast<unsigned int>(index));
     }
 
     std::expected<Node, std::string> processNode(const aiNode *loadedNode) {
@@ -113,10 +188,9 @@ namespace Engine::Loader {
         return resultNode;
     }
 
-    std::expected<Mesh, std::string> processMesh(const aiMesh *loadedMesh) {
+    std::vector<MeshVertex> extractVertices(const aiMesh *loadedMesh) {
         std::vector<MeshVertex> vertices;
-        std::vector<unsigned int> indices;
-        const unsigned int materialIndex = loadedMesh->mMaterialIndex;
+        vertices.reserve(loadedMesh->mNumVertices);
 
         for (unsigned int i = 0; i < loadedMesh->mNumVertices; i++) {
             MeshVertex vertex;
@@ -135,14 +209,32 @@ namespace Engine::Loader {
 
             vertices.push_back(vertex);
         }
+        return vertices;
+    }
+
+    std::vector<unsigned int> extractIndices(const aiMesh *loadedMesh) {
+        std::vector<unsigned int> indices;
+        indices.reserve(loadedMesh->mNumFaces * 3);  // We triangulate on import
 
         for (unsigned int i = 0; i < loadedMesh->mNumFaces; i++) {
             const aiFace &face = loadedMesh->mFaces[i];
             for (unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+        return indices;
+    }
+
+    std::expected<Mesh, std::string> processMesh(const aiMesh *loadedMesh, const bool keepGeometry, size_t &releasedCpuBytes) {
+        const std::vector<MeshVertex> vertices = extractVertices(loadedMesh);
+        const std::vector<unsigned int> indices = extractIndices(loadedMesh);
+
+        Mesh mesh{vertices, indices, loadedMesh->mMaterialIndex, keepGeometry};
 
-        return Mesh{std::move(vertices), std::move(indices), materialIndex};
+        // The full vertex and index arrays go out of scope here, only the (optional) position-only copy survives
+        releasedCpuBytes += vertices.size() * sizeof(MeshVertex) + indices.size() * sizeof(unsigned int);
+        if (mesh.geometry)
+            releasedCpuBytes -= mesh.geometry->byteSize();
+        return mesh;
     }
 
     std::expected<Material, std::string> processMaterial(const aiMaterial *loadedMaterial) {
@@ -174,42 +266,71 @@ namespace Engine::Loader {
         glBindVertexArray(VAO);
     }
 
-    std::expected<void, std::string> Scene::Draw(Manager::TextureManager &textureManager, const GraphicsShader &shader, const glm::mat4 &modelTransform) const {
-        // TODO: Only do unique per-scene stuff here, and don't double-use the shader
-        shader.use();
-        for (const Mesh &mesh: meshes) {
-            auto matRet = materials[mesh.materialIndex].PopulateShader(shader, textureManager);
-            if (!matRet.has_value())
-                return std::unexpected(FW_UNEXP(matRet, "Failed to populate shader with material"));
+    void Mesh::draw(const unsigned int materialId) const {
+        drawInstanced(1, materialId);
+    }
 
-            const auto model = rootNode.transform * modelTransform;
-            shader.setMat4("model", model);
-            shader.setMat3("mTransposed", glm::mat3(glm::transpose(glm::inverse(model))));
+    void Mesh::drawInstanced(const unsigned int instanceCount, const unsigned int materialId) const {
+        bindGlMesh();
+        // No attribute has a divisor, so the base instance only reaches the shaders as gl_BaseInstance
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, indexType, nullptr, instanceCount, materialId);
+    }
 
-            mesh.bindGlMesh();
-            glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, nullptr);
-        }
+    size_t Mesh::gpuBytes() const {
+        const size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        return vertexCount * sizeof(MeshVertex) + indexCount * indexSize;
+    }
+
+    bool Scene::hasGeometry() const {
+        return std::ranges::all_of(meshes, [](const Mesh &mesh) { return mesh.geometry != nullptr; });
+    }
+
+    size_t Scene::geometryBytes() const {
+        size_t bytes = 0;
+        for (const Mesh &mesh : meshes)
+            if (mesh.geometry)
+                bytes += mesh.geometry->byteSize();
+        return bytes;
+    }
+
+    size_t Scene::gpuBytes() const {
+        size_t bytes = 0;
+        for (const Mesh &mesh : meshes)
+            bytes += mesh.gpuBytes();
+        return bytes;
+    }
+
+    std::expected<void, std::string> bindTransform(RingBuffer &constants, const glm::mat4 &model) {
+        const std::optional<RingAllocation> transform = constants.push(TransformData{
+            model, glm::mat3x4(glm::mat3(glm::transpose(glm::inverse(model))))});
+        if (!transform.has_value())
+            return UNEXPECTED_REF("Out of per-frame constant memory for a transform");
+        constants.bind(GL_UNIFORM_BUFFER, TRANSFORM_BLOCK_BINDING, transform.value());
         return {};
     }
 
-    std::expected<void, std::string> Material::PopulateShader(const GraphicsShader &shader, Manager::TextureManager &textureManager) const {
-        shader.setFloat("material.shininess", shininess);
-        shader.setInt("material.test", textureManager.errorTexture);
+    std::expected<void, std::string> Scene::Draw(const GraphicsShader &shader, RingBuffer &constants, const glm::mat4 &modelTransform) const {
+        auto transformRet = bindTransform(constants, rootNode.transform * modelTransform);
+        if (!transformRet.has_value())
+            return std::unexpected(FW_UNEXP(transformRet, "Failed to bind the scene's transform"));
+        DrawMeshes(shader);
+        return {};
+    }
 
-        std::expected<unsigned int, std::string> diffuse = textureManager.getTexture(diffusePath);
-        if (!diffuse.has_value())
-            return std::unexpected(FW_UNEXP(diffuse, "Failed to load diffuse texture"));
-        shader.setInt("material.texture_diffuse", 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuse.value_or(textureManager.errorTexture));
+    void Scene::DrawMeshes(const GraphicsShader &shader) const {
+        // TODO: Only do unique per-scene stuff here, and don't double-use the shader
+        shader.use();
+        for (const Mesh &mesh: meshes)
+            mesh.draw(materials[mesh.materialIndex].id);
+    }
 
-        std::expected<unsigned int, std::string> specular = textureManager.getTexture(specularPath);
-        if (!specular.has_value())
-            return std::unexpected(FW_UNEXP(specular, "Failed to load specular texture"));
-        shader.setInt("material.texture_specular", 1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specular.value_or(textureManager.errorTexture));
+    std::expected<void, std::string> Scene::DrawInstanced(const GraphicsShader &shader, const unsigned int instanceCount) const {
+        if (instanceCount == 0)
+            return {};
 
+        shader.use();
+        for (const Mesh &mesh: meshes)
+            mesh.drawInstanced(instanceCount, materials[mesh.materialIndex].id);
         return {};
     }
 #pragma endregion
@@ -226,25 +347,55 @@ namespace Engine::Loader {
         rootNode = std::move(other.rootNode);
         meshes = std::move(other.meshes);
         materials = std::move(other.materials);
+        embeddedTextures = std::move(other.embeddedTextures);
+        releasedCpuBytes = other.releasedCpuBytes;
     }
     Scene &Scene::operator=(Scene &&other) noexcept {
         if (this != &other) {
             rootNode = std::move(other.rootNode);
             meshes = std::move(other.meshes);
             materials = std::move(other.materials);
+            embeddedTextures = std::move(other.embeddedTextures);
+            releasedCpuBytes = other.releasedCpuBytes;
         }
         return *this;
     }
 
     Mesh::Mesh(
-        std::vector<MeshVertex> &&vertices,
-        std::vector<unsigned int> &&indices,
-        const unsigned int materialIndex
-    ) : vertices(std::move(vertices)), indices(std::move(indices)), materialIndex(materialIndex) {
-        setupGlMesh();
+        const std::vector<MeshVertex> &vertices,
+        const std::vector<unsigned int> &indices,
+        const unsigned int materialIndex,
+        const bool keepGeometry
+    ) : materialIndex(materialIndex), vertexCount(vertices.size()), indexCount(indices.size()) {
+        for (const MeshVertex &vertex : vertices)
+            bounds.extend(vertex.Position);
+
+        // Compare the area covered in texture space to the area covered in world space. Both are doubled, which cancels out
+        float uvArea = 0.0f, worldArea = 0.0f;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const MeshVertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+            worldArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+            const glm::vec2 uvB = b.TexCoords - a.TexCoords, uvC = c.TexCoords - a.TexCoords;
+            uvArea += std::abs(uvB.x * uvC.y - uvB.y * uvC.x);
+        }
+        if (worldArea > 0.0f)
+            uvDensity = std::sqrt(uvArea / worldArea);
+
+        if (keepGeometry) {
+            geometry = std::make_unique<MeshGeometry>();
+            geometry->positions.reserve(vertices.size());
+            for (const MeshVertex &vertex : vertices)
+                geometry->positions.push_back(vertex.Position);
+            if (vertices.size() <= std::numeric_limits<unsigned short>::max())
+                geometry->shortIndices.assign(indices.begin(), indices.end());
+            else
+                geometry->indices = indices;
+        }
+
+        setupGlMesh(vertices, indices);
     }
 
-    void Mesh::setupGlMesh() {
+    void Mesh::setupGlMesh(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices) {
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
@@ -252,10 +403,18 @@ namespace Engine::Loader {
         glBindVertexArray(VAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.data(), GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        // Halve the index buffer when every index fits in 16 bits
+        if (vertices.size() <= std::numeric_limits<unsigned short>::max()) {
+            const std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+            indexType = GL_UNSIGNED_SHORT;
+        } else {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+            indexType = GL_UNSIGNED_INT;
+        }
 
         // Set all the properties of the vertices
 #define ENABLE_F_VERTEX_ATTRIB(index, member) \
@@ -283,9 +442,13 @@ namespace Engine::Loader {
     Mesh::Mesh(Mesh &&other) noexcept {
         BUFFERS_MV_FROM_TO(other, this);
 
-        vertices = std::move(other.vertices);
-        indices = std::move(other.indices);
         materialIndex = other.materialIndex;
+        vertexCount = other.vertexCount;
+        indexCount = other.indexCount;
+        indexType = other.indexType;
+        bounds = other.bounds;
+        uvDensity = other.uvDensity;
+        geometry = std::move(other.geometry);
     }
     Mesh &Mesh::operator=(Mesh &&other) noexcept {
         if (this != &other) {
@@ -295,9 +458,13 @@ namespace Engine::Loader {
 
             BUFFERS_MV_FROM_TO(other, this);
 
-            vertices = std::move(other.vertices);
-            indices = std::move(other.indices);
             materialIndex = other.materialIndex;
+            vertexCount = other.vertexCount;
+            indexCount = other.indexCount;
+            indexType = other.indexType;
+            bounds = other.bounds;
+            uvDensity = other.uvDensity;
+            geometry = std::move(other.geometry);
         }
         return *this;
     }
@@ -3,27 +3,51 @@
 
 #include <expected>
 #include <string>
+#include <limits>
+#include <memory>
 #include <vector>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/mat3x4.hpp>
 #include <glm/mat4x4.hpp>
 
+#include "texture.h"
+
+// Must match the binding in vert.vert
+#define TRANSFORM_BLOCK_BINDING 1
+
+struct aiNode;
+struct aiMesh;
+struct aiMaterial;
+struct aiScene;
+struct aiTexture;
+
 namespace Engine {
     class GraphicsShader;
-    namespace Manager {
-        class TextureManager;
-    }
 }
+class RingBuffer;
 
 
 // TODO: Bones and animations
 // TODO: We should stop using paths as IDs... maybe pull a minecraft and use some sort of namespace path hybrid?
 
 namespace Engine::Loader {
+    /*!
+     * A draw's transform as laid out in the Transform uniform block (std140).
+     * The normal matrix is stored as a mat3x4, since std140 pads each mat3 column to a vec4 anyway.
+     */
+    struct TransformData {
+        glm::mat4 model;
+        glm::mat3x4 normalMatrix;
+    };
+    static_assert(sizeof(TransformData) == 112, "TransformData must match the std140 layout in vert.vert");
+
     struct Material {
         std::string diffusePath;
         std::string specularPath;
         float shininess;
-
-        std::expected<void, std::string> PopulateShader(const GraphicsShader &shader, Manager::TextureManager &textureManager) const;
+        // Index into the material buffer, assigned by `MaterialManager`. Unregistered materials use the error material
+        unsigned int id = 0;
     };
 
     struct MeshVertex {
@@ -35,25 +59,81 @@ namespace Engine::Loader {
         // We only support a single vertex color atm
         glm::vec4 Color;
     };
+    struct Bounds {
+        glm::vec3 min{std::numeric_limits<float>::max()};
+        glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+        void extend(const glm::vec3 &point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+        [[nodiscard]] glm::vec3 center() const { return (min + max) * 0.5f; }
+        /*!
+         * @return The distance from a point to the closest point of the box, or 0 if the point is inside it
+         */
+        [[nodiscard]] float distanceTo(const glm::vec3 &point) const {
+            return glm::length(glm::max(glm::max(min - point, point - max), glm::vec3(0.0f)));
+        }
+        /*!
+         * @return A box containing this box once transformed
+         */
+        [[nodiscard]] Bounds transformed(const glm::mat4 &transform) const {
+            Bounds result;
+            for (int corner = 0; corner < 8; corner++) {
+                const glm::vec3 point(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z);
+                result.extend(glm::vec3(transform * glm::vec4(point, 1.0f)));
+            }
+            return result;
+        }
+    };
+
+    /*!
+     * CPU-side copy of a mesh's geometry, for consumers like collision that need it after upload.
+     * Only positions are kept, since nothing on the CPU needs normals, texture coordinates or colors.
+     */
+    struct MeshGeometry {
+        std::vector<glm::vec3> positions;
+        // Only one of these is filled in, matching the mesh's `indexType`: 16-bit indices if every vertex fits, otherwise 32-bit ones
+        std::vector<unsigned short> shortIndices;
+        std::vector<unsigned int> indices;
+
+        [[nodiscard]] size_t indexCount() const { return shortIndices.size() + indices.size(); }
+        [[nodiscard]] unsigned int index(const size_t i) const {
+            return shortIndices.empty() ? indices[i] : shortIndices[i];
+        }
+        [[nodiscard]] size_t byteSize() const {
+            return positions.size() * sizeof(glm::vec3) + shortIndices.size() * sizeof(unsigned short) + indices.size() * sizeof(unsigned int);
+        }
+    };
+
     /*!
      * A mesh is a piece of geometry with a single material.
-     * It manages its own OpenGL buffers.
+     * It manages its own OpenGL buffers, and only keeps a CPU copy of its geometry if asked to.
      */
     class Mesh {
     public:
-
-        // TODO: We don't technically need to store the vertices and indices in the mesh object, since they're in the OpenGL buffers
-        //  The geometry will still need to be stored for the collision system, so it might be best to split the mesh into a data version and a renderable version?
-        std::vector<MeshVertex> vertices;
-        std::vector<unsigned int> indices;
         unsigned int materialIndex;
+        unsigned int vertexCount = 0;
+        unsigned int indexCount = 0;
+        // GL_UNSIGNED_SHORT if every index fits, otherwise GL_UNSIGNED_INT
+        unsigned int indexType = 0;
+        Bounds bounds;
+        // Texture coordinate units per world unit (on average), for estimating how many texels end up on screen.
+        // 0 if the mesh has no texture coordinates
+        float uvDensity = 0.0f;
+        // Only present if the mesh was loaded with `keepGeometry`
+        std::unique_ptr<MeshGeometry> geometry;
 
-        // TODO: Moving vertices when constructing the mesh, only to move the entire mesh when making a scene seems a bit wasteful
-        // A bit of a weird constructor, but moving in the vectors allows us to avoid copying them'
+        /*!
+         * @brief Upload a mesh to the GPU
+         * @param keepGeometry Whether to keep a position-only copy of the geometry in `geometry`
+         * @note The vertex and index data isn't needed after this, and can be freed by the caller
+         */
         Mesh(
-            std::vector<MeshVertex>&& vertices,
-            std::vector<unsigned int>&& indices,
-            unsigned int materialIndex
+            const std::vector<MeshVertex> &vertices,
+            const std::vector<unsigned int> &indices,
+            unsigned int materialIndex,
+            bool keepGeometry
         );
         ~Mesh();
 
@@ -65,6 +145,19 @@ namespace Engine::Loader {
         Mesh& operator=(Mesh&& other) noexcept;
 
         void bindGlMesh() const;
+        /*!
+         * @brief Draw the mesh
+         * @param materialId The material to draw with, passed to the shaders as the base instance,
+         *  so selecting a material needs no uniform upload
+         * @note Binds the mesh's VAO
+         */
+        void draw(unsigned int materialId) const;
+        void drawInstanced(unsigned int instanceCount, unsigned int materialId) const;
+
+        /*!
+         * @return The size of this mesh's vertex and index buffers
+         */
+        [[nodiscard]] size_t gpuBytes() const;
 
     private:
         unsigned int VAO{}, VBO{}, EBO{};
@@ -72,7 +165,7 @@ namespace Engine::Loader {
          * Sets up the OpenGL buffers for this mesh.
          * @note Leaves the VAO bound.
          */
-        void setupGlMesh();
+        void setupGlMesh(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices);
     };
 
     struct Node {
@@ -82,10 +175,28 @@ namespace Engine::Loader {
         std::vector<unsigned int> meshIndices;
     };
 
+    /*!
+     * A texture stored inside the scene file, decoded while loading the scene.
+     * Materials refer to it by `key` instead of a file path (see `getEmbeddedTextureKey`).
+     */
+    struct EmbeddedTexture {
+        std::string key;
+        Image image;
+    };
+
+    struct SceneLoadOptions {
+        // Keep a CPU copy of every mesh's positions and indices (e.g. for collision)
+        bool keepGeometry = false;
+    };
+
     struct Scene {
         Node rootNode;
         std::vector<Mesh> meshes;
         std::vector<Material> materials;
+        // Decoded once and handed over to whoever uploads them, after which this is empty
+        std::vector<EmbeddedTexture> embeddedTextures;
+        // Bytes of vertex and index data that were freed after upload instead of being kept in RAM
+        size_t releasedCpuBytes = 0;
 
         Scene(
             const Node &rootNode,
@@ -100,10 +211,71 @@ namespace Engine::Loader {
         Scene(Scene&& other) noexcept;
         Scene& operator=(Scene&& other) noexcept;
 
-        std::expected<void, std::string> Draw(Manager::TextureManager &textureManager, const GraphicsShader &shader, const glm::mat4 &modelTransform) const;
+        /*!
+         * @brief Draw every mesh of the scene
+         * @param constants Where the draw's transform is written, and bound from
+         * @note Expects the material manager to be bound to `shader`, so only material indices change between meshes
+         */
+        std::expected<void, std::string> Draw(const GraphicsShader &shader, RingBuffer &constants, const glm::mat4 &modelTransform) const;
+        /*!
+         * @brief Draw every mesh of the scene with the transform that's already bound (see `bindTransform`), ignoring the root node's
+         * @note For scenes that share a transform, like the cells of a world, so it's only written once per frame
+         */
+        void DrawMeshes(const GraphicsShader &shader) const;
+        /*!
+         * @brief Draw every mesh once for all instances in the currently bound instance buffer
+         * @param shader A shader that reads its transforms from the instance buffer (see vert_instanced.vert)
+         * @param instanceCount The number of instances in the bound instance buffer
+         * @note Expects the material manager to be bound to `shader`
+         */
+        std::expected<void, std::string> DrawInstanced(const GraphicsShader &shader, unsigned int instanceCount) const;
+
+        [[nodiscard]] bool hasGeometry() const;
+        /*!
+         * @return The bytes of CPU geometry kept by this scene's meshes
+         */
+        [[nodiscard]] size_t geometryBytes() const;
+        /*!
+         * @return The size of the vertex and index buffers of all of this scene's meshes
+         */
+        [[nodiscard]] size_t gpuBytes() const;
     };
 
-    std::expected<Scene, std::string> loadScene(const std::string &path);
+    std::expected<Scene, std::string> loadScene(const std::string &path, const SceneLoadOptions &options = {});
+    /*!
+     * Write a model transform and its normal matrix to this frame's constants, and bind them to TRANSFORM_BLOCK_BINDING.
+     * @return An error message if the frame is out of constant memory.
+     */
+    std::expected<void, std::string> bindTransform(RingBuffer &constants, const glm::mat4 &model);
+
+    // Conversion helpers shared with other loaders that read through Assimp
+    std::vector<MeshVertex> extractVertices(const aiMesh *loadedMesh);
+    std::vector<unsigned int> extractIndices(const aiMesh *loadedMesh);
+    std::expected<Node, std::string> processNode(const aiNode *loadedNode);
+    std::expected<Material, std::string> processMaterial(const aiMaterial *loadedMaterial);
+    /*!
+     * Decode every texture embedded in a scene, keyed by `getEmbeddedTextureKey`.
+     * @param path The path the scene was loaded from.
+     */
+    std::expected<std::vector<EmbeddedTexture>, std::string> processEmbeddedTextures(const aiScene *loadedScene, const std::string &path);
+    /*!
+     * Point a material's texture path at the key of the embedded texture it refers to, if it refers to one.
+     */
+    void resolveEmbeddedTexturePath(const aiScene *loadedScene, const std::string &scenePath, std::string &texturePath);
+
+    /*!
+     * Get the key an embedded texture's image is registered under. It's scoped to the scene, since every scene numbers its textures from 0.
+     * @param scenePath The path to the scene file.
+     * @param index The texture's index in the scene file.
+     */
+    std::string getEmbeddedTextureKey(const std::string &scenePath, unsigned int index);
+    /*!
+     * Decode an embedded texture straight from the importer's memory: compressed files with stb_image,
+     * and raw texels by swizzling them from BGRA as they're copied out.
+     * @return The decoded image, or an error message.
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads.
+     */
+    std::expected<Image, std::string> decodeEmbeddedTexture(const aiTexture *texture);
 };
 
 
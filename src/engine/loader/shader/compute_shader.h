@@ -12,6 +12,11 @@ namespace Engine {
             : ShaderProgram({
                 {computeFilePath, GL_COMPUTE_SHADER}
             }) {};
+        /*!
+         * @brief Finish a program started with `startBuild`, waiting for the driver if it isn't done yet
+         */
+        explicit ComputeShader(PendingProgram &&pending)
+            : ShaderProgram(std::move(pending)) {};
     };
 }
 
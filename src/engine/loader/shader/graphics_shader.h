@@ -26,6 +26,11 @@ namespace Engine {
          */
         explicit GraphicsShader(const std::vector<std::pair<std::string, unsigned int>> &filePaths)
             : ShaderProgram(filePaths) {};
+        /*!
+         * @brief Finish a program started with `startBuild`, waiting for the driver if it isn't done yet
+         */
+        explicit GraphicsShader(PendingProgram &&pending)
+            : ShaderProgram(std::move(pending)) {};
     };
 }
 
@@ -0,0 +1,253 @@
+#include "preprocessor.h"
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <engine/logging.h>
+#include <engine/loader/generic.h>
+
+#define INCLUDE_DIRECTIVE "include"
+#define VERSION_DIRECTIVE "version"
+
+namespace Engine::Loader {
+    /*!
+     * A shader file split around its include directives, which are removed along with their lines.
+     */
+    struct ShaderFile {
+        struct Include {
+            size_t offset;  // Where the directive was in `text`
+            std::string path;  // Empty where `version` was taken out
+            int nextLine;  // The line `text` continues with after the directive
+        };
+
+        std::string text;
+        std::vector<Include> includes;
+        // A #version directive that came after an include, taken out of `text` so it can still come first
+        std::string version;
+        std::filesystem::file_time_type writeTime;
+    };
+
+    std::unordered_map<std::string, std::shared_ptr<const ShaderFile>> &getShaderFileCache() {
+        static std::unordered_map<std::string, std::shared_ptr<const ShaderFile>> cache;
+        return cache;
+    }
+
+    void clearShaderIncludeCache() {
+        getShaderFileCache().clear();
+    }
+
+    bool isBlank(const char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    /*!
+     * @return Whether a line ends inside a block comment
+     * @param inBlockComment Whether the line starts inside one
+     */
+    bool endsInBlockComment(const std::string_view line, bool inBlockComment) {
+        for (size_t i = 0; i + 1 < line.size(); i++) {
+            if (inBlockComment) {
+                if (line[i] == '*' && line[i + 1] == '/') {
+                    inBlockComment = false;
+                    i++;
+                }
+            } else if (line[i] == '/' && line[i + 1] == '/') {
+                return false;  // The rest of the line is a comment
+            } else if (line[i] == '/' && line[i + 1] == '*') {
+                inBlockComment = true;
+                i++;
+            }
+        }
+        return inBlockComment;
+    }
+
+    /*!
+     * @return Where the directive's name ends if the line is a `#name` directive, or npos if it isn't
+     */
+    size_t matchDirective(const std::string_view line, const std::string_view name) {
+        size_t i = 0;
+        while (i < line.size() && isBlank(line[i]))
+            i++;
+        if (i == line.size() || line[i] != '#')
+            return std::string_view::npos;
+        i++;
+        while (i < line.size() && isBlank(line[i]))
+            i++;
+        if (line.substr(i, name.size()) != name)
+            return std::string_view::npos;
+        return i + name.size();
+    }
+
+    /*!
+     * @return The path of an include directive, nothing if the line isn't one, or an error message if it is malformed
+     */
+    std::expected<std::optional<std::string>, std::string> parseInclude(const std::string_view line) {
+        size_t i = matchDirective(line, INCLUDE_DIRECTIVE);
+        if (i == std::string_view::npos)
+            return std::nullopt;
+
+        if (i == line.size() || !isBlank(line[i]))
+            return UNEXPECTED_REF("Expected whitespace after #include");
+        while (i < line.size() && isBlank(line[i]))
+            i++;
+        if (i == line.size() || line[i] != '"')
+            return UNEXPECTED_REF("Expected opening quote after #include");
+        const size_t end = line.find('"', i + 1);
+        if (end == std::string_view::npos)
+            return UNEXPECTED_REF("Expected closing quote after #include");
+        if (end == i + 1)
+            return UNEXPECTED_REF("Empty #include path");
+        return std::string(line.substr(i + 1, end - i - 1));
+    }
+
+    std::expected<std::shared_ptr<const ShaderFile>, std::string> parseShaderFile(const std::string &filePath, const std::filesystem::file_time_type writeTime) {
+        const std::expected<std::string, std::string> source = readTextFile(filePath);
+        if (!source.has_value())
+            return std::unexpected(FW_UNEXP(source, "Failed to read shader file"));
+        const std::string &text = source.value();
+
+        auto file = std::make_shared<ShaderFile>();
+        file->text.reserve(text.size());
+        file->writeTime = writeTime;
+
+        bool inBlockComment = false;
+        int lineNumber = 1;
+        for (size_t lineStart = 0; lineStart < text.size(); lineNumber++) {
+            const size_t newLine = text.find('\n', lineStart);
+            const size_t lineEnd = newLine == std::string::npos ? text.size() : newLine;
+            const size_t nextLine = newLine == std::string::npos ? text.size() : newLine + 1;
+            const std::string_view line(text.data() + lineStart, lineEnd - lineStart);
+
+            if (!inBlockComment) {
+                std::expected<std::optional<std::string>, std::string> include = parseInclude(line);
+                if (!include.has_value()) {
+                    // Left in place for the compiler to point at
+                    logWarn("Invalid include directive at %s:%d" NL_INDENT "%s", filePath.c_str(), lineNumber, include.error().c_str());
+                } else if (include->has_value()) {
+                    file->includes.push_back({file->text.size(), std::move(include->value()), lineNumber + 1});
+                    lineStart = nextLine;
+                    continue;
+                } else if (!file->includes.empty() && file->version.empty()) {
+                    // Included code (and the #line before it) can't come before #version
+                    const size_t versionEnd = matchDirective(line, VERSION_DIRECTIVE);
+                    if (versionEnd != std::string_view::npos && (versionEnd == line.size() || isBlank(line[versionEnd]))) {
+                        file->version = std::string(line) + '\n';
+                        file->includes.push_back({file->text.size(), "", lineNumber + 1});
+                        lineStart = nextLine;
+                        continue;
+                    }
+                }
+            }
+            inBlockComment = endsInBlockComment(line, inBlockComment);
+            file->text.append(text, lineStart, nextLine - lineStart);
+            lineStart = nextLine;
+        }
+        // So whatever follows (the #line after an include) starts on its own line
+        if (!file->text.empty() && file->text.back() != '\n')
+            file->text += '\n';
+        return file;
+    }
+
+    /*!
+     * @return A file's parsed contents, from the cache unless the file changed since it was parsed
+     */
+    std::expected<std::shared_ptr<const ShaderFile>, std::string> getShaderFile(const std::string &filePath) {
+        std::error_code error;
+        const std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(filePath, error);
+        auto &cache = getShaderFileCache();
+        if (const auto it = cache.find(filePath); !error && it != cache.end() && it->second->writeTime == writeTime)
+            return it->second;
+
+        std::expected<std::shared_ptr<const ShaderFile>, std::string> file = parseShaderFile(filePath, writeTime);
+        if (file.has_value() && !error)
+            cache.insert_or_assign(filePath, file.value());
+        return file;
+    }
+
+    std::expected<void, std::string> expandShaderFile(const ShaderFile &file, const int fileIndex,
+            PreprocessedShader &shader, std::unordered_set<std::string> &included) {
+        // Only the shader itself can start with #version. Anywhere else it's left where it was, for the compiler to reject
+        if (!file.version.empty() && fileIndex == 0)
+            shader.source += file.version + "#line 1 0\n";
+
+        size_t copied = 0;
+        for (const ShaderFile::Include &include : file.includes) {
+            shader.source.append(file.text, copied, include.offset - copied);
+            copied = include.offset;
+
+            if (include.path.empty()) {
+                if (fileIndex != 0)
+                    shader.source += file.version;
+                else
+                    shader.source += "#line " + std::to_string(include.nextLine) + " " + std::to_string(fileIndex) + "\n";
+                continue;
+            }
+
+            // Keeps the directive's line, so the lines after it don't need a #line
+            if (!included.insert(include.path).second) {
+                shader.source += "// ignoring #include \"" + include.path + "\" (already included)\n";
+                continue;
+            }
+
+            const std::expected<std::shared_ptr<const ShaderFile>, std::string> includedFile = getShaderFile(include.path);
+            if (!includedFile.has_value())
+                return std::unexpected(FW_UNEXP(includedFile, "Failed to include \"" + include.path + "\""));
+            const auto includedIndex = static_cast<int>(shader.files.size());
+            shader.files.push_back(include.path);
+
+            shader.source += "#line 1 " + std::to_string(includedIndex) + "\n";
+            std::expected<void, std::string> expandRet = expandShaderFile(*includedFile.value(), includedIndex, shader, included);
+            if (!expandRet.has_value())
+                return expandRet;
+            shader.source += "#line " + std::to_string(include.nextLine) + " " + std::to_string(fileIndex) + "\n";
+        }
+        shader.source.append(file.text, copied);
+        return {};
+    }
+
+    /*!
+     * Insert macro definitions after the `#version` directive, which has to come first, then restore the line numbers after it.
+     */
+    void insertDefines(std::string &source, const std::vector<std::string> &defines) {
+        size_t versionStart = 0;
+        while (versionStart < source.size() && isBlank(source[versionStart]))
+            versionStart++;
+        const bool hasVersion = source.compare(versionStart, 8, "#version") == 0;
+        const size_t newLine = source.find('\n');
+        const size_t insertAt = hasVersion ? (newLine == std::string::npos ? source.size() : newLine + 1) : 0;
+
+        std::string block = hasVersion && newLine == std::string::npos ? "\n" : "";
+        for (const std::string &define : defines)
+            block += "#define " + define + "\n";
+        block += hasVersion ? "#line 2 0\n" : "#line 1 0\n";
+        source.insert(insertAt, block);
+    }
+
+    std::expected<PreprocessedShader, std::string> preprocessShader(const std::string &filePath, const std::vector<std::string> &defines) {
+        const std::expected<std::shared_ptr<const ShaderFile>, std::string> file = getShaderFile(filePath);
+        if (!file.has_value())
+            return std::unexpected(file.error());
+
+        PreprocessedShader shader;
+        shader.source.reserve(file.value()->text.size());
+        shader.files.push_back(filePath);
+        std::unordered_set<std::string> included{filePath};
+        std::expected<void, std::string> expandRet = expandShaderFile(*file.value(), 0, shader, included);
+        if (!expandRet.has_value())
+            return std::unexpected(expandRet.error());
+        if (!defines.empty())
+            insertDefines(shader.source, defines);
+        return shader;
+    }
+
+    std::string PreprocessedShader::describeFiles() const {
+        std::string description = "Source strings:";
+        for (size_t i = 0; i < files.size(); i++)
+            description += " " + std::to_string(i) + " = \"" + files[i] + "\"" + (i + 1 < files.size() ? "," : "");
+        return description;
+    }
+}
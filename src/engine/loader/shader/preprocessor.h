@@ -0,0 +1,41 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include <expected>
+#include <string>
+#include <vector>
+
+namespace Engine::Loader {
+    /*!
+     * A shader source with its includes resolved.
+     */
+    struct PreprocessedShader {
+        std::string source;
+        // The file each `#line` source string number refers to, starting with the shader itself (0)
+        std::vector<std::string> files;
+
+        /*!
+         * @return Which file each source string number is, to add to compiler errors.
+         */
+        [[nodiscard]] std::string describeFiles() const;
+    };
+
+    /*!
+     * Resolve the `#include "path"` directives of a shader in a single pass, building the output in one buffer.
+     * Each file is only included once per shader, and directives inside block comments are ignored.
+     * Included files are wrapped in `#line` directives, so compiler errors point at the line within the right file,
+     * with the file given by its source string number (see `PreprocessedShader::files`).
+     * If an include comes before the `#version` directive, the directive is moved to the top, since nothing can come before it.
+     * @param filePath The path to the shader. Include paths are relative to the working directory, like every other asset path.
+     * @param defines Macros to define right after the `#version` directive, as "NAME" or "NAME VALUE", for building variants of a shader.
+     * @return The preprocessed shader, or an error message if a file couldn't be read. Malformed includes are left in place with a warning.
+     * @note Parsed files are cached across shaders until they change on disk. Not thread safe, like the rest of the shader code.
+     */
+    std::expected<PreprocessedShader, std::string> preprocessShader(const std::string &filePath, const std::vector<std::string> &defines = {});
+    /*!
+     * Drop every cached parsed file.
+     */
+    void clearShaderIncludeCache();
+}
+
+#endif
@@ -1,59 +1,267 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <stdexcept>
 
 #include <gl/glew.h>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "engine/logging.h"
+#include "engine/loader/binary_io.h"
 #include "engine/loader/generic.h"
 
+#include "preprocessor.h"
 #include "shader_program.h"
 
+#define PROGRAM_CACHE_MAGIC 0x534C4C4Cu  // "LLLS"
+#define PROGRAM_CACHE_VERSION 1u  // Bump whenever the cache file layout changes
 
 namespace Engine {
-    ShaderProgram::ShaderProgram(const std::vector<std::pair<std::string, unsigned int>> &filePaths) : programID(0) {
-        std::vector<unsigned int> shaderIDs;
-        shaderIDs.reserve(filePaths.size());
+    struct ProgramCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t binaryFormat;
+        float compileMilliseconds;  // How long compiling and linking from source took, to report what the cache saves
+    };
+
+    uint64_t getProgramCacheKey(const std::vector<std::pair<Loader::PreprocessedShader, unsigned int>> &shaders) {
+        // The driver is part of the key, since binaries are only guaranteed to load on the driver that produced them
+        std::string key;
+        for (const GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const auto *value = reinterpret_cast<const char *>(glGetString(name));
+            key += value != nullptr ? value : "";
+            key += '\n';
+        }
+        for (const auto &[shader, shaderType] : shaders) {
+            key += std::to_string(shaderType) + '\n';
+            key += shader.source;
+            key += '\0';
+        }
+        return hashString(key);
+    }
+
+    std::string getProgramCachePath(const uint64_t key) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return CACHE_DIR "shaders/" + std::string(name);
+    }
 
-        // Load all shaders
+    /*!
+     * @brief Link a program from a cached binary
+     * @return How long compiling the program from source took, or an error message if the binary is missing or was rejected
+     */
+    std::expected<float, std::string> loadProgramBinary(const unsigned int program, const uint64_t key) {
+        const std::string cachePath = getProgramCachePath(key);
+        Loader::BinaryReader reader(cachePath);
+        const auto header = reader.read<ProgramCacheHeader>();
+        if (!reader.good())
+            return UNEXPECTED_REF("No cached binary");
+        if (header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION || header.key != key)
+            return UNEXPECTED_REF("Cached binary is outdated");
+        const std::vector<unsigned char> binary = reader.readVector<unsigned char>();
+        if (!reader.good() || binary.empty())
+            return UNEXPECTED_REF("Cached binary is truncated");
+
+        glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+        int result = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
+        if (result != GL_TRUE)
+            return UNEXPECTED_REF("Driver rejected the cached binary");
+        return header.compileMilliseconds;
+    }
+
+    void saveProgramBinary(const unsigned int program, const uint64_t key, const float compileMilliseconds) {
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<unsigned char> binary(length);
+        GLenum binaryFormat = 0;
+        glGetProgramBinary(program, length, nullptr, &binaryFormat, binary.data());
+
+        const std::string cachePath = getProgramCachePath(key);
+        if (const std::expected<void, std::string> dirRet = Loader::createParentDirectories(cachePath); !dirRet.has_value()) {
+            logWarn("Failed to cache program binary" NL_INDENT "%s", dirRet.error().c_str());
+            return;
+        }
+        Loader::BinaryWriter writer(cachePath);
+        writer.write(ProgramCacheHeader{PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, binaryFormat, compileMilliseconds});
+        writer.writeVector(binary);
+        if (!writer.commit())
+            logWarn("Failed to write program binary \"%s\"", cachePath.c_str());
+    }
+
+    bool supportsProgramBinaries() {
+        int formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }
+
+    void enableParallelCompile() {
+        static const bool enabled = [] {
+            // Let the driver pick how many threads to compile on
+            if (GLEW_KHR_parallel_shader_compile)
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+            else if (GLEW_ARB_parallel_shader_compile)
+                glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+            else
+                return false;
+            return true;
+        }();
+        (void)enabled;
+    }
+
+    std::string getInfoLog(const unsigned int object, const bool program) {
+        int infoLogLength = 0;
+        if (program)
+            glGetProgramiv(object, GL_INFO_LOG_LENGTH, &infoLogLength);
+        else
+            glGetShaderiv(object, GL_INFO_LOG_LENGTH, &infoLogLength);
+        if (infoLogLength == 0)
+            return "No info log available";
+
+        std::vector<char> infoLog(infoLogLength);
+        if (program)
+            glGetProgramInfoLog(object, infoLogLength, nullptr, infoLog.data());
+        else
+            glGetShaderInfoLog(object, infoLogLength, nullptr, infoLog.data());
+        return infoLog.data();
+    }
+
+    PendingProgram ShaderProgram::startBuild(const std::vector<std::pair<std::string, unsigned int>> &filePaths,
+            const std::vector<std::string> &defines) {
+        enableParallelCompile();
+        PendingProgram pending;
+        pending.start = std::chrono::steady_clock::now();
+        pending.name = filePaths.empty() ? std::string() : filePaths.front().first;
+        for (size_t i = 0; i < defines.size(); i++)
+            pending.name += (i == 0 ? " [" : ", ") + defines[i] + (i + 1 == defines.size() ? "]" : "");
+
+        // The cache is keyed by the preprocessed sources, so editing an included file invalidates it too
+        std::vector<std::pair<Loader::PreprocessedShader, unsigned int>> shaders;
+        shaders.reserve(filePaths.size());
         for (const auto &[filePath, shaderType] : filePaths) {
-            const std::expected<unsigned int, std::string> shaderID = loadShader(filePath, shaderType);
-            if (!shaderID.has_value()) {
-                for (const auto &id : shaderIDs)
-                    glDeleteShader(id);
-                throw std::runtime_error("Failed to compile shader " + filePath + ": " NL_INDENT + shaderID.error());
+            std::expected<Loader::PreprocessedShader, std::string> shader = Loader::preprocessShader(filePath, defines);
+            if (!shader.has_value())
+                throw std::runtime_error("Failed to preprocess shader " + filePath + ": " NL_INDENT + shader.error());
+            shaders.emplace_back(std::move(shader.value()), shaderType);
+        }
+
+        pending.cacheBinary = supportsProgramBinaries();
+        pending.cacheKey = pending.cacheBinary ? getProgramCacheKey(shaders) : 0;
+        pending.program = glCreateProgram();
+        if (pending.cacheBinary) {
+            const std::expected<float, std::string> cached = loadProgramBinary(pending.program, pending.cacheKey);
+            if (cached.has_value()) {
+                pending.cachedCompileMilliseconds = cached.value();
+                return pending;
             }
-            shaderIDs.push_back(shaderID.value());
+            // A rejected binary leaves the program unlinked, but it's simpler to start over with a fresh one
+            glDeleteProgram(pending.program);
+            pending.program = glCreateProgram();
+            logDebug("Program binary cache miss for \"%s\"" NL_INDENT "%s", pending.name.c_str(), cached.error().c_str());
         }
 
-        const unsigned int progID = glCreateProgram();
-        // Attach all shaders
-        for (const auto &shaderID : shaderIDs) {
-            glAttachShader(progID, shaderID);
-            glDeleteShader(shaderID);  // Flagged for deletion when no longer attached to anything
+        // Only issue the work here. Checking a status would wait for it
+        for (const auto &[shader, shaderType] : shaders) {
+            const unsigned int shaderID = glCreateShader(shaderType);
+            const char *shaderSource = shader.source.c_str();
+            glShaderSource(shaderID, 1, &shaderSource, nullptr);
+            glCompileShader(shaderID);
+            glAttachShader(pending.program, shaderID);
+            // Errors are reported by source string number, which is only obvious without includes
+            pending.shaders.emplace_back(shaderID, shader.files.size() > 1
+                ? shader.files.front() + " (" + shader.describeFiles() + ")"
+                : shader.files.front());
         }
+        if (pending.cacheBinary)
+            glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(pending.program);
+        return pending;
+    }
+
+    std::vector<PendingProgram> ShaderProgram::startBuilds(const std::vector<std::vector<std::pair<std::string, unsigned int>>> &programs) {
+        std::vector<PendingProgram> pending;
+        pending.reserve(programs.size());
+        for (const auto &filePaths : programs)
+            pending.push_back(startBuild(filePaths));
+        return pending;
+    }
+
+    ShaderProgram::ShaderProgram(const std::vector<std::pair<std::string, unsigned int>> &filePaths)
+        : ShaderProgram(startBuild(filePaths)) {}
 
-        glLinkProgram(progID);
+    ShaderProgram::ShaderProgram(PendingProgram &&pending) : programID(0) {
+        const auto elapsedMilliseconds = [&pending] {
+            return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pending.start).count();
+        };
 
         int result = GL_FALSE;
-        glGetProgramiv(progID, GL_LINK_STATUS, &result);
-        if (result == GL_TRUE) {
-            for (const auto &shaderID : shaderIDs)
-                glDetachShader(progID, shaderID);  // Detach and delete shaders, we only need what is linked in the program now
-            programID = progID;
-            return;
+        glGetProgramiv(pending.program, GL_LINK_STATUS, &result);
+        if (result != GL_TRUE) {
+            // A stage that failed to compile is the more useful error
+            for (const auto &[shaderID, description] : pending.shaders) {
+                glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
+                if (result != GL_TRUE)
+                    throw std::runtime_error("Failed to compile shader " + description + ": " NL_INDENT "Shader compilation failed: " + getInfoLog(shaderID, false));
+            }
+            throw std::runtime_error("Program linking failed: " NL_INDENT + getInfoLog(pending.program, true));
         }
 
-        int infoLogLength = 0;
-        glGetProgramiv(progID, GL_INFO_LOG_LENGTH, &infoLogLength);
-        if (infoLogLength == 0) {
-            glDeleteProgram(progID);  // Automatically detaches shaders, we don't need to loop through them
-            throw std::runtime_error("Program linking failed: No info log available");
+        for (const auto &[shaderID, description] : pending.shaders) {
+            glDetachShader(pending.program, shaderID);  // We only need what is linked in the program now
+            glDeleteShader(shaderID);
         }
+        pending.shaders.clear();
+        programID = pending.program;
+        pending.program = 0;
+        findUniformLocations();
+
+        if (pending.cachedCompileMilliseconds.has_value()) {
+            const float loadMilliseconds = elapsedMilliseconds();
+            logDebug("Program binary cache hit for \"%s\": loaded in %.1f ms, saving %.1f ms of compiling",
+                pending.name.c_str(), loadMilliseconds, std::max(pending.cachedCompileMilliseconds.value() - loadMilliseconds, 0.0f));
+        } else if (pending.cacheBinary)
+            saveProgramBinary(programID, pending.cacheKey, elapsedMilliseconds());
+    }
 
-        std::vector<char> infoLog(infoLogLength);
-        glGetProgramInfoLog(progID, infoLogLength, nullptr, infoLog.data());
-        glDeleteProgram(progID);  // Automatically detaches shaders, we don't need to loop through them
-        throw std::runtime_error("Program linking failed: " NL_INDENT + std::string(infoLog.data()));
+    PendingProgram::~PendingProgram() {
+        for (const auto &[shaderID, description] : shaders)
+            glDeleteShader(shaderID);
+        glDeleteProgram(program);
+    }
+
+    PendingProgram::PendingProgram(PendingProgram &&other) noexcept
+        : program(other.program), shaders(std::move(other.shaders)), name(std::move(other.name)), cacheBinary(other.cacheBinary),
+          cacheKey(other.cacheKey), cachedCompileMilliseconds(other.cachedCompileMilliseconds), start(other.start) {
+        other.program = 0;
+        other.shaders.clear();
+    }
+    PendingProgram &PendingProgram::operator=(PendingProgram &&other) noexcept {
+        if (this != &other) {
+            for (const auto &[shaderID, description] : shaders)
+                glDeleteShader(shaderID);
+            glDeleteProgram(program);
+            program = other.program;
+            shaders = std::move(other.shaders);
+            name = std::move(other.name);
+            cacheBinary = other.cacheBinary;
+            cacheKey = other.cacheKey;
+            cachedCompileMilliseconds = other.cachedCompileMilliseconds;
+            start = other.start;
+            other.program = 0;
+            other.shaders.clear();
+        }
+        return *this;
+    }
+
+    bool PendingProgram::isReady() const {
+        if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+            return true;
+        int completed = GL_TRUE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
     }
 
     ShaderProgram::~ShaderProgram() {
@@ -63,160 +271,96 @@ namespace Engine {
     ShaderProgram::ShaderProgram(ShaderProgram &&other) noexcept {
         programID = other.programID;
         other.programID = 0;
+        uniformLocations = std::move(other.uniformLocations);
     }
     ShaderProgram &ShaderProgram::operator=(ShaderProgram &&other) noexcept {
         if (this != &other) {
             glDeleteProgram(programID);
             programID = other.programID;
             other.programID = 0;
+            uniformLocations = std::move(other.uniformLocations);
         }
         return *this;
     }
 
-    std::expected<unsigned int, std::string> ShaderProgram::loadShader(
-        const std::string &filePath,
-        const unsigned int shaderType
-    ) {
-        std::expected<std::string, std::string> shaderSrc = Loader::readTextFile(filePath);
-        if (!shaderSrc.has_value())
-            return std::unexpected(FW_UNEXP(shaderSrc, "Failed to read shader file"));
-        shaderSrc = preprocessSource(shaderSrc.value());
-        if (!shaderSrc.has_value())
-            return std::unexpected(FW_UNEXP(shaderSrc, std::string("Failed to preprocess shader source")));
-
-        const unsigned int shaderID = glCreateShader(shaderType);
-        const char *shaderSource = shaderSrc.value().c_str();
-        glShaderSource(shaderID, 1, &shaderSource, nullptr);
-        glCompileShader(shaderID);
-
-        int result = GL_FALSE;
-        glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
-        if (result == GL_TRUE)
-            return shaderID;
-
-        int infoLogLength = 0;
-        glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
-        if (infoLogLength == 0) {
-            glDeleteShader(shaderID);  // Prevent leak if we failed to compile
-            return UNEXPECTED_REF("Shader compilation failed: No info log available");
-        }
-
-        std::vector<char> infoLog(infoLogLength);
-        glGetShaderInfoLog(shaderID, infoLogLength, nullptr, infoLog.data());
-        glDeleteShader(shaderID);  // Prevent leak if we failed to compile
-        return UNEXPECTED_REF("Shader compilation failed: " + std::string(infoLog.data()));
-    }
-
-    std::expected<std::string, std::string> ShaderProgram::preprocessSource(std::string shaderSrc) {
-        constexpr auto includeDirective = "#include";
-        constexpr auto includeDirectiveLength = strlen(includeDirective);
-
-        std::vector<std::string> processedFiles; // Avoid infinite recursion and unnecessary file reads
-
-        std::string::size_type cursor = 0;
-        std::string::size_type findStart = cursor;
-        while ((findStart = shaderSrc.find(includeDirective, findStart)) != std::string::npos) {
-            cursor = findStart;
-            // Exit if we are in the middle of a line (ignoring leading whitespace)
-            while (shaderSrc[cursor - 1] == ' ' || shaderSrc[cursor - 1] == '\t')
-                cursor--;
-            if (shaderSrc[findStart - 1] != '\n') {
-                logWarn("Invalid include directive at " + std::to_string(findStart) + ". Expected start of line:" + shaderSrc.substr(findStart-10, 40));
-                findStart++; // So we won't find the same include directive again
-                continue;
-            }
-            cursor = findStart;
-
-#define IN_BOUNDS cursor < shaderSrc.size()
-
-            cursor += includeDirectiveLength;
-            if (shaderSrc[cursor] != ' ' && shaderSrc[cursor] != '\t') {
-                logWarn("Invalid include directive. Expected whitespace after directive");
-                continue;
-            }
-            cursor++;
-            while (IN_BOUNDS && shaderSrc[cursor] == ' ' || shaderSrc[cursor] == '\t')
-                cursor++;
-
-            if (shaderSrc[cursor] != '"') {
-                logWarn("Invalid include directive. Expected opening quote");
-                continue;
-            }
-            cursor++;
-            const auto pathStart = cursor;
-            while (IN_BOUNDS && shaderSrc[cursor] != '"' && shaderSrc[cursor] != '\n')
-                cursor++;
-            if (shaderSrc[cursor] != '"') {
-                logWarn("Invalid include directive. Expected closing quote");
-                continue;
-            }
-            const auto includePath = shaderSrc.substr(pathStart, cursor - pathStart);
-            cursor++;
+    void ShaderProgram::use() const {
+        glUseProgram(programID);
+    }
 
-            if (std::ranges::find(processedFiles, includePath) != processedFiles.end()) {
-                shaderSrc.replace(findStart, cursor - findStart, "// ignoring #include " + includePath + " (already included)");
-                continue;
+    void ShaderProgram::findUniformLocations() {
+        int uniformCount = 0, maxNameLength = 0;
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        std::vector<char> nameBuffer(std::max(maxNameLength, 1));
+
+        const auto addUniform = [this](const std::string &name, const int location) {
+            const auto [it, inserted] = uniformLocations.try_emplace(hashString(name), location);
+            if (!inserted && it->second != location)
+                logWarn("Uniform \"%s\" has the same hash as another uniform of program %u", name.c_str(), programID);
+        };
+        for (int i = 0; i < uniformCount; i++) {
+            int length = 0, size = 0;
+            unsigned int type = 0;
+            glGetActiveUniform(programID, i, static_cast<int>(nameBuffer.size()), &length, &size, &type, nameBuffer.data());
+            const std::string name(nameBuffer.data(), length);
+            const int location = glGetUniformLocation(programID, name.c_str());
+            if (location == -1)
+                continue;  // Lives in a uniform block
+            addUniform(name, location);
+
+            // Arrays are listed once, as "name[0]". Elements are consecutive locations, and can also be set through the bare name
+            if (size > 1 && name.ends_with("[0]")) {
+                const std::string arrayName = name.substr(0, name.size() - 3);
+                addUniform(arrayName, location);
+                for (int element = 1; element < size; element++)
+                    addUniform(arrayName + "[" + std::to_string(element) + "]", location + element);
             }
-            logDebug("Processing include file \"%s\"", includePath.c_str());
-            processedFiles.push_back(includePath);
-            std::expected<std::string, std::string> includeSrc = Loader::readTextFile(includePath);
-            if (!includeSrc.has_value())
-                return std::unexpected(FW_UNEXP(includeSrc,
-                    "Failed to read include: " + shaderSrc.substr(findStart, cursor - findStart)));
-            // Replace the include directive with the actual source
-            shaderSrc.replace(findStart, cursor - findStart, includeSrc.value());
         }
-#undef IN_BOUNDS
-
-        return shaderSrc;
-    }
-
-    void ShaderProgram::use() const {
-        glUseProgram(programID);
     }
 
-    int ShaderProgram::getUniformLoc(const std::string &name) const {
-        return glGetUniformLocation(programID, name.c_str());
+    int ShaderProgram::getUniformLoc(const UniformID id) const {
+        const auto it = uniformLocations.find(id.hash);
+        return it != uniformLocations.end() ? it->second : -1;
     }
 
-    void ShaderProgram::setBool(const std::string &name, const bool value) const {
-        glUniform1i(getUniformLoc(name), static_cast<int>(value));
+    void ShaderProgram::setBool(const UniformID id, const bool value) const {
+        glUniform1i(getUniformLoc(id), static_cast<int>(value));
     }
-    void ShaderProgram::setInt(const std::string &name, const int value) const {
-        glUniform1i(getUniformLoc(name), value);
+    void ShaderProgram::setInt(const UniformID id, const int value) const {
+        glUniform1i(getUniformLoc(id), value);
     }
-    void ShaderProgram::setFloat(const std::string &name, const float value) const {
-        glUniform1f(getUniformLoc(name), value);
+    void ShaderProgram::setFloat(const UniformID id, const float value) const {
+        glUniform1f(getUniformLoc(id), value);
     }
 
-    void ShaderProgram::setVec2(const std::string &name, const glm::vec2 &value) const {
-        glUniform2fv(getUniformLoc(name), 1, &value[0]);
+    void ShaderProgram::setVec2(const UniformID id, const glm::vec2 &value) const {
+        glUniform2fv(getUniformLoc(id), 1, &value[0]);
     }
-    void ShaderProgram::setVec3(const std::string &name, const glm::vec3 &value) const {
-        glUniform3fv(getUniformLoc(name), 1, &value[0]);
+    void ShaderProgram::setVec3(const UniformID id, const glm::vec3 &value) const {
+        glUniform3fv(getUniformLoc(id), 1, &value[0]);
     }
-    void ShaderProgram::setVec4(const std::string &name, const glm::vec4 &value) const {
-        glUniform4fv(getUniformLoc(name), 1, &value[0]);
+    void ShaderProgram::setVec4(const UniformID id, const glm::vec4 &value) const {
+        glUniform4fv(getUniformLoc(id), 1, &value[0]);
     }
 
-    void ShaderProgram::setVec2(const std::string &name, const float x, const float y) const {
-        glUniform2f(getUniformLoc(name), x, y);
+    void ShaderProgram::setVec2(const UniformID id, const float x, const float y) const {
+        glUniform2f(getUniformLoc(id), x, y);
     }
-    void ShaderProgram::setVec3(const std::string &name, const float x, const float y, const float z) const {
-        glUniform3f(getUniformLoc(name), x, y, z);
+    void ShaderProgram::setVec3(const UniformID id, const float x, const float y, const float z) const {
+        glUniform3f(getUniformLoc(id), x, y, z);
     }
-    void ShaderProgram::setVec4(const std::string &name, const float x, const float y, const float z, const float w) const {
-        glUniform4f(getUniformLoc(name), x, y, z, w);
+    void ShaderProgram::setVec4(const UniformID id, const float x, const float y, const float z, const float w) const {
+        glUniform4f(getUniformLoc(id), x, y, z, w);
     }
 
-    void ShaderProgram::setMat2(const std::string &name, const glm::mat2 &mat) const {
-        glUniformMatrix2fv(getUniformLoc(name), 1, GL_FALSE, &mat[0][0]);
+    void ShaderProgram::setMat2(const UniformID id, const glm::mat2 &mat) const {
+        glUniformMatrix2fv(getUniformLoc(id), 1, GL_FALSE, &mat[0][0]);
     }
-    void ShaderProgram::setMat3(const std::string &name, const glm::mat3 &mat) const {
-        glUniformMatrix3fv(getUniformLoc(name), 1, GL_FALSE, &mat[0][0]);
+    void ShaderProgram::setMat3(const UniformID id, const glm::mat3 &mat) const {
+        glUniformMatrix3fv(getUniformLoc(id), 1, GL_FALSE, &mat[0][0]);
     }
-    void ShaderProgram::setMat4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(getUniformLoc(name), 1, GL_FALSE, &mat[0][0]);
+    void ShaderProgram::setMat4(const UniformID id, const glm::mat4 &mat) const {
+        glUniformMatrix4fv(getUniformLoc(id), 1, GL_FALSE, &mat[0][0]);
     }
 
     std::expected<void, std::string> ShaderProgram::bindUniformBlock(const std::string &name, const unsigned int bindingPoint) const {
@@ -1,18 +1,98 @@
 #ifndef SHADER_PROGRAM_H
 #define SHADER_PROGRAM_H
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <expected>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <glm/fwd.hpp>
 
 namespace Engine {
+    /*!
+     * @brief 64 bit FNV-1a hash of a string, like a uniform name
+     */
+    constexpr uint64_t hashString(const std::string_view value) {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (const char c : value) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    /*!
+     * Identifies a uniform by the hash of its name. String literals are hashed at compile time,
+     * so passing one to a setter is a single table lookup. Names built at runtime are hashed when they're passed
+     */
+    struct UniformID {
+        uint64_t hash;
+
+        template<size_t N>
+        consteval UniformID(const char (&name)[N]) : hash(hashString(std::string_view(name, N - 1))) {}  // NOLINT(*-explicit-constructor)
+        UniformID(const std::string &name) : hash(hashString(name)) {}  // NOLINT(*-explicit-constructor)
+    };
+
+    /*!
+     * A shader program whose compiles and link have been issued, but not checked yet (see `ShaderProgram::startBuild`).
+     * With GL_KHR_parallel_shader_compile the driver builds it on its own threads in the meantime,
+     * otherwise the driver is free to defer the work until the first status check
+     */
+    class PendingProgram {
+    private:
+        friend class ShaderProgram;
+
+        unsigned int program = 0;
+        // Each compiled stage, with its file (and includes) for error messages. Empty if the program came from the binary cache
+        std::vector<std::pair<unsigned int, std::string>> shaders;
+        std::string name;
+        bool cacheBinary = false;
+        uint64_t cacheKey = 0;
+        // If it came from the binary cache, how long compiling it from source took
+        std::optional<float> cachedCompileMilliseconds;
+        std::chrono::steady_clock::time_point start;
+
+        PendingProgram() = default;
+
+    public:
+        ~PendingProgram();
+
+        // Non-copyable
+        PendingProgram(const PendingProgram&) = delete;
+        PendingProgram& operator=(const PendingProgram&) = delete;
+        // Moveable
+        PendingProgram(PendingProgram&& other) noexcept;
+        PendingProgram& operator=(PendingProgram&& other) noexcept;
+
+        /*!
+         * @return Whether the driver has finished building the program, so constructing the shader from it won't wait.
+         *  Always true without GL_KHR_parallel_shader_compile
+         */
+        [[nodiscard]] bool isReady() const;
+    };
+
     class ShaderProgram {
     protected:  // ShaderProgram should never be instantiated directly, only through derived classes
         explicit ShaderProgram(const std::vector<std::pair<std::string, unsigned int>> &filePaths);
+        /*!
+         * @brief Finish building a program, waiting for the driver if it isn't done yet
+         * @throws std::runtime_error If a shader failed to compile or the program failed to link
+         */
+        explicit ShaderProgram(PendingProgram &&pending);
     public:
         unsigned int programID;
 
+    private:
+        // The location of every active uniform, by the hash of its name. Filled in once the program is linked
+        std::unordered_map<uint64_t, int> uniformLocations;
+        void findUniformLocations();
+
+    public:
+
         ~ShaderProgram();
 
         // Non-copyable
@@ -23,30 +103,41 @@ namespace Engine {
         ShaderProgram& operator=(ShaderProgram&& other) noexcept;
 
         void use() const;
-        [[nodiscard]] int getUniformLoc(const std::string &name) const;
+        /*!
+         * @return The location of an active uniform, or -1 (which OpenGL ignores) if the program doesn't use it
+         */
+        [[nodiscard]] int getUniformLoc(UniformID id) const;
 
-    private:
-        static std::expected<unsigned int, std::string> loadShader(
-            const std::string &filePath,
-            unsigned int shaderType
-        );
-        static std::expected<std::string, std::string> preprocessSource(std::string shaderSrc);
+        /*!
+         * @brief Preprocess a program's shaders and issue their compiles and link, without waiting for any of them
+         * @param filePaths Pairs of file paths and shader types (GL_VERTEX_SHADER, GL_FRAGMENT_SHADER...)
+         * @param defines Macros defined in every stage, as "NAME" or "NAME VALUE", to build a variant of the program
+         * @return The build, to construct the shader from once it's needed
+         * @throws std::runtime_error If a shader couldn't be read or preprocessed
+         */
+        static PendingProgram startBuild(const std::vector<std::pair<std::string, unsigned int>> &filePaths,
+            const std::vector<std::string> &defines = {});
+        /*!
+         * @brief Start building several programs at once (see `startBuild`), so the driver's work on them overlaps
+         * @note Construct the shaders in the same order, so the ones finished first are checked first
+         */
+        static std::vector<PendingProgram> startBuilds(const std::vector<std::vector<std::pair<std::string, unsigned int>>> &programs);
 
     public:
-        void setBool(const std::string &name, bool value) const;
-        void setInt(const std::string &name, int value) const;
-        void setFloat(const std::string &name, float value) const;
-
-        void setVec2(const std::string &name, const glm::vec2 &value) const;
-        void setVec3(const std::string &name, const glm::vec3 &value) const;
-        void setVec4(const std::string &name, const glm::vec4 &value) const;
-        void setVec2(const std::string &name, float x, float y) const;
-        void setVec3(const std::string &name, float x, float y, float z) const;
-        void setVec4(const std::string &name, float x, float y, float z, float w) const;
-
-        void setMat2(const std::string &name, const glm::mat2 &mat) const;
-        void setMat3(const std::string &name, const glm::mat3 &mat) const;
-        void setMat4(const std::string &name, const glm::mat4 &mat) const;
+        void setBool(UniformID id, bool value) const;
+        void setInt(UniformID id, int value) const;
+        void setFloat(UniformID id, float value) const;
+
+        void setVec2(UniformID id, const glm::vec2 &value) const;
+        void setVec3(UniformID id, const glm::vec3 &value) const;
+        void setVec4(UniformID id, const glm::vec4 &value) const;
+        void setVec2(UniformID id, float x, float y) const;
+        void setVec3(UniformID id, float x, float y, float z) const;
+        void setVec4(UniformID id, float x, float y, float z, float w) const;
+
+        void setMat2(UniformID id, const glm::mat2 &mat) const;
+        void setMat3(UniformID id, const glm::mat3 &mat) const;
+        void setMat4(UniformID id, const glm::mat4 &mat) const;
 
         std::expected<void, std::string> bindUniformBlock(const std::string &name, unsigned int bindingPoint) const;
     };
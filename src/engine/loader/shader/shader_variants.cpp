@@ -0,0 +1,68 @@
+#include "shader_variants.h"
+
+#include <stdexcept>
+
+#include <engine/logging.h>
+
+namespace Engine {
+    ShaderVariants::ShaderVariants(const std::vector<std::pair<std::string, unsigned int>> &filePaths,
+            const std::vector<std::string> &features, std::function<void(const GraphicsShader &)> onBuilt, const std::vector<std::string> &defines)
+        : filePaths(filePaths), features(features), defines(defines), onBuilt(std::move(onBuilt)) {}
+
+    std::vector<std::string> ShaderVariants::getDefines(const ShaderVariantKey key) const {
+        std::vector<std::string> variantDefines = defines;
+        for (size_t i = 0; i < features.size(); i++)
+            if ((key & (1u << i)) != 0)
+                variantDefines.push_back(features[i]);
+        return variantDefines;
+    }
+
+    void ShaderVariants::finish(const ShaderVariantKey key, PendingProgram &&build) {
+        try {
+            const GraphicsShader &shader = variants.emplace(key, GraphicsShader(std::move(build))).first->second.value();
+            if (onBuilt)
+                onBuilt(shader);
+        } catch (const std::runtime_error &error) {
+            variants.insert_or_assign(key, std::unexpected(std::string(error.what())));
+        }
+    }
+
+    void ShaderVariants::prepare(const std::vector<ShaderVariantKey> &keys) {
+        for (const ShaderVariantKey key : keys) {
+            if (variants.contains(key) || pending.contains(key))
+                continue;
+            try {
+                pending.emplace(key, ShaderProgram::startBuild(filePaths, getDefines(key)));
+            } catch (const std::runtime_error &error) {
+                variants.emplace(key, std::unexpected(std::string(error.what())));
+            }
+        }
+    }
+
+    std::expected<const GraphicsShader *, std::string> ShaderVariants::get(const ShaderVariantKey key) {
+        auto it = variants.find(key);
+        if (it == variants.end()) {
+            if (features.size() < 32 && (key >> features.size()) != 0)
+                return UNEXPECTED_REF("Shader variant key " + std::to_string(key) + " has bits without a feature");
+
+            // Finishing a prepared build only waits for whatever the driver hasn't done yet
+            if (const auto pendingIt = pending.find(key); pendingIt != pending.end()) {
+                PendingProgram build = std::move(pendingIt->second);
+                pending.erase(pendingIt);
+                finish(key, std::move(build));
+            } else {
+                logDebug("Building shader variant %u of \"%s\" on first use", key, filePaths.empty() ? "" : filePaths.front().first.c_str());
+                try {
+                    finish(key, ShaderProgram::startBuild(filePaths, getDefines(key)));
+                } catch (const std::runtime_error &error) {
+                    variants.emplace(key, std::unexpected(std::string(error.what())));
+                }
+            }
+            it = variants.find(key);
+        }
+
+        if (!it->second.has_value())
+            return std::unexpected(it->second.error());
+        return &it->second.value();
+    }
+}
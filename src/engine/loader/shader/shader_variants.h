@@ -0,0 +1,69 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "graphics_shader.h"
+
+namespace Engine {
+    /*!
+     * A set of features to build a shader with, one bit per feature in `ShaderVariants::features`.
+     */
+    typedef uint32_t ShaderVariantKey;
+
+    /*!
+     * Every permutation of a graphics shader's optional features, each built as its own program with the features' macros defined.
+     * Code a variant doesn't use is compiled out instead of branched over at runtime.
+     * Variants are built the first time they're asked for, or ahead of time with `prepare`, then cached by key.
+     */
+    class ShaderVariants {
+    private:
+        std::vector<std::pair<std::string, unsigned int>> filePaths;
+        std::vector<std::string> features;
+        std::vector<std::string> defines;
+        std::function<void(const GraphicsShader &)> onBuilt;
+
+        std::unordered_map<ShaderVariantKey, PendingProgram> pending;
+        // Failed builds are kept too, so they aren't retried every time they're asked for
+        std::unordered_map<ShaderVariantKey, std::expected<GraphicsShader, std::string>> variants;
+
+        [[nodiscard]] std::vector<std::string> getDefines(ShaderVariantKey key) const;
+        void finish(ShaderVariantKey key, PendingProgram &&build);
+
+    public:
+        /*!
+         * @param filePaths Pairs of file paths and shader types (GL_VERTEX_SHADER, GL_FRAGMENT_SHADER...)
+         * @param features The macro each bit of a key defines, starting from the lowest bit
+         * @param onBuilt Called with each variant once it's built, to set up state that outlives draws (like uniform block bindings)
+         * @param defines Macros defined in every variant, as "NAME" or "NAME VALUE"
+         */
+        ShaderVariants(const std::vector<std::pair<std::string, unsigned int>> &filePaths, const std::vector<std::string> &features,
+            std::function<void(const GraphicsShader &)> onBuilt = {}, const std::vector<std::string> &defines = {});
+
+        /*!
+         * @brief Start building variants that will be needed soon, so the driver compiles them in parallel
+         */
+        void prepare(const std::vector<ShaderVariantKey> &keys);
+        /*!
+         * @return The variant with exactly these features, building it (and waiting for it) if needed, or an error message if it failed to build
+         */
+        std::expected<const GraphicsShader *, std::string> get(ShaderVariantKey key);
+
+        /*!
+         * @return The number of variants built so far, including failed ones
+         */
+        [[nodiscard]] size_t count() const { return variants.size(); }
+        [[nodiscard]] size_t pendingCount() const { return pending.size(); }
+
+        ShaderVariants(const ShaderVariants&) = delete;
+        ShaderVariants& operator=(const ShaderVariants&) = delete;
+    };
+}
+
+#endif
@@ -1,36 +1,89 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-#include <unordered_map>
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <future>
 #include <gl/glew.h>
 
 #include <engine/logging.h>
+#include <engine/util/thread_pool.h>
 
+#include "binary_io.h"
+#include "cooked_image.h"
+#include "equirectangular.h"
+#include "generic.h"
 #include "texture.h"
 
+#define TEXTURE_CACHE_MAGIC 0x544C4C4Cu  // "LLLT"
+#define TEXTURE_CACHE_VERSION 2u
+
 namespace Engine::Loader {
-    struct ImageData {
-        int width, height, channelCount;
-        stbi_uc *imgData;
-    };
-    /*!
-     * Internal helper function to load an image from a file.
-     * @attention You as the caller are responsible for freeing the allocated memory using `stbi_image_free`.
-     */
-    std::expected<ImageData, std::string> loadImage(const char *filePath) {
-        int width, height, channelCount;
-        stbi_uc *imgData = stbi_load(filePath, &width, &height, &channelCount, 0);
+    void ImageDeleter::operator()(unsigned char *pixels) const {
+        stbi_image_free(pixels);
+    }
+
+    std::expected<Image, std::string> decodeImage(const std::string &filePath) {
+        Image image;
+        stbi_uc *imgData = stbi_load(filePath.c_str(), &image.width, &image.height, &image.channelCount, 0);
         if (!imgData) {
-            stbi_image_free(imgData);
-            logError("Failed to load texture \"%s\": %s", filePath, stbi_failure_reason());
-            return std::unexpected(FILE_REF + std::string("Failed to load texture: \"") + filePath + "\": " + stbi_failure_reason());
+            // The failure reason is thread-local, so this is fine on worker threads
+            logError("Failed to load texture \"%s\": %s", filePath.c_str(), stbi_failure_reason());
+            return std::unexpected(FILE_REF + "Failed to load texture: \"" + filePath + "\": " + stbi_failure_reason());
+        }
+
+        image.pixels.reset(imgData);
+        return image;
+    }
+
+    std::expected<Image, std::string> decodeImage(const std::span<const unsigned char> data) {
+        Image image;
+        stbi_uc *imgData = stbi_load_from_memory(data.data(), static_cast<int>(data.size()), &image.width, &image.height, &image.channelCount, 0);
+        if (!imgData)
+            return std::unexpected(FILE_REF + "Failed to decode image from memory: " + stbi_failure_reason());
+
+        image.pixels.reset(imgData);
+        return image;
+    }
+
+    std::expected<Image, std::string> loadImage(const std::string &filePath) {
+        const std::string cachePath = getCachePath(filePath, ".qimg");
+        if (isCacheFresh(cachePath, filePath)) {
+            std::expected<std::vector<unsigned char>, std::string> data = readBinaryFile(cachePath);
+            std::expected<Image, std::string> image = data.has_value()
+                ? decodeCookedImage(data.value())
+                : std::unexpected(FW_UNEXP(data, "Failed to read cooked image"));
+            if (image.has_value())
+                return image;
+            logWarn("Discarding cooked image \"%s\"" NL_INDENT "%s", cachePath.c_str(), image.error().c_str());
         }
 
-        return ImageData{width, height, channelCount, imgData};
+        std::expected<Image, std::string> image = decodeImage(filePath);
+        if (!image.has_value())
+            return image;
+
+        // Next time, skip decoding the source
+        const std::vector<unsigned char> cooked = encodeCookedImage(image.value());
+        std::expected<void, std::string> writeRet = createParentDirectories(cachePath);
+        if (writeRet.has_value()) {
+            BinaryWriter writer(cachePath);
+            writer.writeArray(cooked.data(), cooked.size());
+            if (!writer.commit())
+                writeRet = UNEXPECTED_REF("Failed to write cooked image \"" + cachePath + "\"");
+        }
+        if (!writeRet.has_value())
+            logWarn("Failed to cache cooked image for \"%s\"" NL_INDENT "%s", filePath.c_str(), writeRet.error().c_str());
+        return image;
+    }
+
+    void generateMips(Image &image, const TextureUsage usage) {
+        image.mips = generateMipChain(image.pixels.get(), image.width, image.height, image.channelCount, getMipOptions(image.channelCount, usage));
     }
 
-    GLint getChannelCount(const int channelCount) {
+    int getPixelFormat(const int channelCount) {
         switch (channelCount) {
             case 1: return GL_RED;
+            case 2: return GL_RG;
             case 3: return GL_RGB;
             case 4: return GL_RGBA;
             default: {
@@ -40,66 +93,384 @@ namespace Engine::Loader {
         }
     }
 
-    std::expected<unsigned int, std::string> loadTexture(const char *filePath) {
-        std::expected<ImageData, std::string> imgData = loadImage(filePath);
-        if (!imgData)
-            return std::unexpected(FW_UNEXP(imgData, "Failed to load texture"));
+    unsigned int getSizedFormat(const int channelCount) {
+        switch (channelCount) {
+            case 1: return GL_R8;
+            case 2: return GL_RG8;
+            case 3: return GL_RGB8;
+            case 4: return GL_RGBA8;
+            default: return GL_R8;  // Matches getPixelFormat
+        }
+    }
 
-        logDebug("Loaded texture \"%s\" with dimensions %dx%d", filePath, imgData->width, imgData->height);
-        const GLint format = getChannelCount(imgData->channelCount);
+    int getMipLevelCount(const int width, const int height) {
+        return static_cast<int>(std::bit_width(static_cast<unsigned int>(std::max(width, height))));
+    }
 
+    void setTexture2DParameters() {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);  // TODO: GL_CLAMP_TO_EDGE to better support alpha textures?
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    void setCubeMapParameters() {
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    unsigned int createTexture(const int width, const int height, const int channelCount) {
         unsigned int textureID;
         glGenTextures(1, &textureID);
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, imgData->width, imgData->height, 0, format, GL_UNSIGNED_BYTE, imgData->imgData);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(imgData->imgData);
+        glTexStorage2D(GL_TEXTURE_2D, getMipLevelCount(width, height), getSizedFormat(channelCount), width, height);
+        setTexture2DParameters();
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);  // TODO: GL_CLAMP_TO_EDGE to better support alpha textures?
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        return textureID;
+    }
+
+    unsigned int createCubeMap(const std::span<const Image, 6> faces) {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+        // Every face shares the same immutable storage, so they must all match the first
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, getSizedFormat(faces[0].channelCount), faces[0].width, faces[0].height);
+        setCubeMapParameters();
 
         return textureID;
     }
 
-    std::expected<unsigned int, std::string> loadCubeMap(const std::string &filePath) {
+    unsigned int createCompressedTexture(const CompressedTexture &texture) {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(texture.levels.size()), getBlockGlFormat(texture.format),
+            texture.levels[0].width, texture.levels[0].height);
+        setTexture2DParameters();
+
+        return textureID;
+    }
+
+    unsigned int createCompressedCubeMap(const std::span<const CompressedTexture, 6> faces) {
         unsigned int textureID;
         glGenTextures(1, &textureID);
+
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, static_cast<GLsizei>(faces[0].levels.size()), getBlockGlFormat(faces[0].format),
+            faces[0].levels[0].width, faces[0].levels[0].height);
+        setCubeMapParameters();
+
+        return textureID;
+    }
+
+    unsigned int uploadTexture(const Image &image) {
+        const unsigned int textureID = createTexture(image.width, image.height, image.channelCount);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // Rows of RGB and single channel images aren't 4 byte aligned
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height,
+            getPixelFormat(image.channelCount), GL_UNSIGNED_BYTE, image.pixels.get());
+        for (size_t i = 0; i < image.mips.size(); i++)
+            glTexSubImage2D(GL_TEXTURE_2D, static_cast<int>(i + 1), 0, 0, image.mips[i].width, image.mips[i].height,
+                getPixelFormat(image.channelCount), GL_UNSIGNED_BYTE, image.mips[i].pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (image.mips.empty())
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+        return textureID;
+    }
+
+    unsigned int uploadCubeMap(const std::array<Image, 6> &faces) {
+        const unsigned int textureID = createCubeMap(faces);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int i = 0; i < 6; i++)
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, faces[i].width, faces[i].height,
+                getPixelFormat(faces[i].channelCount), GL_UNSIGNED_BYTE, faces[i].pixels.get());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        return textureID;
+    }
 
-        const std::pmr::unordered_map<GLint, std::string> dirMap = {
-            {GL_TEXTURE_CUBE_MAP_POSITIVE_X, "right"},
-            {GL_TEXTURE_CUBE_MAP_NEGATIVE_X, "left"},
-            {GL_TEXTURE_CUBE_MAP_POSITIVE_Y, "top"},
-            {GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, "bottom"},
-            {GL_TEXTURE_CUBE_MAP_POSITIVE_Z, "front"},
-            {GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, "back"}
-        };
+    std::expected<unsigned int, std::string> loadTexture(const char *filePath) {
+        std::expected<Image, std::string> image = loadImage(filePath);
+        if (!image)
+            return std::unexpected(FW_UNEXP(image, "Failed to load texture"));
+        generateMips(image.value());
+
+        logDebug("Loaded texture \"%s\" with dimensions %dx%d", filePath, image->width, image->height);
+        return uploadTexture(image.value());
+    }
 
+    // In the order of the GL_TEXTURE_CUBE_MAP_* targets
+    constexpr std::array<const char *, 6> CUBE_MAP_FACE_NAMES = {"right", "left", "top", "bottom", "front", "back"};
+
+    std::array<std::string, 6> getCubeMapFacePaths(const std::string &filePath) {
         const auto extension_index = filePath.find_last_of('.');
+        std::array<std::string, 6> paths;
+        for (int i = 0; i < 6; i++)
+            paths[i] = filePath.substr(0, extension_index) + "_" + CUBE_MAP_FACE_NAMES[i] + filePath.substr(extension_index);
+        return paths;
+    }
+
+    std::expected<unsigned int, std::string> loadCubeMap(const std::string &filePath) {
+        const std::array<std::string, 6> paths = getCubeMapFacePaths(filePath);
+
+        // Decode all the faces at once
+        std::array<std::future<std::expected<Image, std::string>>, 6> pendingFaces;
+        for (int i = 0; i < 6; i++)
+            pendingFaces[i] = ThreadPool::shared().submit([path = paths[i]] { return loadImage(path); });
+
+        std::array<Image, 6> faces;
         for (int i = 0; i < 6; i++) {
-            const GLint faceDir = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+            std::expected<Image, std::string> face = pendingFaces[i].get();
+            if (!face)
+                return std::unexpected(FW_UNEXP(face, "Failed to load cubemap texture"));
+            faces[i] = std::move(face.value());
+        }
+
+        return uploadCubeMap(faces);
+    }
 
-            const auto path = filePath.substr(0, extension_index) + "_" + dirMap.at(faceDir) + filePath.substr(extension_index);
+#pragma region Compressed texture cache
+    // Tightly packed RGBA pixels of a single mip level
+    struct RgbaLevel {
+        int width, height;
+        std::vector<unsigned char> pixels;
+    };
+
+    RgbaLevel expandToRgba(const Image &image) {
+        RgbaLevel level{image.width, image.height, std::vector<unsigned char>(static_cast<size_t>(image.width) * image.height * 4)};
+        const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+        for (size_t i = 0; i < pixelCount; i++) {
+            const unsigned char *source = image.pixels.get() + i * image.channelCount;
+            unsigned char *target = level.pixels.data() + i * 4;
+            target[0] = source[0];
+            target[1] = image.channelCount >= 2 ? source[1] : 0;
+            target[2] = image.channelCount >= 3 ? source[2] : 0;
+            target[3] = image.channelCount >= 4 ? source[3] : 255;
+        }
+        return level;
+    }
 
-            std::expected<ImageData, std::string> imgData = loadImage(path.c_str());
-            if (!imgData) {
-                glDeleteTextures(1, &textureID);
-                return std::unexpected(FW_UNEXP(imgData, "Failed to load cubemap texture"));
+    std::expected<void, std::string> writeCompressedTexture(const std::string &cachePath, const CompressedTexture &texture, const bool highQuality) {
+        auto dirRet = createParentDirectories(cachePath);
+        if (!dirRet.has_value())
+            return std::unexpected(FW_UNEXP(dirRet, "Failed to create texture cache directory"));
+
+        BinaryWriter writer(cachePath);
+        writer.write(TEXTURE_CACHE_MAGIC);
+        writer.write(TEXTURE_CACHE_VERSION);
+        writer.write(static_cast<uint32_t>(texture.format));
+        writer.write(static_cast<uint8_t>(highQuality));
+        writer.write(static_cast<uint32_t>(texture.levels.size()));
+        for (const CompressedTexture::Level &level : texture.levels) {
+            writer.write(static_cast<int32_t>(level.width));
+            writer.write(static_cast<int32_t>(level.height));
+            writer.writeVector(level.data);
+        }
+        if (!writer.commit())
+            return UNEXPECTED_REF("Failed to write texture cache \"" + cachePath + "\"");
+        return {};
+    }
+
+    std::expected<CompressedTexture, std::string> readCompressedTexture(const std::string &cachePath, const bool highQuality, const int maxResolution) {
+        BinaryReader reader(cachePath);
+        if (reader.read<uint32_t>() != TEXTURE_CACHE_MAGIC || reader.read<uint32_t>() != TEXTURE_CACHE_VERSION)
+            return UNEXPECTED_REF("Not a cached texture, or an outdated one: \"" + cachePath + "\"");
+
+        CompressedTexture texture{};
+        texture.format = static_cast<BlockFormat>(reader.read<uint32_t>());
+        if (static_cast<bool>(reader.read<uint8_t>()) != highQuality)
+            return UNEXPECTED_REF("Cached texture was cooked at a different quality: \"" + cachePath + "\"");
+
+        const auto levelCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < levelCount && reader.good(); i++) {
+            CompressedTexture::Level level{};
+            level.width = reader.read<int32_t>();
+            level.height = reader.read<int32_t>();
+            if (maxResolution > 0 && std::max(level.width, level.height) > maxResolution) {
+                // Levels are stored largest first, so streaming in the low mips only reads the end of the file
+                const auto byteCount = reader.read<uint64_t>();
+                if (byteCount != getCompressedSize(texture.format, level.width, level.height))
+                    return UNEXPECTED_REF("Cached texture level has the wrong size: \"" + cachePath + "\"");
+                reader.skip(byteCount);
+                continue;
             }
+            level.data = reader.readVector<unsigned char>();
+            if (level.data.size() != getCompressedSize(texture.format, level.width, level.height))
+                return UNEXPECTED_REF("Cached texture level has the wrong size: \"" + cachePath + "\"");
+            texture.levels.push_back(std::move(level));
+        }
+
+        if (!reader.good() || texture.levels.empty())
+            return UNEXPECTED_REF("Cached texture is truncated: \"" + cachePath + "\"");
+        return texture;
+    }
 
-            const GLint format = getChannelCount(imgData->channelCount);
-            glTexImage2D(faceDir,
-                0, format, imgData->width, imgData->height, 0, format, GL_UNSIGNED_BYTE, imgData->imgData);
+    /*!
+     * @brief Compress a level and every mip level below it, down to 1x1
+     */
+    CompressedTexture compressMipChain(const RgbaLevel &level, const BlockFormat format, const MipOptions &options) {
+        CompressedTexture texture{format, {}};
+        texture.levels.push_back({level.width, level.height, compressImage(level.pixels.data(), level.width, level.height, format)});
+        for (const MipLevel &mip : generateMipChain(level.pixels.data(), level.width, level.height, 4, options))
+            texture.levels.push_back({mip.width, mip.height, compressImage(mip.pixels.data(), mip.width, mip.height, format)});
+        return texture;
+    }
+
+    std::expected<CompressedTexture, std::string> cookCompressedTexture(const std::string &filePath, const bool highQuality, const TextureUsage usage) {
+        std::expected<Image, std::string> image = loadImage(filePath);
+        if (!image.has_value())
+            return std::unexpected(FW_UNEXP(image, "Failed to load texture for cooking"));
+
+        // Options come from the source channels, since expanding to RGBA adds an opaque alpha rather than a cutout
+        return compressMipChain(expandToRgba(image.value()), chooseBlockFormat(image->channelCount, highQuality),
+            getMipOptions(image->channelCount, usage));
+    }
+
+    std::expected<CompressedTexture, std::string> loadCompressedTexture(const std::string &filePath, const bool highQuality, const int maxResolution,
+            const TextureUsage usage) {
+        // The mip chains differ, so a texture used both ways is cooked twice
+        const std::string cachePath = getCachePath(filePath, usage == TextureUsage::SPECULAR ? ".specular.btex" : ".btex");
+        if (isCacheFresh(cachePath, filePath)) {
+            std::expected<CompressedTexture, std::string> texture = readCompressedTexture(cachePath, highQuality, maxResolution);
+            if (texture.has_value())
+                return texture;
+            logWarn("Discarding texture cache" NL_INDENT "%s", texture.error().c_str());
         }
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        return textureID;
+        std::expected<CompressedTexture, std::string> texture = cookCompressedTexture(filePath, highQuality, usage);
+        if (!texture.has_value())
+            return std::unexpected(FW_UNEXP(texture, "Failed to cook texture"));
+
+        auto writeRet = writeCompressedTexture(cachePath, texture.value(), highQuality);
+        if (!writeRet.has_value())
+            logWarn("Failed to cache cooked texture \"%s\"" NL_INDENT "%s", filePath.c_str(), writeRet.error().c_str());
+        else
+            logDebug("Cooked texture \"%s\" (%zu KiB compressed)", filePath.c_str(), texture->byteSize() / 1024);
+
+        // The whole chain is cached, but only the requested levels are returned
+        if (maxResolution > 0) {
+            std::vector<CompressedTexture::Level> &levels = texture->levels;
+            const auto first = std::ranges::find_if(levels, [maxResolution](const CompressedTexture::Level &level) {
+                return std::max(level.width, level.height) <= maxResolution;
+            });
+            levels.erase(levels.begin(), first);
+        }
+        return texture;
+    }
+#pragma endregion
+
+#pragma region Equirectangular cubemaps
+    std::expected<std::array<Image, 6>, std::string> loadEquirectangularCubeMap(const std::string &filePath) {
+        std::expected<Image, std::string> panorama = loadImage(filePath);
+        if (!panorama.has_value())
+            return std::unexpected(FW_UNEXP(panorama, "Failed to load equirectangular panorama"));
+
+        const RgbaLevel rgba = expandToRgba(panorama.value());
+        const int faceSize = getCubeMapFaceSize(rgba.width);
+        std::array<Image, 6> faces;
+        std::array<unsigned char *, 6> facePixels{};
+        for (int i = 0; i < 6; i++) {
+            // Images are freed by stb_image, which uses free
+            facePixels[i] = static_cast<unsigned char *>(std::malloc(static_cast<size_t>(faceSize) * faceSize * 4));
+            if (facePixels[i] == nullptr)
+                return UNEXPECTED_REF("Failed to allocate cubemap faces for \"" + filePath + "\"");
+            faces[i] = {faceSize, faceSize, 4, std::unique_ptr<unsigned char[], ImageDeleter>(facePixels[i])};
+        }
+
+        equirectangularToCubeMap(rgba.pixels.data(), rgba.width, rgba.height, faceSize, facePixels);
+        return faces;
+    }
+
+    std::expected<std::array<CompressedTexture, 6>, std::string> loadCompressedEquirectangularCubeMap(const std::string &filePath, const bool highQuality) {
+        std::array<std::string, 6> cachePaths;
+        for (int i = 0; i < 6; i++)
+            cachePaths[i] = getCachePath(filePath, std::string("_") + CUBE_MAP_FACE_NAMES[i] + ".btex");
+
+        std::array<CompressedTexture, 6> faces;
+        if (std::ranges::all_of(cachePaths, [&filePath](const std::string &cachePath) { return isCacheFresh(cachePath, filePath); })) {
+            std::expected<void, std::string> readRet;
+            for (int i = 0; i < 6 && readRet.has_value(); i++) {
+                std::expected<CompressedTexture, std::string> face = readCompressedTexture(cachePaths[i], highQuality, 0);
+                if (face.has_value())
+                    faces[i] = std::move(face.value());
+                else
+                    readRet = std::unexpected(face.error());
+            }
+            if (readRet.has_value())
+                return faces;
+            logWarn("Discarding cubemap cache" NL_INDENT "%s", readRet.error().c_str());
+        }
+
+        std::expected<Image, std::string> panorama = loadImage(filePath);
+        if (!panorama.has_value())
+            return std::unexpected(FW_UNEXP(panorama, "Failed to load equirectangular panorama for cooking"));
+
+        const RgbaLevel rgba = expandToRgba(panorama.value());
+        const int faceSize = getCubeMapFaceSize(rgba.width);
+        std::array<RgbaLevel, 6> faceLevels;
+        std::array<unsigned char *, 6> facePixels{};
+        for (int i = 0; i < 6; i++) {
+            faceLevels[i] = {faceSize, faceSize, std::vector<unsigned char>(static_cast<size_t>(faceSize) * faceSize * 4)};
+            facePixels[i] = faceLevels[i].pixels.data();
+        }
+        equirectangularToCubeMap(rgba.pixels.data(), rgba.width, rgba.height, faceSize, facePixels);
+
+        const BlockFormat format = chooseBlockFormat(panorama->channelCount, highQuality);
+        MipOptions mipOptions = getMipOptions(panorama->channelCount, TextureUsage::DIFFUSE);
+        mipOptions.wrap = false;  // Faces meet other faces at their edges, not themselves
+        size_t byteSize = 0;
+        for (int i = 0; i < 6; i++) {
+            faces[i] = compressMipChain(faceLevels[i], format, mipOptions);
+            byteSize += faces[i].byteSize();
+            auto writeRet = writeCompressedTexture(cachePaths[i], faces[i], highQuality);
+            if (!writeRet.has_value())
+                logWarn("Failed to cache cooked cubemap face \"%s\"" NL_INDENT "%s", cachePaths[i].c_str(), writeRet.error().c_str());
+        }
+        logDebug("Cooked equirectangular cubemap \"%s\" (%dx%d faces, %zu KiB compressed)", filePath.c_str(), faceSize, faceSize, byteSize / 1024);
+        return faces;
+    }
+#pragma endregion
+
+    size_t estimateTextureBytes(const unsigned int textureID, const unsigned int target) {
+        glBindTexture(target, textureID);
+        // Cubemap levels have to be queried per face, but all faces are the same size
+        const GLenum levelTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+        const size_t faceCount = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+
+        size_t bytes = 0;
+        for (int level = 0; ; level++) {
+            GLint width = 0, height = 0;
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_HEIGHT, &height);
+            if (width == 0 || height == 0)
+                break;
+
+            GLint compressed = GL_FALSE;
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED, &compressed);
+            if (compressed) {
+                GLint compressedSize = 0;
+                glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+                bytes += static_cast<size_t>(compressedSize) * faceCount;
+                continue;
+            }
+
+            GLint bits = 0;
+            for (const GLenum component : {GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+                                           GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE}) {
+                GLint componentBits = 0;
+                glGetTexLevelParameteriv(levelTarget, level, component, &componentBits);
+                bits += componentBits;
+            }
+            bytes += static_cast<size_t>(width) * height * ((bits + 7) / 8) * faceCount;
+        }
+        return bytes;
     }
-}
\ No newline at end of file
+}
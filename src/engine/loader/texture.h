@@ -1,9 +1,160 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
+#include <array>
 #include <expected>
+#include <memory>
+#include <span>
 #include <string>
+#include <vector>
+
+#include "block_compression.h"
+#include "mipmap.h"
 
 namespace Engine::Loader {
+    struct ImageDeleter {
+        void operator()(unsigned char *pixels) const;
+    };
+
+    /*!
+     * Decoded pixels of an image, tightly packed with 8 bits per channel.
+     */
+    struct Image {
+        int width = 0, height = 0, channelCount = 0;
+        // Must be allocated with malloc (which stb_image uses)
+        std::unique_ptr<unsigned char[], ImageDeleter> pixels;
+        // The levels below this one, if they were generated on the CPU (see `generateMips`)
+        std::vector<MipLevel> mips;
+
+        [[nodiscard]] size_t byteSize() const {
+            return static_cast<size_t>(width) * height * channelCount;
+        }
+    };
+
+    /*!
+     * A block compressed texture with its full mip chain, as stored in the texture cache.
+     */
+    struct CompressedTexture {
+        struct Level {
+            int width, height;
+            std::vector<unsigned char> data;
+        };
+
+        BlockFormat format;
+        std::vector<Level> levels;
+
+        [[nodiscard]] size_t byteSize() const {
+            size_t bytes = 0;
+            for (const Level &level : levels)
+                bytes += level.data.size();
+            return bytes;
+        }
+    };
+
+    /*!
+     * Decode an image from a file with stb_image.
+     * @param filePath The path to the file.
+     * @return The decoded image, or an error message.
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads.
+     */
+    std::expected<Image, std::string> decodeImage(const std::string &filePath);
+    /*!
+     * Decode an image file that is already in memory (like a texture embedded in a scene) with stb_image, without copying it first.
+     * @param data The contents of the image file.
+     * @return The decoded image, or an error message.
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads.
+     */
+    std::expected<Image, std::string> decodeImage(std::span<const unsigned char> data);
+    /*!
+     * Load an image, preferring its cooked version (see `encodeCookedImage`) when it is at least as new as the source.
+     * Otherwise the source is decoded, and cooked for next time.
+     * @param filePath The path to the source image.
+     * @return The decoded image, or an error message.
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads. Failing to write the cooked image isn't an error.
+     */
+    std::expected<Image, std::string> loadImage(const std::string &filePath);
+    /*!
+     * Generate the full mip chain of an image on the CPU, with the filtering options suited to its channels and usage (see `getMipOptions`).
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads.
+     */
+    void generateMips(Image &image, TextureUsage usage = TextureUsage::DIFFUSE);
+
+    /*!
+     * Get the OpenGL pixel format of an image with the given number of channels.
+     */
+    int getPixelFormat(int channelCount);
+    /*!
+     * Get the sized OpenGL internal format used to store an image with the given number of channels.
+     */
+    unsigned int getSizedFormat(int channelCount);
+    /*!
+     * Get the number of levels in a full mip chain, down to 1x1.
+     */
+    int getMipLevelCount(int width, int height);
+    /*!
+     * Set the wrapping and filtering of the bound 2D texture.
+     */
+    void setTexture2DParameters();
+    /*!
+     * Set the wrapping and filtering of the bound cubemap texture.
+     */
+    void setCubeMapParameters();
+
+    /*!
+     * Create a 2D texture with immutable storage for a full mip chain, to be filled in with `glTexSubImage2D`.
+     * @return The texture ID.
+     * @attention It is YOUR responsibility to free the memory allocated by opengl.
+     * @note Every level has to be filled in, either with the image's generated mips or by `glGenerateMipmap`.
+     */
+    unsigned int createTexture(int width, int height, int channelCount);
+    /*!
+     * Create a cubemap texture with immutable storage matching the size and format of the given faces.
+     * Every face must have the same size and channel count.
+     * @return The texture ID.
+     * @attention It is YOUR responsibility to free the memory allocated by opengl.
+     */
+    unsigned int createCubeMap(std::span<const Image, 6> faces);
+    /*!
+     * Create a 2D texture with immutable storage for every level of a compressed texture,
+     * to be filled in with `glCompressedTexSubImage2D`.
+     * @return The texture ID.
+     * @attention It is YOUR responsibility to free the memory allocated by opengl.
+     */
+    unsigned int createCompressedTexture(const CompressedTexture &texture);
+    /*!
+     * Create a cubemap texture with immutable storage for every level of six compressed faces.
+     * @return The texture ID.
+     * @attention It is YOUR responsibility to free the memory allocated by opengl.
+     */
+    unsigned int createCompressedCubeMap(std::span<const CompressedTexture, 6> faces);
+
+    /*!
+     * Upload a decoded image as a mipmapped 2D texture. Its generated mips are uploaded if it has any, otherwise they're generated by OpenGL.
+     * @return The texture ID.
+     * @attention It is YOUR responsibility to free the memory allocated by opengl.
+     */
+    unsigned int uploadTexture(const Image &image);
+    /*!
+     * Upload six decoded images as a cubemap texture.
+     * @param faces The faces, in the order of the `GL_TEXTURE_CUBE_MAP_*` targets (+X, -X, +Y, -Y, +Z, -Z).
+     * @return The texture ID.
+     * @attention It is YOUR responsibility to free the memory allocated by opengl.
+     */
+    unsigned int uploadCubeMap(const std::array<Image, 6> &faces);
+
+    /*!
+     * Load the block compressed version of a texture from the texture cache, cooking it first if it is missing or stale.
+     * Cooking decodes the source image, generates its mip chain and compresses every level.
+     * @param filePath The path to the source image.
+     * @param highQuality Whether colour images should use BC7 rather than BC1/BC3. Changing this re-cooks the texture.
+     * @param maxResolution If positive, only levels whose width and height are at most this are loaded, skipping the rest of the file.
+     *  The smaller levels of a mip chain are a complete mip chain themselves, so the result is a smaller version of the texture.
+     * @param usage How the mip chain is filtered. Each usage is cached separately
+     * @return The compressed texture, or an error message.
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads. Failing to write the cache isn't an error.
+     */
+    std::expected<CompressedTexture, std::string> loadCompressedTexture(const std::string &filePath, bool highQuality, int maxResolution = 0,
+        TextureUsage usage = TextureUsage::DIFFUSE);
+
     /*!
      * Load a texture from a file.
      * @param filePath The path to the file.
@@ -12,15 +163,48 @@ namespace Engine::Loader {
      */
     std::expected<unsigned int, std::string> loadTexture(const char* filePath);
 
-    // TODO: Allow loading cubemap from equirectangular projection
     /*!
-     * Loads a cubemap texture from a set of files.
+     * Get the paths of the six faces of a cubemap.
+     * @param filePath The path to the file. The different directions are inserted before the file extension with an underscore.
+     * @note The file name suffixes are: `_right`, `_left`, `_top`, `_bottom`, `_front`, `_back`.
+     */
+    std::array<std::string, 6> getCubeMapFacePaths(const std::string &filePath);
+
+    /*!
+     * Loads a cubemap texture from a set of files, decoding all faces concurrently on the shared thread pool.
      * @param filePath The path to the file. The different directions are inserted before the file extension with an underscore.
      * @return The texture ID if successful, or an error message if not.
      * @attention If returned successfully, it is YOUR responsibility to free the memory allocated by opengl.
+     * @attention Don't call this from a task on the shared thread pool, since it waits for other tasks on it.
      * @note The file name suffixes are: `_right`, `_left`, `_top`, `_bottom`, `_front`, `_back`.
      */
     std::expected<unsigned int, std::string> loadCubeMap(const std::string &filePath);
+
+    /*!
+     * Decode an equirectangular panorama and project it onto the six faces of a cubemap on the CPU (see `equirectangularToCubeMap`).
+     * @param filePath The path to the panorama.
+     * @return The RGBA faces, in the order of the `GL_TEXTURE_CUBE_MAP_*` targets, or an error message.
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads.
+     */
+    std::expected<std::array<Image, 6>, std::string> loadEquirectangularCubeMap(const std::string &filePath);
+    /*!
+     * Load the block compressed faces of a cubemap projected from an equirectangular panorama from the texture cache,
+     * converting and cooking them first if they are missing or stale. Each face is cached with its full mip chain.
+     * @param filePath The path to the panorama.
+     * @param highQuality Whether colour images should use BC7 rather than BC1/BC3. Changing this re-cooks the faces.
+     * @return The compressed faces, in the order of the `GL_TEXTURE_CUBE_MAP_*` targets, or an error message.
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads. Failing to write the cache isn't an error.
+     */
+    std::expected<std::array<CompressedTexture, 6>, std::string> loadCompressedEquirectangularCubeMap(const std::string &filePath, bool highQuality);
+
+    /*!
+     * Estimate the GPU memory used by a texture, from the size and format of each of its mip levels.
+     * @param textureID The texture to query
+     * @param target The texture's target (`GL_TEXTURE_2D` or `GL_TEXTURE_CUBE_MAP`)
+     * @return The estimated size in bytes
+     * @note Binds the texture to `target`
+     */
+    size_t estimateTextureBytes(unsigned int textureID, unsigned int target);
 }
 
 #endif //TEXTURE_H
@@ -0,0 +1,322 @@
+#include "world.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <unordered_map>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <glm/glm.hpp>
+
+#include <engine/logging.h>
+
+#include "binary_io.h"
+#include "generic.h"
+
+#ifndef NDEBUG
+#include <chrono>
+#endif
+
+#define WORLD_INDEX_MAGIC 0x574C4C4Cu  // "LLLW"
+#define WORLD_CELL_MAGIC 0x434C4C4Cu  // "LLLC"
+#define WORLD_FORMAT_VERSION 2u
+
+
+namespace Engine::Loader {
+    std::string getWorldIndexPath(const std::string &scenePath) {
+        return getCachePath(scenePath, ".world");
+    }
+
+    std::string getCellPath(const std::string &scenePath, const int x, const int z) {
+        return getCachePath(scenePath, ".cells/cell_" + std::to_string(x) + "_" + std::to_string(z) + ".bin");
+    }
+
+#pragma region Partitioning
+    struct CellBuilder {
+        std::map<unsigned int, CellMeshData> meshesByMaterial;
+        Bounds bounds;
+    };
+
+    std::expected<void, std::string> writeCell(const std::string &cellPath, const CellBuilder &cell) {
+        auto dirRet = createParentDirectories(cellPath);
+        if (!dirRet.has_value())
+            return std::unexpected(FW_UNEXP(dirRet, "Failed to create cell directory"));
+
+        BinaryWriter writer(cellPath);
+        writer.write(WORLD_CELL_MAGIC);
+        writer.write(WORLD_FORMAT_VERSION);
+        writer.write(static_cast<uint32_t>(cell.meshesByMaterial.size()));
+        for (const auto &[materialIndex, mesh] : cell.meshesByMaterial) {
+            writer.write(static_cast<uint32_t>(materialIndex));
+            writer.writeVector(mesh.vertices);
+            writer.writeVector(mesh.indices);
+        }
+        if (!writer.commit())
+            return UNEXPECTED_REF("Failed to write cell \"" + cellPath + "\"");
+        return {};
+    }
+
+    std::expected<void, std::string> writeWorldIndex(const std::string &indexPath, const WorldIndex &index) {
+        BinaryWriter writer(indexPath);
+        writer.write(WORLD_INDEX_MAGIC);
+        writer.write(WORLD_FORMAT_VERSION);
+        writer.write(index.cellSize);
+
+        writer.write(static_cast<uint32_t>(index.materials.size()));
+        for (const Material &material : index.materials) {
+            writer.writeString(material.diffusePath);
+            writer.writeString(material.specularPath);
+            writer.write(material.shininess);
+        }
+
+        writer.write(static_cast<uint32_t>(index.cells.size()));
+        for (const WorldCell &cell : index.cells) {
+            writer.write(static_cast<int32_t>(cell.x));
+            writer.write(static_cast<int32_t>(cell.z));
+            writer.write(cell.bounds);
+            writer.write(static_cast<uint64_t>(cell.gpuBytes));
+            writer.writeString(cell.path);
+        }
+
+        // Stored decoded, so loading the index never has to decode them again
+        writer.write(static_cast<uint32_t>(index.embeddedTextures.size()));
+        for (const EmbeddedTexture &texture : index.embeddedTextures) {
+            writer.writeString(texture.key);
+            writer.write(static_cast<int32_t>(texture.image.width));
+            writer.write(static_cast<int32_t>(texture.image.height));
+            writer.write(static_cast<int32_t>(texture.image.channelCount));
+            writer.writeArray(texture.image.pixels.get(), texture.image.byteSize());
+        }
+        if (!writer.commit())
+            return UNEXPECTED_REF("Failed to write world index \"" + indexPath + "\"");
+        return {};
+    }
+
+    std::expected<WorldIndex, std::string> partitionScene(const std::string &scenePath, const float cellSize) {
+#ifndef NDEBUG
+        const auto start = std::chrono::high_resolution_clock::now();
+#endif
+        Assimp::Importer importer;
+        const aiScene* loadedScene = importer.ReadFile(scenePath.c_str(),
+            aiProcess_Triangulate
+            | aiProcess_FlipUVs
+        );
+        if (!loadedScene || loadedScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !loadedScene->mRootNode)
+            return std::unexpected(std::string("Failed to load scene for partitioning: ") + importer.GetErrorString());
+
+        // Cells are stored in world space, so bake in the root transform the scene would normally be drawn with
+        std::expected<Node, std::string> rootNode = processNode(loadedScene->mRootNode);
+        if (!rootNode.has_value())
+            return std::unexpected(FW_UNEXP(rootNode, "Failed to load node tree"));
+        const glm::mat4 rootTransform = rootNode->transform;
+        const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(rootTransform)));
+
+        std::expected<std::vector<EmbeddedTexture>, std::string> embeddedTextures = processEmbeddedTextures(loadedScene, scenePath);
+        if (!embeddedTextures.has_value())
+            return std::unexpected(FW_UNEXP(embeddedTextures, "Failed to load embedded textures"));
+
+        WorldIndex index{cellSize, {}, {}, std::move(embeddedTextures.value())};
+        index.materials.reserve(loadedScene->mNumMaterials);
+        for (unsigned int i = 0; i < loadedScene->mNumMaterials; i++) {
+            std::expected<Material, std::string> material = processMaterial(loadedScene->mMaterials[i]);
+            if (!material.has_value())
+                return std::unexpected(FW_UNEXP(material, "Failed to load material "+std::to_string(i)+));
+            resolveEmbeddedTexturePath(loadedScene, scenePath, material->diffusePath);
+            resolveEmbeddedTexturePath(loadedScene, scenePath, material->specularPath);
+            index.materials.push_back(material.value());
+        }
+
+        // Ordered, so cells end up in the index in a stable order
+        std::map<std::pair<int, int>, CellBuilder> cells;
+        for (unsigned int meshIndex = 0; meshIndex < loadedScene->mNumMeshes; meshIndex++) {
+            const aiMesh *loadedMesh = loadedScene->mMeshes[meshIndex];
+            std::vector<MeshVertex> vertices = extractVertices(loadedMesh);
+            const std::vector<unsigned int> indices = extractIndices(loadedMesh);
+            for (MeshVertex &vertex : vertices) {
+                vertex.Position = glm::vec3(rootTransform * glm::vec4(vertex.Position, 1.0f));
+                vertex.Normal = normalMatrix * vertex.Normal;
+            }
+
+            // Maps this mesh's vertex indices to indices within each cell's merged mesh
+            std::map<std::pair<int, int>, std::unordered_map<unsigned int, unsigned int>> remaps;
+            for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+                const glm::vec3 centroid = (vertices[indices[i]].Position
+                    + vertices[indices[i + 1]].Position
+                    + vertices[indices[i + 2]].Position) / 3.0f;
+                const std::pair<int, int> cellKey = {
+                    static_cast<int>(std::floor(centroid.x / cellSize)),
+                    static_cast<int>(std::floor(centroid.z / cellSize))
+                };
+
+                CellBuilder &cell = cells[cellKey];
+                CellMeshData &cellMesh = cell.meshesByMaterial[loadedMesh->mMaterialIndex];
+                cellMesh.materialIndex = loadedMesh->mMaterialIndex;
+                auto &remap = remaps[cellKey];
+                for (size_t corner = 0; corner < 3; corner++) {
+                    const unsigned int sourceIndex = indices[i + corner];
+                    auto [it, inserted] = remap.try_emplace(sourceIndex, static_cast<unsigned int>(cellMesh.vertices.size()));
+                    if (inserted) {
+                        cellMesh.vertices.push_back(vertices[sourceIndex]);
+                        cell.bounds.extend(vertices[sourceIndex].Position);
+                    }
+                    cellMesh.indices.push_back(it->second);
+                }
+            }
+        }
+
+        // Clear out cells from previous partitions, which may have used a different grid
+        std::error_code removeError;
+        std::filesystem::remove_all(getCachePath(scenePath, ".cells"), removeError);
+
+        index.cells.reserve(cells.size());
+        for (const auto &[cellKey, cell] : cells) {
+            const auto &[x, z] = cellKey;
+            WorldCell worldCell{x, z, cell.bounds, 0, getCellPath(scenePath, x, z)};
+            for (const auto &[materialIndex, mesh] : cell.meshesByMaterial) {
+                const size_t indexSize = mesh.vertices.size() <= std::numeric_limits<unsigned short>::max()
+                    ? sizeof(unsigned short) : sizeof(unsigned int);
+                worldCell.gpuBytes += mesh.vertices.size() * sizeof(MeshVertex) + mesh.indices.size() * indexSize;
+            }
+
+            auto writeRet = writeCell(worldCell.path, cell);
+            if (!writeRet.has_value())
+                return std::unexpected(FW_UNEXP(writeRet, "Failed to write cell"));
+            index.cells.push_back(std::move(worldCell));
+        }
+
+        // Write the index last, so a partially written world is never considered fresh
+        auto writeRet = writeWorldIndex(getWorldIndexPath(scenePath), index);
+        if (!writeRet.has_value())
+            return std::unexpected(FW_UNEXP(writeRet, "Failed to write world index"));
+
+#ifndef NDEBUG
+        logDebug("Partitioned \"%s\" into %zu cells in %d ms", scenePath.c_str(), index.cells.size(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count());
+#else
+        logDebug("Partitioned \"%s\" into %zu cells", scenePath.c_str(), index.cells.size());
+#endif
+        return index;
+    }
+#pragma endregion
+
+
+#pragma region Loading
+    std::expected<WorldIndex, std::string> readWorldIndex(const std::string &indexPath) {
+        BinaryReader reader(indexPath);
+        if (reader.read<uint32_t>() != WORLD_INDEX_MAGIC || reader.read<uint32_t>() != WORLD_FORMAT_VERSION)
+            return UNEXPECTED_REF("Not a world index, or an outdated one: \"" + indexPath + "\"");
+
+        WorldIndex index{};
+        index.cellSize = reader.read<float>();
+
+        const auto materialCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < materialCount && reader.good(); i++) {
+            Material material;
+            material.diffusePath = reader.readString();
+            material.specularPath = reader.readString();
+            material.shininess = reader.read<float>();
+            index.materials.push_back(std::move(material));
+        }
+
+        const auto cellCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < cellCount && reader.good(); i++) {
+            WorldCell cell{};
+            cell.x = reader.read<int32_t>();
+            cell.z = reader.read<int32_t>();
+            cell.bounds = reader.read<Bounds>();
+            cell.gpuBytes = reader.read<uint64_t>();
+            cell.path = reader.readString();
+            index.cells.push_back(std::move(cell));
+        }
+
+        const auto textureCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < textureCount && reader.good(); i++) {
+            EmbeddedTexture texture;
+            texture.key = reader.readString();
+            texture.image.width = reader.read<int32_t>();
+            texture.image.height = reader.read<int32_t>();
+            texture.image.channelCount = reader.read<int32_t>();
+            if (!reader.good() || texture.image.width <= 0 || texture.image.height <= 0
+                || texture.image.channelCount <= 0 || texture.image.channelCount > 4
+                || texture.image.byteSize() > reader.remaining())
+                return UNEXPECTED_REF("World index has a corrupt embedded texture: \"" + indexPath + "\"");
+            // Images are freed by stb_image, which uses free
+            texture.image.pixels.reset(static_cast<unsigned char *>(std::malloc(texture.image.byteSize())));
+            if (texture.image.pixels == nullptr)
+                return UNEXPECTED_REF("Failed to allocate an embedded texture");
+            reader.readArray(texture.image.pixels.get(), texture.image.byteSize());
+            index.embeddedTextures.push_back(std::move(texture));
+        }
+
+        if (!reader.good())
+            return UNEXPECTED_REF("World index is truncated: \"" + indexPath + "\"");
+        return index;
+    }
+
+    std::expected<WorldIndex, std::string> loadWorldIndex(const std::string &scenePath, const float cellSize) {
+        const std::string indexPath = getWorldIndexPath(scenePath);
+        if (isCacheFresh(indexPath, scenePath)) {
+            std::expected<WorldIndex, std::string> index = readWorldIndex(indexPath);
+            if (index.has_value() && index->cellSize == cellSize)
+                return index;
+            if (!index.has_value())
+                logWarn("Discarding world cache" NL_INDENT "%s", index.error().c_str());
+        }
+
+        std::expected<WorldIndex, std::string> index = partitionScene(scenePath, cellSize);
+        if (!index.has_value())
+            return std::unexpected(FW_UNEXP(index, "Failed to partition world"));
+        return index;
+    }
+
+    std::expected<CellData, std::string> loadCell(const WorldCell &cell, const size_t materialCount) {
+        BinaryReader reader(cell.path);
+        if (reader.read<uint32_t>() != WORLD_CELL_MAGIC || reader.read<uint32_t>() != WORLD_FORMAT_VERSION)
+            return UNEXPECTED_REF("Not a world cell, or an outdated one: \"" + cell.path + "\"");
+
+        CellData cellData;
+        const auto meshCount = reader.read<uint32_t>();
+        // Every mesh takes at least its material index and two counts, so a corrupt count can't reserve more than the file could hold
+        cellData.meshes.reserve(std::min<size_t>(meshCount, reader.remaining() / (sizeof(uint32_t) + 2 * sizeof(uint64_t))));
+        for (uint32_t i = 0; i < meshCount && reader.good(); i++) {
+            CellMeshData mesh;
+            mesh.materialIndex = reader.read<uint32_t>();
+            mesh.vertices = reader.readVector<MeshVertex>();
+            mesh.indices = reader.readVector<unsigned int>();
+            if (!reader.good())
+                break;
+
+            // The mesh and the draw would read whatever lies past the vertices or materials
+            if (mesh.materialIndex >= materialCount)
+                return UNEXPECTED_REF("World cell refers to material " + std::to_string(mesh.materialIndex) + " of " + std::to_string(materialCount) + ": \"" + cell.path + "\"");
+            if (mesh.indices.size() % 3 != 0)
+                return UNEXPECTED_REF("World cell has a mesh with an incomplete triangle: \"" + cell.path + "\"");
+            if (std::ranges::any_of(mesh.indices, [&](const unsigned int index) { return index >= mesh.vertices.size(); }))
+                return UNEXPECTED_REF("World cell has a mesh with indices past its vertices: \"" + cell.path + "\"");
+            cellData.meshes.push_back(std::move(mesh));
+        }
+
+        if (!reader.good())
+            return UNEXPECTED_REF("World cell is truncated: \"" + cell.path + "\"");
+        return cellData;
+    }
+
+    Scene uploadCell(const CellData &cellData, const std::vector<Material> &materials) {
+        std::vector<Mesh> meshes;
+        meshes.reserve(cellData.meshes.size());
+        size_t releasedCpuBytes = 0;
+        for (const CellMeshData &mesh : cellData.meshes) {
+            meshes.emplace_back(mesh.vertices, mesh.indices, mesh.materialIndex, false);
+            releasedCpuBytes += mesh.vertices.size() * sizeof(MeshVertex) + mesh.indices.size() * sizeof(unsigned int);
+        }
+
+        // Cells are already in world space
+        Scene scene{Node{{}, glm::mat4(1.0f), {}}, std::move(meshes), materials};
+        scene.releasedCpuBytes = releasedCpuBytes;
+        return scene;
+    }
+#pragma endregion
+}
@@ -0,0 +1,75 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <expected>
+#include <string>
+#include <vector>
+
+#include "scene.h"
+
+namespace Engine::Loader {
+    /*!
+     * A single grid cell of a partitioned world, as listed in the world index.
+     */
+    struct WorldCell {
+        int x, z;
+        Bounds bounds;
+        // Estimated size of the cell's vertex and index buffers once uploaded
+        size_t gpuBytes;
+        std::string path;
+    };
+
+    /*!
+     * The index of a partitioned world: every cell, and the materials and embedded textures they share.
+     */
+    struct WorldIndex {
+        float cellSize;
+        std::vector<Material> materials;
+        std::vector<WorldCell> cells;
+        // Decoded once and handed over to whoever uploads them, after which this is empty (see `Scene::embeddedTextures`)
+        std::vector<EmbeddedTexture> embeddedTextures;
+    };
+
+    struct CellMeshData {
+        unsigned int materialIndex;
+        std::vector<MeshVertex> vertices;
+        std::vector<unsigned int> indices;
+    };
+
+    /*!
+     * The geometry of a single cell, loaded from disk but not yet uploaded.
+     */
+    struct CellData {
+        std::vector<CellMeshData> meshes;
+    };
+
+    /*!
+     * @brief Split a scene into a grid of cells on the XZ plane, and write them to the cache
+     * @param scenePath The scene to partition
+     * @param cellSize The width and depth of each cell
+     * @return The index of the partitioned world
+     * @note Triangles are assigned to the cell containing their centroid, so cell bounds may overlap slightly.
+     *  Meshes with the same material are merged within each cell. Embedded textures are decoded into the index.
+     */
+    std::expected<WorldIndex, std::string> partitionScene(const std::string &scenePath, float cellSize);
+    /*!
+     * @brief Load the index of a partitioned world, partitioning the scene first if the cache is missing or stale
+     * @param scenePath The source scene of the world
+     * @param cellSize The width and depth of each cell. If the cache was partitioned with a different size, it is rebuilt
+     */
+    std::expected<WorldIndex, std::string> loadWorldIndex(const std::string &scenePath, float cellSize);
+    /*!
+     * @brief Read the geometry of a cell from disk
+     * @param materialCount The number of materials in the world's index, which every mesh's material index must be below
+     * @return The cell's meshes, or an error message if the file is truncated or refers to vertices or materials that don't exist
+     * @note Doesn't touch OpenGL, so it is safe to call from worker threads
+     */
+    std::expected<CellData, std::string> loadCell(const WorldCell &cell, size_t materialCount);
+    /*!
+     * @brief Upload a loaded cell to the GPU as a scene
+     * @note Must be called on the thread owning the OpenGL context
+     */
+    Scene uploadCell(const CellData &cellData, const std::vector<Material> &materials);
+}
+
+#endif
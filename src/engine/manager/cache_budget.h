@@ -0,0 +1,30 @@
+#ifndef MANAGER_CACHE_BUDGET_H
+#define MANAGER_CACHE_BUDGET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace Engine::Manager {
+    struct MemoryUsage {
+        size_t cpuBytes = 0;
+        size_t gpuBytes = 0;
+    };
+
+    /*!
+     * Limits for an asset cache. Once a limit is exceeded, the least recently used assets are evicted,
+     * as long as they haven't been used for `minIdleFrames` frames.
+     */
+    struct CacheBudget {
+        size_t cpuBytes = std::numeric_limits<size_t>::max();
+        size_t gpuBytes = std::numeric_limits<size_t>::max();
+        // Assets used within this many frames are never evicted, even if we're over budget
+        uint64_t minIdleFrames = 300;
+
+        [[nodiscard]] bool exceededBy(const MemoryUsage &usage) const {
+            return usage.cpuBytes > cpuBytes || usage.gpuBytes > gpuBytes;
+        }
+    };
+}
+
+#endif
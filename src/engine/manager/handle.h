@@ -0,0 +1,148 @@
+#ifndef MANAGER_HANDLE_H
+#define MANAGER_HANDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Handles pack a slot index and the slot's generation into 32 bits
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_GENERATION_BITS (32 - HANDLE_INDEX_BITS)
+
+namespace Engine::Manager {
+    /*!
+     * A 32-bit reference to an asset in a manager, resolved once from its path so per-frame lookups are array indexing.
+     * The low bits index a slot, and the high bits count how many times that slot has been reused,
+     * so a handle to an unloaded asset is detected instead of silently pointing at whatever took its slot.
+     * @tparam Tag Distinguishes handles of different managers, so they can't be mixed up
+     * @note The default handle is null, and never refers to an asset
+     */
+    template<typename Tag>
+    class Handle {
+    private:
+        uint32_t value = 0;
+
+    public:
+        static constexpr uint32_t INDEX_MASK = (1u << HANDLE_INDEX_BITS) - 1;
+        static constexpr uint32_t GENERATION_MASK = (1u << HANDLE_GENERATION_BITS) - 1;
+
+        Handle() = default;
+        Handle(const uint32_t index, const uint32_t generation) : value((generation & GENERATION_MASK) << HANDLE_INDEX_BITS | (index & INDEX_MASK)) {}
+
+        [[nodiscard]] uint32_t index() const { return value & INDEX_MASK; }
+        [[nodiscard]] uint32_t generation() const { return value >> HANDLE_INDEX_BITS; }
+        [[nodiscard]] uint32_t raw() const { return value; }
+        [[nodiscard]] bool isNull() const { return value == 0; }
+        explicit operator bool() const { return value != 0; }
+
+        bool operator==(const Handle &) const = default;
+    };
+
+    /*!
+     * Storage for assets addressed by handles. Removed slots are reused, with a new generation
+     */
+    template<typename Tag, typename T>
+    class HandlePool {
+    private:
+        struct Slot {
+            T value;
+            uint32_t generation = 1;  // Starts at 1, so no live handle is ever null
+            bool used = false;
+        };
+        std::vector<Slot> slots;
+        std::vector<uint32_t> freeSlots;
+        size_t count_ = 0;
+
+    public:
+        /*!
+         * @return A handle to the new asset, or a null handle if every index is in use
+         */
+        Handle<Tag> insert(T value) {
+            uint32_t index;
+            if (!freeSlots.empty()) {
+                index = freeSlots.back();
+                freeSlots.pop_back();
+            } else {
+                if (slots.size() > Handle<Tag>::INDEX_MASK)
+                    return {};
+                index = static_cast<uint32_t>(slots.size());
+                slots.emplace_back();
+            }
+            Slot &slot = slots[index];
+            slot.value = std::move(value);
+            slot.used = true;
+            count_++;
+            return {index, slot.generation};
+        }
+
+        /*!
+         * @return The asset, or nullptr if the handle is null or stale
+         */
+        [[nodiscard]] T *get(const Handle<Tag> handle) {
+            if (handle.index() >= slots.size())
+                return nullptr;
+            Slot &slot = slots[handle.index()];
+            return slot.used && slot.generation == handle.generation() ? &slot.value : nullptr;
+        }
+        [[nodiscard]] const T *get(const Handle<Tag> handle) const {
+            return const_cast<HandlePool *>(this)->get(handle);
+        }
+
+        /*!
+         * @brief Free a slot, making every handle to it stale
+         * @return Whether the handle was live
+         */
+        bool remove(const Handle<Tag> handle) {
+            if (get(handle) == nullptr)
+                return false;
+            Slot &slot = slots[handle.index()];
+            slot.value = T();
+            slot.used = false;
+            // Skip generation 0, so the handle to index 0 with a wrapped generation isn't null
+            slot.generation = (slot.generation + 1) & Handle<Tag>::GENERATION_MASK;
+            if (slot.generation == 0)
+                slot.generation = 1;
+            freeSlots.push_back(handle.index());
+            count_--;
+            return true;
+        }
+
+        /*!
+         * @brief Free every slot, making every handle stale
+         */
+        void clear() {
+            for (uint32_t index = 0; index < slots.size(); index++)
+                if (slots[index].used)
+                    remove({index, slots[index].generation});
+        }
+
+        /*!
+         * @brief Call `function(handle, value)` for every live asset
+         */
+        template<typename F>
+        void forEach(F &&function) {
+            for (uint32_t index = 0; index < slots.size(); index++)
+                if (slots[index].used)
+                    function(Handle<Tag>(index, slots[index].generation), slots[index].value);
+        }
+        template<typename F>
+        void forEach(F &&function) const {
+            for (uint32_t index = 0; index < slots.size(); index++)
+                if (slots[index].used)
+                    function(Handle<Tag>(index, slots[index].generation), slots[index].value);
+        }
+
+        [[nodiscard]] size_t count() const { return count_; }
+    };
+}
+
+template<typename Tag>
+struct std::hash<Engine::Manager::Handle<Tag>> {
+    size_t operator()(const Engine::Manager::Handle<Tag> &handle) const noexcept {
+        return std::hash<uint32_t>{}(handle.raw());
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "engine/manager/light.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <gl/glew.h>
+#include <glm/common.hpp>
+
+#include <engine/render/immutable_storage.h>
+
+// The light count, padded to the alignment of the light array
+#define LIGHT_BUFFER_HEADER_BYTES 16
+
+
+namespace Engine::Manager {
+    float getLightRange(const LightData &light) {
+        constexpr float infinity = std::numeric_limits<float>::infinity();
+        if (light.type == LightType::DIRECTIONAL)
+            return infinity;
+
+        const glm::vec3 brightest = glm::max(light.ambient, glm::max(light.diffuse, light.specular));
+        const float brightness = std::max(brightest.x, std::max(brightest.y, brightest.z));
+        // Where brightness / (constant + linear * d + quadratic * d^2) = cutoff
+        const float c = light.constant - brightness / LIGHT_RANGE_CUTOFF;
+        if (c >= 0.0f)
+            return 0.0f;  // Never bright enough to see
+        if (light.quadratic > 0.0f)
+            return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+        if (light.linear > 0.0f)
+            return -c / light.linear;
+        return infinity;
+    }
+
+    LightManager::~LightManager() {
+        glDeleteBuffers(1, &SSBO);
+    }
+
+    void LightManager::markDirty(const size_t index) {
+        if (dirtyBegin == dirtyEnd) {
+            dirtyBegin = index;
+            dirtyEnd = index + 1;
+            return;
+        }
+        dirtyBegin = std::min(dirtyBegin, index);
+        dirtyEnd = std::max(dirtyEnd, index + 1);
+    }
+
+    LightHandle LightManager::addLight(const LightData &light) {
+        const auto index = static_cast<uint32_t>(lights.size());
+        const LightHandle handle = indices.insert(index);
+        if (handle.isNull())
+            return handle;
+        lights.push_back(light);
+        lights.back().range = getLightRange(light);
+        owners.push_back(handle);
+        markDirty(index);
+        countDirty = true;
+        return handle;
+    }
+
+    bool LightManager::removeLight(const LightHandle handle) {
+        const uint32_t *index = indices.get(handle);
+        if (index == nullptr)
+            return false;
+
+        // Keep the lights packed, so the shaders can loop up to the count
+        const uint32_t removed = *index;
+        const auto last = static_cast<uint32_t>(lights.size() - 1);
+        if (removed != last) {
+            lights[removed] = lights[last];
+            owners[removed] = owners[last];
+            *indices.get(owners[removed]) = removed;
+            markDirty(removed);
+        }
+        lights.pop_back();
+        owners.pop_back();
+        indices.remove(handle);
+        countDirty = true;
+        return true;
+    }
+
+    const LightData *LightManager::getLight(const LightHandle handle) const {
+        const uint32_t *index = indices.get(handle);
+        return index != nullptr ? &lights[*index] : nullptr;
+    }
+
+    bool LightManager::setLight(const LightHandle handle, const LightData &light) {
+        const uint32_t *index = indices.get(handle);
+        if (index == nullptr)
+            return false;
+        LightData updated = light;
+        updated.range = getLightRange(light);
+        if (std::memcmp(&lights[*index], &updated, sizeof(LightData)) != 0) {
+            lights[*index] = updated;
+            markDirty(*index);
+        }
+        return true;
+    }
+
+    bool LightManager::setTransform(const LightHandle handle, const glm::vec3 &position, const glm::vec3 &direction) {
+        const LightData *light = getLight(handle);
+        if (light == nullptr)
+            return false;
+        LightData moved = *light;
+        moved.position = position;
+        moved.direction = direction;
+        return setLight(handle, moved);
+    }
+
+    void LightManager::update() {
+        if (dirtyBegin == dirtyEnd && !countDirty)
+            return;
+
+        if (Render::growStorageBuffer(SSBO, gpuCapacity, lights.size(), sizeof(LightData), 16, LIGHT_BUFFER_HEADER_BYTES)) {
+            // The binding point outlives program switches, so it only changes with the buffer. Everything is uploaded to the new one
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, SSBO);
+            dirtyBegin = 0;
+            dirtyEnd = lights.size();
+            countDirty = true;
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO);
+        if (countDirty) {
+            const auto count = static_cast<uint32_t>(lights.size());
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(count), &count);
+            countDirty = false;
+        }
+        // Removing the last light leaves a range past the end, which the count already hides
+        dirtyEnd = std::min(dirtyEnd, lights.size());
+        if (dirtyBegin < dirtyEnd)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_HEADER_BYTES + dirtyBegin * sizeof(LightData),
+                (dirtyEnd - dirtyBegin) * sizeof(LightData), lights.data() + dirtyBegin);
+        dirtyBegin = dirtyEnd = 0;
+    }
+}
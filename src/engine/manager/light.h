@@ -0,0 +1,116 @@
+#ifndef MANAGER_LIGHT_H
+#define MANAGER_LIGHT_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include "handle.h"
+
+// Must match the binding in lights.glsl
+#define LIGHT_BUFFER_BINDING 3
+// Light past this fraction of its full brightness is too dim to show up in 8-bit colour, so it's culled
+#define LIGHT_RANGE_CUTOFF (1.0f / 256.0f)
+
+namespace Engine::Manager {
+    // Must match the LIGHT_* defines in lights.glsl
+    enum class LightType : uint32_t {
+        DIRECTIONAL,
+        POINT,
+        SPOT
+    };
+
+    /*!
+     * A light as laid out in the light SSBO (std430). Every type shares the same layout, and ignores what it doesn't use:
+     * directional lights have no position or attenuation, and only spot lights have a cone.
+     */
+    struct LightData {
+        glm::vec3 position{0.0f};
+        LightType type = LightType::POINT;
+        glm::vec3 direction{0.0f, -1.0f, 0.0f};
+        float cutOff = 1.0f;  // Cosine of the angle the spot light is full brightness within
+        glm::vec3 ambient{0.0f};
+        float outerCutOff = 1.0f;  // Cosine of the angle the spot light fades out at
+        glm::vec3 diffuse{0.0f};
+        float constant = 1.0f;
+        glm::vec3 specular{0.0f};
+        float linear = 0.0f;
+        float quadratic = 0.0f;
+        float range = 0.0f;  // Set by the light manager, see `getLightRange`
+        float padding[2]{};
+    };
+    static_assert(sizeof(LightData) == 96, "LightData must match the std430 layout in lights.glsl");
+
+    /*!
+     * @return How far a light reaches before it dims below LIGHT_RANGE_CUTOFF of its brightest colour,
+     *  or infinity for directional lights and lights that don't fade
+     */
+    float getLightRange(const LightData &light);
+
+    struct LightTag;
+    typedef Handle<LightTag> LightHandle;
+
+    /*!
+     * Keeps every light in a single shader storage buffer, bound once, behind a count the shaders loop up to.
+     * Lights are packed densely, and only the range of lights that changed since the last `update` is uploaded,
+     * so static lights cost nothing per frame.
+     */
+    class LightManager {
+    private:
+        // Where each light is in `lights`. Removing a light moves the last one into its place
+        HandlePool<LightTag, uint32_t> indices;
+        std::vector<LightData> lights;
+        std::vector<LightHandle> owners;  // The handle of each light in `lights`
+
+        unsigned int SSBO{};
+        size_t gpuCapacity = 0;  // In lights
+        size_t dirtyBegin = 0, dirtyEnd = 0;  // Range of lights to re-upload
+        bool countDirty = true;
+
+        void markDirty(size_t index);
+
+    public:
+        LightManager() = default;
+        ~LightManager();
+
+        /*!
+         * @return A handle to the new light, which stays valid until it is removed
+         */
+        LightHandle addLight(const LightData &light);
+        /*!
+         * @brief Remove a light, making its handle stale
+         * @return Whether the handle was valid
+         */
+        bool removeLight(LightHandle handle);
+        /*!
+         * @return The light, or nullptr if the handle is stale
+         */
+        [[nodiscard]] const LightData *getLight(LightHandle handle) const;
+        /*!
+         * @brief Replace a light. It is only uploaded again if something actually changed
+         * @return Whether the handle was valid
+         */
+        bool setLight(LightHandle handle, const LightData &light);
+        /*!
+         * @brief Move and turn a light, like `setLight`
+         */
+        bool setTransform(LightHandle handle, const glm::vec3 &position, const glm::vec3 &direction);
+
+        /*!
+         * @brief Upload the lights that changed, growing the buffer if needed
+         * @note Should be called once per frame, before drawing anything lit
+         */
+        void update();
+
+        [[nodiscard]] size_t count() const { return lights.size(); }
+        /*!
+         * @return The lights, in the order they are in the buffer
+         */
+        [[nodiscard]] const std::vector<LightData> &data() const { return lights; }
+
+        LightManager(const LightManager&) = delete;
+        LightManager& operator=(const LightManager&) = delete;
+    };
+}
+
+#endif
@@ -0,0 +1,521 @@
+#include "engine/manager/material.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <gl/glew.h>
+
+#include <engine/loader/shader/graphics_shader.h>
+#include <engine/loader/texture.h>
+#include <engine/logging.h>
+#include <engine/render/immutable_storage.h>
+
+
+
+namespace Engine::Manager {
+    int getTextureResolution(const unsigned int textureID) {
+        GLint width = 0, height = 0;
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        return std::max(width, height);
+    }
+
+    // Materials are deduplicated by their textures and shininess
+    std::string getMaterialKey(const Loader::Material &material) {
+        return material.diffusePath + '\n' + material.specularPath + '\n' + std::to_string(material.shininess);
+    }
+
+    // Specular textures are filtered differently, so they're kept apart from the same file used as a diffuse texture
+    std::string getTextureKey(const std::string &texturePath, const Loader::TextureUsage usage) {
+        return usage == Loader::TextureUsage::SPECULAR && !texturePath.empty() ? texturePath + "\nspecular" : texturePath;
+    }
+
+    MaterialManager::MaterialManager(TextureManager &textureManager) : textureManager(textureManager) {
+        GLint textureUnits = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &textureUnits);
+        maxArrays = static_cast<unsigned int>(std::clamp(textureUnits, 1, MAX_MATERIAL_TEXTURE_ARRAYS));
+        // Textures are copied between arrays while streaming, so don't let references into `arrays` move
+        arrays.reserve(maxArrays);
+
+        const std::optional<TextureLocation> error = addToArray(textureManager.errorTexture);
+        if (!error.has_value())
+            throw std::runtime_error("Failed to add the error texture to a texture array");
+        errorLocation = error.value();
+
+        // Textureless, so it always uses the error texture. This reference is never dropped
+        registerMaterial({"", "", 32.0f});
+        update();
+    }
+
+    MaterialManager::~MaterialManager() {
+        glDeleteBuffers(1, &SSBO);
+    }
+
+    bool MaterialManager::streaming() const {
+        return streamTextures && textureManager.compressTextures;
+    }
+
+    int MaterialManager::getInitialResolution() const {
+        return streaming() ? MIN_STREAMED_TEXTURE_RESOLUTION : 0;
+    }
+
+    unsigned int MaterialManager::registerMaterial(const Loader::Material &material) {
+        const std::string key = getMaterialKey(material);
+        if (const auto it = idsByKey.find(key); it != idsByKey.end()) {
+            materialReferences[it->second]++;
+            return it->second;
+        }
+
+        unsigned int id;
+        if (!freeIds.empty()) {
+            id = freeIds.back();
+            freeIds.pop_back();
+        } else {
+            id = static_cast<unsigned int>(materials.size());
+            materials.emplace_back();
+            materialTextures.emplace_back();
+            data.emplace_back();
+            wantedResolutions.push_back(0.0f);
+            materialReferences.push_back(0);
+        }
+        idsByKey.emplace(key, id);
+        materials[id] = material;
+        materials[id].id = id;
+        materialTextures[id] = {getTextureIndex(material.diffusePath, Loader::TextureUsage::DIFFUSE),
+            getTextureIndex(material.specularPath, Loader::TextureUsage::SPECULAR)};
+        data[id] = {errorLocation.array, errorLocation.layer, errorLocation.array, errorLocation.layer, material.shininess, {}};
+        wantedResolutions[id] = 0.0f;
+        materialReferences[id] = 1;
+        unresolved.push_back(id);
+        markDirty(id);
+        return id;
+    }
+
+    void MaterialManager::registerMaterials(std::vector<Loader::Material> &materials) {
+        for (Loader::Material &material : materials)
+            material.id = registerMaterial(material);
+    }
+
+    bool MaterialManager::unregisterMaterial(const unsigned int id) {
+        if (id >= materials.size() || materialReferences[id] == 0)
+            return false;
+        if (--materialReferences[id] > 0)
+            return true;
+
+        if (const auto it = idsByKey.find(getMaterialKey(materials[id])); it != idsByKey.end() && it->second == id)
+            idsByKey.erase(it);
+        releaseTexture(materialTextures[id].diffuse);
+        releaseTexture(materialTextures[id].specular);
+        std::erase(unresolved, id);
+        // Anything still drawn with it shows the error texture rather than freed layers
+        data[id] = {errorLocation.array, errorLocation.layer, errorLocation.array, errorLocation.layer, data[id].shininess, {}};
+        markDirty(id);
+        wantedResolutions[id] = 0.0f;
+        freeIds.push_back(id);
+        return true;
+    }
+
+    void MaterialManager::unregisterMaterials(const std::vector<Loader::Material> &materials) {
+        for (const Loader::Material &material : materials)
+            unregisterMaterial(material.id);
+    }
+
+    bool MaterialManager::setShininess(const unsigned int id, const float shininess) {
+        if (id >= materials.size() || materialReferences[id] == 0)
+            return false;
+        if (materials[id].shininess == shininess)
+            return true;
+
+        // Keep deduplicating by the material's new parameters, unless an identical material already exists
+        Loader::Material &material = materials[id];
+        if (const auto it = idsByKey.find(getMaterialKey(material)); it != idsByKey.end() && it->second == id)
+            idsByKey.erase(it);
+        material.shininess = shininess;
+        idsByKey.try_emplace(getMaterialKey(material), id);
+
+        data[id].shininess = shininess;
+        markDirty(id);
+        return true;
+    }
+
+    const Loader::Material *MaterialManager::get(const unsigned int id) const {
+        return id < materials.size() && materialReferences[id] > 0 ? &materials[id] : nullptr;
+    }
+
+    uint32_t MaterialManager::getTextureIndex(const std::string &texturePath, const Loader::TextureUsage usage) {
+        const auto [it, inserted] = textureIndices.try_emplace(getTextureKey(texturePath, usage), 0);
+        if (!inserted) {
+            textures[it->second].references++;
+            return it->second;
+        }
+
+        if (!freeTextures.empty()) {
+            it->second = freeTextures.back();
+            freeTextures.pop_back();
+        } else {
+            it->second = static_cast<uint32_t>(textures.size());
+            textures.emplace_back();
+        }
+        ResidentTexture &texture = textures[it->second];
+        texture = {};
+        texture.references = 1;
+        texture.path = texturePath;
+        texture.usage = usage;
+        texture.location = errorLocation;
+        if (texturePath.empty()) {
+            // Textureless materials use the error texture, and never stream
+            texture.resolved = true;
+            texture.complete = true;
+        } else
+            texture.handle = textureManager.preload(texturePath, TextureType::TEXTURE_2D, getInitialResolution(), usage);
+        return it->second;
+    }
+
+    void MaterialManager::releaseTexture(const uint32_t index) {
+        ResidentTexture &texture = textures[index];
+        if (--texture.references > 0)
+            return;
+
+        if (texture.location != errorLocation)
+            arrays[texture.location.array].removeLayer(texture.location.layer);
+        // Stops them loading, if they still are
+        if (texture.handle)
+            textureManager.unloadTexture(texture.handle);
+        if (texture.streamingHandle)
+            textureManager.unloadTexture(texture.streamingHandle);
+        textureIndices.erase(getTextureKey(texture.path, texture.usage));
+
+        // Looks like a texture that failed to load, so streaming skips it
+        texture = {};
+        texture.location = errorLocation;
+        texture.resolved = true;
+        texture.complete = true;
+        freeTextures.push_back(index);
+    }
+
+    std::optional<MaterialManager::TextureLocation> MaterialManager::resolveTexture(ResidentTexture &texture) {
+        if (texture.resolved)
+            return texture.location;
+
+        const std::expected<unsigned int, std::string> loaded = textureManager.getTexture(texture.handle);
+        if (loaded.has_value() && loaded.value() == textureManager.errorTexture && textureManager.isLoading(texture.handle))
+            return std::nullopt;
+
+        // Textures that failed to load are never streamed
+        texture.resolved = true;
+        texture.complete = true;
+        if (!loaded.has_value()) {
+            logError("Failed to load material texture \"%s\"" NL_INDENT "%s", texture.path.c_str(), loaded.error().c_str());
+        } else if (loaded.value() != textureManager.errorTexture) {
+            texture.embedded = textureManager.isEmbedded(texture.handle);
+            if (const std::optional<TextureLocation> location = addToArray(loaded.value()); location.has_value()) {
+                texture.resolution = getTextureResolution(loaded.value());
+                texture.location = location.value();
+                texture.complete = !streaming() || texture.embedded;
+                texture.lastNeededFrame = frame;
+            }
+            // The array has its own copy now
+            textureManager.unloadTexture(texture.handle);
+            texture.handle = {};
+        }
+        return texture.location;
+    }
+
+    std::optional<uint32_t> MaterialManager::findArray(const int width, const int height, const int levels, const unsigned int internalFormat, const size_t layerBytes) {
+        const auto match = std::ranges::find_if(arrays, [&](const TextureArray &array) {
+            return array.matches(width, height, levels, internalFormat);
+        });
+        if (match != arrays.end())
+            return static_cast<uint32_t>(match - arrays.begin());
+
+        // Arrays whose layers were all removed hold no memory, and can be reused for any format
+        const auto empty = std::ranges::find_if(arrays, [](const TextureArray &array) { return array.count() == 0; });
+        if (empty != arrays.end()) {
+            *empty = TextureArray(width, height, levels, internalFormat, layerBytes);
+            return static_cast<uint32_t>(empty - arrays.begin());
+        }
+
+        if (arrays.size() >= maxArrays) {
+            logWarn("Out of material texture arrays, can't add a %dx%d texture with format 0x%X", width, height, internalFormat);
+            return std::nullopt;
+        }
+        arrays.emplace_back(width, height, levels, internalFormat, layerBytes);
+        return static_cast<uint32_t>(arrays.size() - 1);
+    }
+
+    std::optional<MaterialManager::TextureLocation> MaterialManager::addToArray(const unsigned int textureID) {
+        GLint width = 0, height = 0, internalFormat = 0, levels = 0;
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+        if (levels == 0) {
+            logWarn("Texture %u doesn't have immutable storage, so it can't be added to a texture array", textureID);
+            return std::nullopt;
+        }
+
+        const std::optional<uint32_t> array = findArray(width, height, levels, static_cast<unsigned int>(internalFormat),
+            Loader::estimateTextureBytes(textureID, GL_TEXTURE_2D));
+        if (!array.has_value())
+            return std::nullopt;
+        return TextureLocation{array.value(), arrays[array.value()].addLayer(textureID, GL_TEXTURE_2D)};
+    }
+
+    void MaterialManager::markDirty(const unsigned int id) {
+        if (dirtyBegin == dirtyEnd) {
+            dirtyBegin = id;
+            dirtyEnd = id + 1;
+            return;
+        }
+        dirtyBegin = std::min<size_t>(dirtyBegin, id);
+        dirtyEnd = std::max<size_t>(dirtyEnd, id + 1);
+    }
+
+    void MaterialManager::requestResolution(const unsigned int materialId, const float resolution) {
+        if (materialId >= wantedResolutions.size() || materialReferences[materialId] == 0)
+            return;
+        // Don't let meshes right against the camera ask for more than any texture could have
+        wantedResolutions[materialId] = std::max(wantedResolutions[materialId], std::min(resolution, 65536.0f));
+    }
+
+    void MaterialManager::requestDetail(const Loader::Scene &scene, const glm::mat4 &transform, const glm::vec3 &cameraPosition, const float pixelScale) {
+        // Closer than this, the texel density estimate stops being meaningful (and the full texture is needed anyway)
+        constexpr float MIN_DETAIL_DISTANCE = 1.0f;
+
+        // Scaling a mesh up spreads its texture coordinates over more of the world
+        const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+        for (const Loader::Mesh &mesh : scene.meshes) {
+            if (mesh.uvDensity <= 0.0f || mesh.materialIndex >= scene.materials.size())
+                continue;
+            const float distance = std::max(mesh.bounds.transformed(transform).distanceTo(cameraPosition), MIN_DETAIL_DISTANCE);
+            // Pixels per world unit, over texture coordinate units per world unit, is the texels needed per texture coordinate unit
+            requestResolution(scene.materials[mesh.materialIndex].id, pixelScale * scale / (distance * mesh.uvDensity));
+        }
+    }
+
+    void MaterialManager::moveTexture(const uint32_t index, const TextureLocation location, const int resolution) {
+        ResidentTexture &texture = textures[index];
+        if (texture.location != errorLocation)
+            arrays[texture.location.array].removeLayer(texture.location.layer);
+        texture.location = location;
+        texture.resolution = resolution;
+
+        for (unsigned int id = 0; id < materials.size(); id++) {
+            if (materialReferences[id] == 0)
+                continue;  // Its texture indices may have been reused
+            if (materialTextures[id].diffuse == index) {
+                data[id].diffuseArray = location.array;
+                data[id].diffuseLayer = location.layer;
+                markDirty(id);
+            }
+            if (materialTextures[id].specular == index) {
+                data[id].specularArray = location.array;
+                data[id].specularLayer = location.layer;
+                markDirty(id);
+            }
+        }
+    }
+
+    void MaterialManager::finishStreaming(const uint32_t index) {
+        ResidentTexture &texture = textures[index];
+        const std::expected<unsigned int, std::string> loaded = textureManager.getTexture(texture.streamingHandle);
+        if (loaded.has_value() && loaded.value() == textureManager.errorTexture && textureManager.isLoading(texture.streamingHandle))
+            return;
+        texture.loadingResolution = 0;
+
+        if (!loaded.has_value() || loaded.value() == textureManager.errorTexture) {
+            texture.complete = true;  // The low mips will have to do
+            logWarn("Failed to stream texture \"%s\", keeping it at %d" NL_INDENT "%s", texture.path.c_str(), texture.resolution,
+                loaded.has_value() ? "Loaded as the error texture" : loaded.error().c_str());
+        } else if (const int resolution = getTextureResolution(loaded.value()); resolution <= texture.resolution) {
+            texture.complete = true;  // Asked for more, but the top level was already resident
+        } else if (const std::optional<TextureLocation> location = addToArray(loaded.value()); location.has_value()) {
+            logDebug("Streamed texture \"%s\" up to %d", texture.path.c_str(), resolution);
+            moveTexture(index, location.value(), resolution);
+        } else {
+            texture.complete = true;  // No room for it, so stop asking
+            logWarn("Gave up streaming texture \"%s\" up to %d, keeping it at %d", texture.path.c_str(), resolution, texture.resolution);
+        }
+        textureManager.unloadTexture(texture.streamingHandle);
+        texture.streamingHandle = {};
+    }
+
+    void MaterialManager::downgradeTexture(const uint32_t index) {
+        ResidentTexture &texture = textures[index];
+        const TextureArray &source = arrays[texture.location.array];
+        const int wanted = std::max(static_cast<int>(std::ceil(texture.wantedResolution)), MIN_STREAMED_TEXTURE_RESOLUTION);
+
+        // Keep the smallest level that still has the wanted detail
+        int level = 0;
+        while (level + 1 < source.getLevels()
+            && std::max(source.getWidth() >> (level + 1), source.getHeight() >> (level + 1)) >= wanted)
+            level++;
+        if (level == 0) {
+            texture.lastNeededFrame = frame;  // Can't drop a level without going under the wanted detail
+            return;
+        }
+
+        const int width = std::max(source.getWidth() >> level, 1), height = std::max(source.getHeight() >> level, 1);
+        // Every level is a quarter of the one above, so this is a close enough estimate
+        const std::optional<uint32_t> array = findArray(width, height, source.getLevels() - level, source.getInternalFormat(),
+            std::max<size_t>(source.getLayerBytes() >> (2 * level), 1));
+        if (!array.has_value()) {
+            texture.lastNeededFrame = frame;
+            return;
+        }
+
+        const unsigned int layer = arrays[array.value()].addLayer(source.id(), GL_TEXTURE_2D_ARRAY, texture.location.layer, level);
+        logDebug("Dropped texture \"%s\" down to %d", texture.path.c_str(), std::max(width, height));
+        moveTexture(index, {array.value(), layer}, std::max(width, height));
+        texture.complete = false;
+        texture.lastNeededFrame = frame;
+    }
+
+    bool MaterialManager::fitBudget() {
+        size_t bytes = residentBytes();
+        if (bytes <= gpuBudgetBytes)
+            return true;
+
+        std::vector<uint32_t> overDetailed;
+        for (uint32_t index = 0; index < textures.size(); index++) {
+            const ResidentTexture &texture = textures[index];
+            if (texture.location != errorLocation && texture.loadingResolution == 0 && !texture.embedded
+                && texture.wantedResolution * 2.0f <= static_cast<float>(texture.resolution))
+                overDetailed.push_back(index);
+        }
+        std::ranges::sort(overDetailed, {}, [this](const uint32_t index) { return textures[index].lastNeededFrame; });
+        for (const uint32_t index : overDetailed) {
+            if (bytes <= gpuBudgetBytes)
+                return true;
+            bytes -= arrays[textures[index].location.array].getLayerBytes();
+            downgradeTexture(index);
+            bytes += arrays[textures[index].location.array].getLayerBytes();
+        }
+        return bytes <= gpuBudgetBytes;
+    }
+
+    void MaterialManager::updateStreaming() {
+        // Each texture is wanted at the highest resolution of any material using it
+        for (unsigned int id = 0; id < wantedResolutions.size(); id++) {
+            if (wantedResolutions[id] <= 0.0f)
+                continue;
+            for (const uint32_t index : {materialTextures[id].diffuse, materialTextures[id].specular})
+                textures[index].wantedResolution = std::max(textures[index].wantedResolution, wantedResolutions[id]);
+            wantedResolutions[id] = 0.0f;
+        }
+
+        unsigned int loading = 0;
+        std::vector<std::pair<float, uint32_t>> candidates;
+        for (uint32_t index = 0; index < textures.size(); index++) {
+            ResidentTexture &texture = textures[index];
+            if (texture.location == errorLocation)
+                continue;
+
+            if (texture.loadingResolution > 0)
+                finishStreaming(index);
+            if (texture.loadingResolution > 0)
+                loading++;
+            else if (!texture.complete && texture.wantedResolution > static_cast<float>(texture.resolution))
+                candidates.emplace_back(texture.wantedResolution / static_cast<float>(texture.resolution), index);
+
+            // Half the resolution would lose detail that's on screen, so the resident mips are still needed
+            if (texture.wantedResolution * 2.0f > static_cast<float>(texture.resolution))
+                texture.lastNeededFrame = frame;
+            else if (frame - texture.lastNeededFrame >= STREAMED_TEXTURE_DOWNGRADE_FRAMES && texture.loadingResolution == 0 && !texture.embedded)
+                downgradeTexture(index);
+        }
+
+        // Detail that's on screen is only streamed in while there's room for it
+        if (!fitBudget())
+            candidates.clear();
+
+        // The textures missing the most detail go first
+        std::ranges::sort(candidates, std::greater{}, [](const auto &candidate) { return candidate.first; });
+        for (const auto &[missing, index] : candidates) {
+            if (loading >= maxStreamingLoads)
+                break;
+            ResidentTexture &texture = textures[index];
+            // Always ask for at least the next level, otherwise a texture just under a power of two would get its own resolution back
+            texture.loadingResolution = std::max(texture.resolution * 2, static_cast<int>(std::ceil(texture.wantedResolution)));
+            texture.streamingHandle = textureManager.preload(texture.path, TextureType::TEXTURE_2D, texture.loadingResolution, texture.usage);
+            loading++;
+        }
+
+        for (ResidentTexture &texture : textures)
+            texture.wantedResolution = 0.0f;
+    }
+
+    void MaterialManager::update() {
+        frame++;
+        for (auto it = unresolved.begin(); it != unresolved.end();) {
+            const std::optional<TextureLocation> diffuse = resolveTexture(textures[materialTextures[*it].diffuse]);
+            const std::optional<TextureLocation> specular = resolveTexture(textures[materialTextures[*it].specular]);
+
+            MaterialData materialData = data[*it];
+            if (diffuse.has_value()) {
+                materialData.diffuseArray = diffuse->array;
+                materialData.diffuseLayer = diffuse->layer;
+            }
+            if (specular.has_value()) {
+                materialData.specularArray = specular->array;
+                materialData.specularLayer = specular->layer;
+            }
+            if (std::memcmp(&materialData, &data[*it], sizeof(MaterialData)) != 0) {
+                data[*it] = materialData;
+                markDirty(*it);
+            }
+
+            if (diffuse.has_value() && specular.has_value())
+                it = unresolved.erase(it);
+            else
+                ++it;
+        }
+
+        if (streaming())
+            updateStreaming();
+
+        if (dirtyBegin == dirtyEnd)
+            return;
+
+        if (Render::growStorageBuffer(SSBO, gpuCapacity, data.size(), sizeof(MaterialData), 64)) {
+            // Upload everything to the new buffer
+            dirtyBegin = 0;
+            dirtyEnd = data.size();
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyBegin * sizeof(MaterialData),
+            (dirtyEnd - dirtyBegin) * sizeof(MaterialData), data.data() + dirtyBegin);
+        dirtyBegin = dirtyEnd = 0;
+    }
+
+    void MaterialManager::bind(const GraphicsShader &shader) const {
+        shader.use();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, SSBO);
+        // The samplers already point at these units, from their binding in frag.frag
+        for (unsigned int i = 0; i < arrays.size(); i++)
+            arrays[i].bind(i);
+    }
+
+    size_t MaterialManager::streamingCount() const {
+        return std::ranges::count_if(textures, [](const ResidentTexture &texture) { return texture.loadingResolution > 0; });
+    }
+
+    size_t MaterialManager::residentBytes() const {
+        size_t bytes = 0;
+        for (const ResidentTexture &texture : textures)
+            if (texture.location != errorLocation)
+                bytes += arrays[texture.location.array].getLayerBytes();
+        return bytes;
+    }
+
+    size_t MaterialManager::gpuBytes() const {
+        size_t bytes = 0;
+        for (const TextureArray &array : arrays)
+            bytes += array.gpuBytes();
+        return bytes;
+    }
+}
@@ -0,0 +1,260 @@
+#ifndef MANAGER_MATERIAL_H
+#define MANAGER_MATERIAL_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <engine/loader/scene.h>
+#include <engine/render/texture_array.h>
+
+#include "texture.h"
+
+// Must match the binding in frag.frag
+#define MATERIAL_BUFFER_BINDING 2
+// Material textures use texture units from 0 up to the fragment stage's limit, but never more than this.
+// The count actually used is passed to frag.frag as MATERIAL_TEXTURE_ARRAYS (see `MaterialManager::maxArrayCount`)
+#define MAX_MATERIAL_TEXTURE_ARRAYS 32
+// Materials that were never registered draw with the error texture
+#define ERROR_MATERIAL_ID 0
+// Streamed textures first become resident at this resolution (or the next mip level below it), then load larger mips as they're needed
+#define MIN_STREAMED_TEXTURE_RESOLUTION 64
+// How long a texture must have more detail than needed before it drops back to fewer mips, so it doesn't thrash
+#define STREAMED_TEXTURE_DOWNGRADE_FRAMES 300
+
+namespace Engine {
+    class GraphicsShader;
+}
+
+namespace Engine::Manager {
+    /*!
+     * A material as laid out in the material SSBO (std430).
+     * Textures are referenced by the index of their texture array, and their layer within it.
+     */
+    struct MaterialData {
+        uint32_t diffuseArray;
+        uint32_t diffuseLayer;
+        uint32_t specularArray;
+        uint32_t specularLayer;
+        float shininess;
+        float padding[3];
+    };
+    static_assert(sizeof(MaterialData) == 32, "MaterialData must match the std430 layout in frag.frag");
+
+    /*!
+     * Turns materials into data: every registered material gets an index into a shader storage buffer,
+     * and its textures are copied into texture arrays shared by all textures of the same size and format.
+     * Once bound, drawing a mesh with any material only takes passing its material index as the draw's base instance.
+     */
+    class MaterialManager {
+    private:
+        struct TextureLocation {
+            uint32_t array;
+            uint32_t layer;
+
+            bool operator==(const TextureLocation &) const = default;
+        };
+        /*!
+         * A texture copied into the arrays. Streamed textures only have their mip levels up to `resolution` resident,
+         * stored as a smaller texture in an array of that size.
+         */
+        struct ResidentTexture {
+            std::string path;
+            Loader::TextureUsage usage = Loader::TextureUsage::DIFFUSE;
+            TextureHandle handle;  // The texture at its initial resolution, until it's copied into an array
+            TextureHandle streamingHandle;  // The larger mips being streamed in, if any
+            bool resolved = false;  // Whether it's in an array (or failed to load)
+            TextureLocation location;
+            int resolution = 0;  // The larger dimension of the resident top level
+            bool complete = false;  // Whether the top level is the full resolution texture
+            bool embedded = false;  // Embedded in a scene, so there are no other resolutions to stream
+            int loadingResolution = 0;  // The resolution being streamed in, or 0
+            float wantedResolution = 0.0f;  // The largest resolution requested since the last update
+            uint64_t lastNeededFrame = 0;  // The last update the resident resolution was actually needed
+            uint32_t references = 0;  // Registered materials using it. Its slot is free once this drops to 0
+        };
+        // Indices of a material's textures in `textures`
+        struct MaterialTextures {
+            uint32_t diffuse;
+            uint32_t specular;
+        };
+
+        TextureManager &textureManager;
+
+        std::vector<Loader::Material> materials;
+        std::vector<MaterialTextures> materialTextures;
+        std::vector<MaterialData> data;
+        // How many times each material was registered and not unregistered yet. Its id is free once this drops to 0
+        std::vector<uint32_t> materialReferences;
+        std::vector<unsigned int> freeIds;
+        // Materials are deduplicated by their textures and shininess
+        std::unordered_map<std::string, unsigned int> idsByKey;
+        // Materials with textures that aren't in an array yet. They use the error texture until they are
+        std::vector<unsigned int> unresolved;
+
+        std::vector<TextureArray> arrays;
+        unsigned int maxArrays;  // One per texture unit
+        std::vector<ResidentTexture> textures;
+        std::vector<uint32_t> freeTextures;  // Slots of `textures` to reuse
+        // Only used when registering and unregistering materials, so paths are hashed once per texture. Specular textures are keyed separately, since they're filtered differently
+        std::unordered_map<std::string, uint32_t> textureIndices;
+        TextureLocation errorLocation{};
+        // Per material, the largest resolution requested since the last update
+        std::vector<float> wantedResolutions;
+        uint64_t frame = 0;
+
+        unsigned int SSBO{};
+        size_t gpuCapacity = 0;  // In materials
+        size_t dirtyBegin = 0, dirtyEnd = 0;  // Range of materials to re-upload
+
+        /*!
+         * @return The index of a texture in `textures`, adding it and starting to load it if it's new
+         */
+        uint32_t getTextureIndex(const std::string &texturePath, Loader::TextureUsage usage);
+        /*!
+         * @brief Drop a material's reference to a texture, freeing its layer once no material uses it
+         */
+        void releaseTexture(uint32_t index);
+        /*!
+         * @return Where a texture lives in the arrays, or nothing if it is still loading
+         */
+        std::optional<TextureLocation> resolveTexture(ResidentTexture &texture);
+        /*!
+         * @return The index of an array holding textures with these properties, creating one if needed
+         */
+        std::optional<uint32_t> findArray(int width, int height, int levels, unsigned int internalFormat, size_t layerBytes);
+        std::optional<TextureLocation> addToArray(unsigned int textureID);
+        void markDirty(unsigned int id);
+
+        [[nodiscard]] bool streaming() const;
+        /*!
+         * @return The resolution textures are first loaded at
+         */
+        [[nodiscard]] int getInitialResolution() const;
+        /*!
+         * @brief Start streaming in the textures that need more detail, and drop detail from the ones that have been over-detailed for a while
+         */
+        void updateStreaming();
+        /*!
+         * @brief Copy a texture into its array once its larger mips are loaded
+         */
+        void finishStreaming(uint32_t index);
+        /*!
+         * @brief Copy the mips a texture still needs into a smaller array, freeing its larger mips
+         */
+        void downgradeTexture(uint32_t index);
+        /*!
+         * @brief Point a texture, and every material using it, at a new location, freeing the old one
+         */
+        void moveTexture(uint32_t index, TextureLocation location, int resolution);
+        /*!
+         * @brief Drop the detail nothing on screen needs, least recently needed first, until the resident textures fit the budget
+         * @return Whether they fit
+         */
+        bool fitBudget();
+
+    public:
+        // Whether textures start with only their low mips, and stream in larger ones as they're needed (see `requestDetail`).
+        // Requires `TextureManager::compressTextures`, since the mip chains come from the texture cache
+        bool streamTextures = true;
+        // Maximum number of textures streaming in larger mips at once
+        unsigned int maxStreamingLoads = 4;
+        // Over this many bytes of resident textures (see `residentBytes`), detail that isn't on screen is dropped right away,
+        // and no more is streamed in. Textures that aren't streamed can only be freed by unregistering their materials
+        size_t gpuBudgetBytes = SIZE_MAX;
+
+        explicit MaterialManager(TextureManager &textureManager);
+        ~MaterialManager();
+
+        /*!
+         * @brief Register a material, starting to load its textures
+         * @return The material's index in the material buffer. Registering an identical material returns the same index,
+         *  and takes another reference to it
+         */
+        unsigned int registerMaterial(const Loader::Material &material);
+        /*!
+         * @brief Register every material in a list, storing their indices in `Material::id`
+         */
+        void registerMaterials(std::vector<Loader::Material> &materials);
+        /*!
+         * @brief Drop a reference taken by `registerMaterial`. Once the last one is dropped, the material's index is reused
+         *  and textures no other material uses are freed
+         * @return Whether the material was registered
+         * @note Nothing should be drawn with the material after its last reference is dropped. Until its index is reused, it draws with the error texture
+         */
+        bool unregisterMaterial(unsigned int id);
+        /*!
+         * @brief Unregister every material in a list registered with `registerMaterials`
+         */
+        void unregisterMaterials(const std::vector<Loader::Material> &materials);
+
+        /*!
+         * @brief Change a registered material's shininess, which only re-uploads that material on the next `update`
+         * @return Whether the material exists
+         * @note Identical materials share an index, so this changes every user of the material
+         */
+        bool setShininess(unsigned int id, float shininess);
+        /*!
+         * @return A registered material, or null if no material has this id
+         */
+        [[nodiscard]] const Loader::Material *get(unsigned int id) const;
+
+        /*!
+         * @brief Request enough texture detail for a material to get a texel per pixel
+         * @param resolution The texture resolution needed, in texels per texture coordinate unit
+         * @note Requests are gathered until the next `update`, where each texture streams towards the highest one
+         */
+        void requestResolution(unsigned int materialId, float resolution);
+        /*!
+         * @brief Request the texture detail needed to draw a scene, from the on-screen texel density of each of its meshes
+         * @param transform The transform the scene is drawn with. Node transforms below it are ignored
+         * @param pixelScale Pixels covered by one world unit at a distance of one, i.e. viewport height / (2 * tan(fov / 2))
+         */
+        void requestDetail(const Loader::Scene &scene, const glm::mat4 &transform, const glm::vec3 &cameraPosition, float pixelScale);
+
+        /*!
+         * @brief Copy newly loaded textures into their arrays, stream texture detail, and upload changed materials
+         * @note Should be called once per frame, after `TextureManager::beginFrame`
+         */
+        void update();
+        /*!
+         * @brief Use the shader and bind the material buffer and texture arrays, each array to the texture unit of its index
+         * @note Draws with this shader then only need to pass the material index as their base instance (see `Mesh::draw`)
+         */
+        void bind(const GraphicsShader &shader) const;
+
+        /*!
+         * @return The number of registered materials
+         */
+        [[nodiscard]] size_t count() const { return materials.size() - freeIds.size(); }
+        /*!
+         * @return One past the highest material index in use
+         */
+        [[nodiscard]] size_t idCount() const { return materials.size(); }
+        [[nodiscard]] size_t arrayCount() const { return arrays.size(); }
+        /*!
+         * @return How many texture arrays the material textures can be spread over. Shaders bound with `bind` must declare this many samplers
+         */
+        [[nodiscard]] unsigned int maxArrayCount() const { return maxArrays; }
+        [[nodiscard]] size_t unresolvedCount() const { return unresolved.size(); }
+        [[nodiscard]] size_t streamingCount() const;
+        /*!
+         * @return The size of the texture arrays
+         */
+        [[nodiscard]] size_t gpuBytes() const;
+        /*!
+         * @return The size of the array layers holding registered materials' textures, which is what `gpuBudgetBytes` limits.
+         *  Arrays grow geometrically and only free their memory once empty, so `gpuBytes` can be larger
+         */
+        [[nodiscard]] size_t residentBytes() const;
+
+        MaterialManager(const MaterialManager&) = delete;
+        MaterialManager& operator=(const MaterialManager&) = delete;
+    };
+}
+
+#endif
@@ -1,38 +1,231 @@
 #include "engine/manager/scene.h"
 
+#include <algorithm>
+#include <vector>
 #include <engine/logging.h>
 
 
 namespace Engine::Manager {
-    SceneManager::SceneManager()
+    SceneManager::SceneManager(MaterialManager &materialManager, TextureManager &textureManager)
     // This is so cursed...
-    : errorScene([] {
+    : materialManager(materialManager), textureManager(textureManager), errorScene([] {
         std::expected<Loader::Scene, std::string> errorScn = Loader::loadScene(ERROR_MESH_PATH);
         if (!errorScn.has_value())
             throw std::runtime_error(FW_UNEXP(errorScn, "Failed to load error model"));
         return std::make_shared<Loader::Scene>(std::move(errorScn.value()));
-    }()) {}
+    }()) {
+        // The error scene is never unloaded, so neither are its embedded textures
+        std::vector<TextureHandle> embeddedTextures;
+        registerResources(*errorScene, embeddedTextures);
+    }
+
+    void SceneManager::registerResources(Loader::Scene &scene, std::vector<TextureHandle> &embeddedTextures) {
+        for (Loader::EmbeddedTexture &texture : scene.embeddedTextures)
+            embeddedTextures.push_back(textureManager.addTexture(texture.key, std::move(texture.image)));
+        scene.embeddedTextures.clear();
+        materialManager.registerMaterials(scene.materials);
+    }
 
-    std::expected<SharedScene, std::string> SceneManager::getScene(const std::string &scenePath) {
-        if (scenes.contains(scenePath))
-            return scenes[scenePath];
+    SceneHandle SceneManager::getHandle(const std::string &scenePath, const bool keepGeometry) {
+        const auto [it, inserted] = handles.try_emplace(scenePath);
+        if (inserted)
+            it->second = scenes.insert({scenePath, keepGeometry});
+        else if (keepGeometry)
+            scenes.get(it->second)->keepGeometry = true;
+        return it->second;
+    }
+
+    std::expected<SharedScene, std::string> SceneManager::getScene(const SceneHandle handle) {
+        CachedScene *cached = scenes.get(handle);
+        if (cached == nullptr)
+            return UNEXPECTED_REF("Stale scene handle");
+
+        cached->lastUsedFrame = frame;
+        if (cached->scene != nullptr) {
+            if (!cached->keepGeometry || cached->scene == errorScene || cached->scene->hasGeometry())
+                return cached->scene;
+            logDebug("Reloading scene \"%s\" to keep its geometry", cached->path.c_str());
+            release(*cached);
+        }
 
-        std::expected<Loader::Scene, std::string> scene = Loader::loadScene(scenePath);
+        std::expected<Loader::Scene, std::string> scene = Loader::loadScene(cached->path, {.keepGeometry = cached->keepGeometry});
         if (!scene.has_value()) {
-            scenes[scenePath] = errorScene;  // Only error once, then use the error model
+            insert(*cached, errorScene);  // Only error once, then use the error model
             return std::unexpected(FW_UNEXP(scene, "Failed to load uncached model"));
         }
-        return scenes[scenePath] = std::make_shared<Loader::Scene>(std::move(scene.value()));
+        const auto shared = std::make_shared<Loader::Scene>(std::move(scene.value()));
+        registerResources(*shared, cached->embeddedTextures);
+        insert(*cached, shared);
+        return shared;
     }
 
-    bool SceneManager::unloadScene(const std::string &scenePath) {
-        if (!scenes.contains(scenePath))
+    std::expected<SharedScene, std::string> SceneManager::getScene(const std::string &scenePath, const bool keepGeometry) {
+        return getScene(getHandle(scenePath, keepGeometry));
+    }
+
+    void SceneManager::insert(CachedScene &cached, const SharedScene &scene) {
+        MemoryUsage sceneUsage;
+        if (scene != errorScene)  // The error scene is always loaded, so it doesn't count towards the budget
+            sceneUsage = {scene->geometryBytes(), scene->gpuBytes()};
+        usage_.cpuBytes += sceneUsage.cpuBytes;
+        usage_.gpuBytes += sceneUsage.gpuBytes;
+        cached.scene = scene;
+        cached.usage = sceneUsage;
+        cached.lastUsedFrame = frame;
+    }
+
+    void SceneManager::release(CachedScene &cached) {
+        usage_.cpuBytes -= cached.usage.cpuBytes;
+        usage_.gpuBytes -= cached.usage.gpuBytes;
+        // The error scene's materials are registered once, by the constructor
+        if (cached.scene != nullptr && cached.scene != errorScene) {
+            if (cached.scene.use_count() == 1)
+                materialManager.unregisterMaterials(cached.scene->materials);
+            else
+                retired.push_back(cached.scene);  // Still drawn, by instances or whoever else holds it
+        }
+        cached.scene = nullptr;
+        cached.usage = {};
+        // Materials copy their textures into arrays, so anything still using them keeps working
+        for (const TextureHandle texture : cached.embeddedTextures)
+            textureManager.unloadTexture(texture);
+        cached.embeddedTextures.clear();
+    }
+
+    bool SceneManager::unloadScene(const SceneHandle handle) {
+        CachedScene *cached = scenes.get(handle);
+        if (cached == nullptr)
             return false;
-        scenes.erase(scenePath);
+        release(*cached);
+        handles.erase(cached->path);
+        scenes.remove(handle);
         return true;
     }
 
+    bool SceneManager::unloadScene(const std::string &scenePath) {
+        const auto it = handles.find(scenePath);
+        return it != handles.end() && unloadScene(it->second);
+    }
+
     void SceneManager::clear() {
+        scenes.forEach([this](SceneHandle, CachedScene &cached) { release(cached); });
         scenes.clear();
+        handles.clear();
+        instances.clear();
+        usage_ = {};
+    }
+
+    void SceneManager::releaseRetired() {
+        std::erase_if(retired, [this](const SharedScene &scene) {
+            if (scene.use_count() > 1)
+                return false;
+            materialManager.unregisterMaterials(scene->materials);
+            return true;
+        });
+    }
+
+    void SceneManager::beginFrame() {
+        frame++;
+        releaseRetired();
+        if (budget.exceededBy(usage_))
+            evict();
+    }
+
+    void SceneManager::evict() {
+        std::vector<CachedScene *> candidates;
+        scenes.forEach([this, &candidates](SceneHandle, CachedScene &cached) {
+            // Only evict scenes nobody else holds, since they'd stay in memory anyway
+            if (cached.scene == nullptr || cached.scene == errorScene || cached.scene.use_count() > 1)
+                return;
+            if (frame - cached.lastUsedFrame >= budget.minIdleFrames)
+                candidates.push_back(&cached);
+        });
+        std::ranges::sort(candidates, {}, &CachedScene::lastUsedFrame);
+
+        for (CachedScene *cached : candidates) {
+            if (!budget.exceededBy(usage_))
+                return;
+            logDebug("Evicting scene \"%s\" (%zu KiB GPU, %zu KiB CPU, unused for %llu frames)", cached->path.c_str(),
+                cached->usage.gpuBytes / 1024, cached->usage.cpuBytes / 1024,
+                static_cast<unsigned long long>(frame - cached->lastUsedFrame));
+            release(*cached);
+        }
+    }
+
+    size_t SceneManager::count() const {
+        size_t loaded = 0;
+        scenes.forEach([&loaded](SceneHandle, const CachedScene &cached) {
+            if (cached.scene != nullptr)
+                loaded++;
+        });
+        return loaded;
+    }
+
+    size_t SceneManager::releasedCpuBytes() const {
+        // Failed paths all point to the error scene, so count it separately to avoid counting it multiple times
+        size_t bytes = errorScene->releasedCpuBytes;
+        scenes.forEach([this, &bytes](SceneHandle, const CachedScene &cached) {
+            if (cached.scene != nullptr && cached.scene != errorScene)
+                bytes += cached.scene->releasedCpuBytes;
+        });
+        return bytes;
+    }
+
+    size_t SceneManager::geometryBytes() const {
+        size_t bytes = errorScene->geometryBytes();
+        scenes.forEach([this, &bytes](SceneHandle, const CachedScene &cached) {
+            if (cached.scene != nullptr && cached.scene != errorScene)
+                bytes += cached.scene->geometryBytes();
+        });
+        return bytes;
+    }
+
+    size_t SceneManager::addInstance(const SharedScene &scene, const glm::mat4 &transform) {
+        return instances[scene].add(transform);
+    }
+
+    bool SceneManager::setInstanceTransform(const SharedScene &scene, const size_t index, const glm::mat4 &transform) {
+        const auto it = instances.find(scene);
+        return it != instances.end() && it->second.set(index, transform);
+    }
+
+    bool SceneManager::removeInstance(const SharedScene &scene, const size_t index) {
+        const auto it = instances.find(scene);
+        if (it == instances.end() || !it->second.remove(index))
+            return false;
+        if (it->second.count() == 0)
+            instances.erase(it);  // Let the scene be freed if nothing else holds it
+        return true;
+    }
+
+    void SceneManager::clearInstances(const SharedScene &scene) {
+        instances.erase(scene);
+    }
+
+    size_t SceneManager::instanceCount(const SharedScene &scene) const {
+        const auto it = instances.find(scene);
+        return it != instances.end() ? it->second.count() : 0;
+    }
+
+    void SceneManager::requestTextureDetail(MaterialManager &materialManager, const glm::vec3 &cameraPosition, const float pixelScale) const {
+        for (const auto &[scene, instanceBuffer] : instances)
+            for (size_t i = 0; i < instanceBuffer.count(); i++)
+                materialManager.requestDetail(*scene, scene->rootNode.transform * instanceBuffer.transform(i), cameraPosition, pixelScale);
+    }
+
+    std::expected<void, std::string> SceneManager::drawInstances(const MaterialManager &materialManager, const GraphicsShader &shader) {
+        if (instances.empty())
+            return {};
+
+        materialManager.bind(shader);
+        for (auto &[scene, instanceBuffer] : instances) {
+            instanceBuffer.upload(scene->rootNode.transform);
+            instanceBuffer.bind();
+
+            auto drawRet = scene->DrawInstanced(shader, instanceBuffer.count());
+            if (!drawRet.has_value())
+                return std::unexpected(FW_UNEXP(drawRet, "Failed to draw scene instances"));
+        }
+        return {};
     }
-}
\ No newline at end of file
+}
@@ -2,29 +2,166 @@
 #define MANAGER_MESH_H
 
 #include <engine/loader/scene.h>
+#include <engine/render/instance_buffer.h>
 #include <expected>
 #include <memory>
 #include <string>
 #include <unordered_map>
 
+#include "cache_budget.h"
+#include "handle.h"
+#include "material.h"
+
 #define ERROR_MESH_PATH "resources/assets/models/error.obj"
 
 struct aiNode;
 
 namespace Engine::Manager {
     typedef std::shared_ptr<Loader::Scene> SharedScene;
+    struct SceneTag;
+    typedef Handle<SceneTag> SceneHandle;
 
+    /*!
+     * Caches scenes by path. Each path is resolved to a `SceneHandle` once, and everything after that is array indexing
+     */
     class SceneManager {
     private:
-        std::unordered_map<std::string, SharedScene> scenes;
+        struct CachedScene {
+            std::string path;
+            bool keepGeometry = false;
+            SharedScene scene;  // Null until loaded, and again once evicted
+            MemoryUsage usage;
+            uint64_t lastUsedFrame = 0;
+            // Scoped to the scene: unloaded with it, since nothing else can load them
+            std::vector<TextureHandle> embeddedTextures;
+        };
+        HandlePool<SceneTag, CachedScene> scenes;
+        // Only used to resolve handles
+        std::unordered_map<std::string, SceneHandle> handles;
+        // Instances keep their scene alive, even if it is unloaded from the path cache
+        std::unordered_map<SharedScene, InstanceBuffer> instances;
+        // Scenes dropped from the cache while something else still held them. Their materials are unregistered once nothing does
+        std::vector<SharedScene> retired;
+
+        MaterialManager &materialManager;
+        TextureManager &textureManager;
+
+        uint64_t frame = 0;
+        MemoryUsage usage_;
+
+        void insert(CachedScene &cached, const SharedScene &scene);
+        /*!
+         * @brief Hand a loaded scene's embedded textures over to the texture manager, then register its materials (which refer to them)
+         */
+        void registerResources(Loader::Scene &scene, std::vector<TextureHandle> &embeddedTextures);
+        /*!
+         * @brief Drop a cached scene, keeping its handle so it can be loaded again
+         */
+        void release(CachedScene &cached);
+        /*!
+         * @brief Unregister the materials of retired scenes that nothing holds anymore
+         */
+        void releaseRetired();
+        void evict();
+
     public:
         SharedScene errorScene;
+        CacheBudget budget;
 
-        SceneManager();
+        /*!
+         * @param materialManager Where the materials of loaded scenes are registered
+         * @param textureManager Where the embedded textures of loaded scenes are registered. Should be the one `materialManager` uses
+         */
+        SceneManager(MaterialManager &materialManager, TextureManager &textureManager);
 
-        std::expected<SharedScene, std::string> getScene(const std::string &scenePath);
+        /*!
+         * @brief Resolve a scene path to a handle, without loading it
+         * @param keepGeometry Whether the scene's meshes should keep a CPU copy of their geometry (e.g. for collision).
+         *  If the scene is cached without geometry, it is reloaded the next time it is requested.
+         * @return The scene's handle, which stays valid until it is unloaded
+         * @note Resolve handles once, when loading whatever uses the scene, rather than every frame
+         */
+        SceneHandle getHandle(const std::string &scenePath, bool keepGeometry = false);
+        /*!
+         * @brief Get a scene, loading it if necessary
+         * @return The scene, or an error message if it failed to load (once, then the error scene) or the handle is stale
+         */
+        std::expected<SharedScene, std::string> getScene(SceneHandle handle);
+        /*!
+         * @brief Resolve a scene path and get the scene (see `getHandle` and `getScene(SceneHandle)`)
+         * @note Hashes the path on every call, so prefer keeping the handle
+         */
+        std::expected<SharedScene, std::string> getScene(const std::string &scenePath, bool keepGeometry = false);
+        /*!
+         * @brief Unload a scene, making its handle stale
+         * @note Instances keep the scene itself alive
+         */
+        bool unloadScene(SceneHandle handle);
         bool unloadScene(const std::string &scenePath);
+        /*!
+         * @brief Unload every scene and instance, making every handle stale
+         */
         void clear();
+
+        /*!
+         * @brief Advance the frame counter and evict least recently used scenes if over budget
+         * @note Scenes that are still referenced outside the manager (including by instances) are never evicted.
+         *  Unloaded scenes keep their materials registered until nothing references them
+         * @note Should be called once per frame
+         */
+        void beginFrame();
+        /*!
+         * @return The estimated memory used by cached scenes (excluding the error scene)
+         */
+        [[nodiscard]] MemoryUsage usage() const { return usage_; }
+        /*!
+         * @return The number of cached scenes
+         */
+        [[nodiscard]] size_t count() const;
+
+        /*!
+         * @return The bytes of vertex and index data freed after upload, across all cached scenes
+         */
+        [[nodiscard]] size_t releasedCpuBytes() const;
+        /*!
+         * @return The bytes of CPU geometry kept for consumers like collision, across all cached scenes
+         */
+        [[nodiscard]] size_t geometryBytes() const;
+
+        /*!
+         * @brief Register an instance of a scene, to be drawn by `drawInstances`
+         * @param scene The scene to instance
+         * @param transform The model transform of the instance
+         * @return The index of the instance within this scene's instances
+         */
+        size_t addInstance(const SharedScene &scene, const glm::mat4 &transform);
+        /*!
+         * @brief Move an existing instance of a scene
+         * @return Whether the instance exists
+         */
+        bool setInstanceTransform(const SharedScene &scene, size_t index, const glm::mat4 &transform);
+        /*!
+         * @brief Remove an instance of a scene
+         * @note The last instance of the scene takes the removed instance's index
+         * @return Whether the instance existed
+         */
+        bool removeInstance(const SharedScene &scene, size_t index);
+        /*!
+         * @brief Remove all instances of a scene
+         */
+        void clearInstances(const SharedScene &scene);
+        [[nodiscard]] size_t instanceCount(const SharedScene &scene) const;
+
+        /*!
+         * @brief Draw every registered instance, with one instanced draw call per mesh
+         * @param materialManager The material manager the scenes' materials were registered with, bound once for every instance
+         * @param shader A shader that reads its transforms from the instance buffer (see vert_instanced.vert)
+         */
+        std::expected<void, std::string> drawInstances(const MaterialManager &materialManager, const GraphicsShader &shader);
+        /*!
+         * @brief Request the texture detail every instance needs from where it is on screen (see `MaterialManager::requestDetail`)
+         */
+        void requestTextureDetail(MaterialManager &materialManager, const glm::vec3 &cameraPosition, float pixelScale) const;
     };
 
 }
@@ -1,62 +1,476 @@
 #include "engine/manager/texture.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <stdexcept>
+#include <vector>
 #include <gl/glew.h>
 
+#include "engine/loader/equirectangular.h"
 #include "engine/loader/texture.h"
 
 #include <engine/logging.h>
+#include <engine/util/thread_pool.h>
 
 
 namespace Engine::Manager {
-    TextureManager::TextureManager() {
+    TextureManager::TextureManager() : staging(TEXTURE_STAGING_BYTES) {
         const auto errorTxt = Loader::loadTexture(ERROR_TEXTURE_PATH);
         if (!errorTxt.has_value())
             throw std::runtime_error("Failed to load error texture: " + errorTxt.error());
         errorTexture = errorTxt.value();
+
+        constexpr unsigned char MAGENTA[] = {255, 0, 255, 255};
+        glGenTextures(1, &errorCubemap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, errorCubemap);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_RGBA8, 1, 1);
+        for (int face = 0; face < 6; face++)
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, MAGENTA);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        // BC1 and BC3 come from an extension (supported everywhere on desktop), while BC7 is core
+        if (!GLEW_EXT_texture_compression_s3tc)
+            highQualityCompression = true;
     }
 
     TextureManager::~TextureManager() {
         clear();
         glDeleteTextures(1, &errorTexture);
+        glDeleteTextures(1, &errorCubemap);
+    }
+
+    unsigned int TextureManager::getErrorTexture(const TextureType type) const {
+        return type == TextureType::TEXTURE_2D ? errorTexture : errorCubemap;
+    }
+
+    void TextureManager::release(CachedTexture &texture) {
+        // Failed loads share the error textures, which we keep until we're destroyed
+        if (texture.id != 0 && texture.id != errorTexture && texture.id != errorCubemap)
+            glDeleteTextures(1, &texture.id);
+        usage_.gpuBytes -= texture.gpuBytes;
+        texture.id = 0;
+        texture.gpuBytes = 0;
+    }
+
+    void TextureManager::cancel(const TextureHandle handle) {
+        pending.erase(handle);  // Any decode still running finishes in the background and is discarded
+        const auto upload = std::ranges::find(uploads, handle, &TextureUpload::handle);
+        if (upload != uploads.end()) {
+            glDeleteTextures(1, &upload->id);  // Copies still in flight finish harmlessly
+            uploads.erase(upload);
+        }
     }
 
     void TextureManager::clear() {
-        for (const auto &[path, textureID] : textures)
-            glDeleteTextures(1, &textureID);
+        textures.forEach([this](TextureHandle, CachedTexture &texture) { release(texture); });
         textures.clear();
+        handles.clear();
+        for (const TextureUpload &upload : uploads)
+            glDeleteTextures(1, &upload.id);
+        uploads.clear();
+        pending.clear();
+        usage_ = {};
     }
 
-    std::expected<unsigned int, std::string> TextureManager::getTexture(const std::string &texturePath, const TextureType type) {
+    std::string TextureManager::getKey(const std::string &texturePath, const int maxResolution, const Loader::TextureUsage usage) {
+        const std::string key = usage == Loader::TextureUsage::SPECULAR ? texturePath + "#specular" : texturePath;
+        return maxResolution > 0 ? key + "@" + std::to_string(maxResolution) : key;
+    }
+
+    TextureHandle TextureManager::getHandle(const std::string &texturePath, const TextureType type, const int maxResolution,
+            const Loader::TextureUsage usage) {
         if (texturePath.empty())
+            return {};
+        if (maxResolution > 0 || usage != Loader::TextureUsage::DIFFUSE) {
+            // Embedded textures only exist at full resolution, filtered as diffuse
+            const auto embedded = handles.find(texturePath);
+            if (embedded != handles.end() && textures.get(embedded->second)->embedded)
+                return embedded->second;
+        }
+        // Only 2D textures are filtered by usage, so don't load cubemaps twice
+        const Loader::TextureUsage keyUsage = type == TextureType::TEXTURE_2D ? usage : Loader::TextureUsage::DIFFUSE;
+        const auto [it, inserted] = handles.try_emplace(getKey(texturePath, maxResolution, keyUsage));
+        if (inserted)
+            it->second = textures.insert({.path = texturePath, .type = type, .maxResolution = maxResolution, .usage = keyUsage});
+        return it->second;
+    }
+
+    std::expected<unsigned int, std::string> TextureManager::getTexture(const TextureHandle handle) {
+        if (handle.isNull())
             return errorTexture;
+        CachedTexture *texture = textures.get(handle);
+        if (texture == nullptr)
+            return UNEXPECTED_REF("Stale texture handle");
+
+        texture->lastUsedFrame = frame;
+        if (texture->id != 0)
+            return texture->id;
+        load(handle, *texture);
+        return getErrorTexture(texture->type);  // Stand in until the texture is uploaded
+    }
+
+    std::expected<unsigned int, std::string> TextureManager::getTexture(const std::string &texturePath, const TextureType type, const int maxResolution,
+            const Loader::TextureUsage usage) {
+        return getTexture(getHandle(texturePath, type, maxResolution, usage));
+    }
+
+    template<typename T>
+    std::expected<std::vector<T>, std::string> toList(std::expected<T, std::string> &&result) {
+        if (!result.has_value())
+            return std::unexpected(std::move(result.error()));
+        std::vector<T> list;
+        list.push_back(std::move(result.value()));
+        return list;
+    }
+
+    template<typename T, size_t N>
+    std::expected<std::vector<T>, std::string> toList(std::expected<std::array<T, N>, std::string> &&result) {
+        if (!result.has_value())
+            return std::unexpected(std::move(result.error()));
+        return std::vector<T>(std::make_move_iterator(result->begin()), std::make_move_iterator(result->end()));
+    }
+
+    void TextureManager::preload(const TextureHandle handle) {
+        if (CachedTexture *texture = textures.get(handle); texture != nullptr)
+            load(handle, *texture);
+    }
+
+    TextureHandle TextureManager::preload(const std::string &texturePath, const TextureType type, const int maxResolution,
+            const Loader::TextureUsage usage) {
+        const TextureHandle handle = getHandle(texturePath, type, maxResolution, usage);
+        preload(handle);
+        return handle;
+    }
+
+    TextureHandle TextureManager::addTexture(const std::string &key, Loader::Image &&image) {
+        const auto [it, inserted] = handles.try_emplace(key);
+        if (!inserted)
+            return it->second;
+        it->second = textures.insert({.path = key, .type = TextureType::TEXTURE_2D, .lastUsedFrame = frame, .loading = true, .embedded = true});
+
+        // Only the mips are left to do, which still shouldn't hold up the main thread
+        PendingTexture pendingTexture{TextureType::TEXTURE_2D, false, false, {}, {}};
+        pendingTexture.images.push_back(ThreadPool::shared().submit([image = std::move(image)]() mutable {
+            Loader::generateMips(image);
+            return toList(std::expected<Loader::Image, std::string>(std::move(image)));
+        }));
+        pending.emplace(it->second, std::move(pendingTexture));
+        return it->second;
+    }
+
+    bool TextureManager::isEmbedded(const TextureHandle handle) const {
+        const CachedTexture *texture = textures.get(handle);
+        return texture != nullptr && texture->embedded;
+    }
+
+    void TextureManager::load(const TextureHandle handle, CachedTexture &texture) {
+        if (texture.id != 0 || texture.loading || texture.embedded)
+            return;
+        texture.loading = true;
+
+        const std::string &texturePath = texture.path;
+        const TextureType type = texture.type;
+        PendingTexture pendingTexture{type, compressTextures, false, {}, {}};
+        if (type == TextureType::EQUIRECTANGULAR_CUBEMAP) {
+            // The whole panorama is needed for every face, so it's a single task (the projection itself is parallel)
+            if (compressTextures)
+                pendingTexture.compressedImages.push_back(ThreadPool::shared().submit([texturePath, highQuality = highQualityCompression] {
+                    return toList(Loader::loadCompressedEquirectangularCubeMap(texturePath, highQuality));
+                }));
+            else if (equirectangularShader != nullptr) {
+                pendingTexture.convertOnGpu = true;
+                pendingTexture.images.push_back(ThreadPool::shared().submit([texturePath] { return toList(Loader::loadImage(texturePath)); }));
+            } else
+                pendingTexture.images.push_back(ThreadPool::shared().submit([texturePath] {
+                    return toList(Loader::loadEquirectangularCubeMap(texturePath));
+                }));
+            pending.emplace(handle, std::move(pendingTexture));
+            return;
+        }
+
+        std::vector<std::string> paths;
+        if (type == TextureType::CUBEMAP) {
+            // Each face gets its own task, so all six decode at once
+            const std::array<std::string, 6> facePaths = Loader::getCubeMapFacePaths(texturePath);
+            paths.assign(facePaths.begin(), facePaths.end());
+        } else
+            paths.push_back(texturePath);
+
+        for (const std::string &path : paths) {
+            if (compressTextures)
+                pendingTexture.compressedImages.push_back(ThreadPool::shared().submit(
+                    [path, highQuality = highQualityCompression, maxResolution = type == TextureType::TEXTURE_2D ? texture.maxResolution : 0,
+                        usage = texture.usage] {
+                        return toList(Loader::loadCompressedTexture(path, highQuality, maxResolution, usage));
+                    }));
+            else
+                pendingTexture.images.push_back(ThreadPool::shared().submit([path, generateMips = type == TextureType::TEXTURE_2D, usage = texture.usage] {
+                    // Filter the mip chain here rather than with glGenerateMipmap, so the main thread only copies it
+                    std::expected<Loader::Image, std::string> image = Loader::loadImage(path);
+                    if (image.has_value() && generateMips)
+                        Loader::generateMips(image.value(), usage);
+                    return toList(std::move(image));
+                }));
+        }
+        pending.emplace(handle, std::move(pendingTexture));
+    }
+
+    bool TextureManager::isLoading(const TextureHandle handle) const {
+        const CachedTexture *texture = textures.get(handle);
+        return texture != nullptr && texture->loading;
+    }
+
+    bool TextureManager::isLoading(const std::string &texturePath, const int maxResolution, const Loader::TextureUsage usage) const {
+        const auto it = handles.find(getKey(texturePath, maxResolution, usage));
+        return it != handles.end() && isLoading(it->second);
+    }
 
-        if (textures.contains(texturePath))
-            return textures[texturePath];
+    template<typename T>
+    bool isReady(const std::vector<std::future<T>> &futures) {
+        return std::ranges::all_of(futures, [](const std::future<T> &future) {
+            return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+    }
 
-#define BREAK_CASE(x, ...) case x: __VA_ARGS__; break;
-        std::expected<unsigned int, std::string> texture;
-        switch (type) {
-            BREAK_CASE(TextureType::TEXTURE_2D, texture = Loader::loadTexture(texturePath.c_str()));
-            BREAK_CASE(TextureType::CUBEMAP, texture = Loader::loadCubeMap(texturePath));
-            default:
-                return std::unexpected("Unknown texture type");
+    template<typename T>
+    std::expected<void, std::string> collect(std::vector<std::future<std::expected<std::vector<T>, std::string>>> &futures, std::vector<T> &results) {
+        for (auto &future : futures) {
+            std::expected<std::vector<T>, std::string> result = future.get();
+            if (!result.has_value())
+                return std::unexpected(FW_UNEXP(result, "Failed to decode texture"));
+            std::ranges::move(result.value(), std::back_inserter(results));
         }
-#undef BREAK_CASE
-        if (!texture.has_value()) {
-            textures[texturePath] = errorTexture;  // Only error once, then use the error texture
-            return std::unexpected(FW_UNEXP(texture, "Failed to load uncached texture"));
+        return {};
+    }
+
+    void TextureManager::startUploads(const bool wait) {
+        for (auto it = pending.begin(); it != pending.end();) {
+            auto &[handle, pendingTexture] = *it;
+            const bool ready = wait || (pendingTexture.compressed ? isReady(pendingTexture.compressedImages) : isReady(pendingTexture.images));
+            if (!ready) {
+                ++it;
+                continue;
+            }
+
+            // Panoramas converted on the GPU are first uploaded as a plain 2D texture
+            const bool cubeMap = pendingTexture.type != TextureType::TEXTURE_2D && !pendingTexture.convertOnGpu;
+            TextureUpload upload{handle, static_cast<unsigned int>(cubeMap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D), pendingTexture.convertOnGpu};
+            std::expected<void, std::string> loadRet = pendingTexture.compressed
+                ? collect(pendingTexture.compressedImages, upload.compressedImages)
+                : collect(pendingTexture.images, upload.images);
+            for (size_t i = 0; i < upload.images.size(); i++) {
+                const Loader::Image &image = upload.images[i];
+                const GLenum target = cubeMap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(i) : GL_TEXTURE_2D;
+                const auto format = static_cast<unsigned int>(Loader::getPixelFormat(image.channelCount));
+                upload.surfaces.push_back({target, 0, image.width, image.height, format, false,
+                    image.pixels.get(), static_cast<size_t>(image.width) * image.channelCount, image.height});
+                for (size_t level = 0; level < image.mips.size(); level++) {
+                    const Loader::MipLevel &mip = image.mips[level];
+                    upload.surfaces.push_back({target, static_cast<int>(level + 1), mip.width, mip.height, format, false,
+                        mip.pixels.data(), static_cast<size_t>(mip.width) * image.channelCount, mip.height});
+                }
+            }
+            for (size_t i = 0; i < upload.compressedImages.size(); i++) {
+                const Loader::CompressedTexture &texture = upload.compressedImages[i];
+                for (size_t level = 0; level < texture.levels.size(); level++) {
+                    const Loader::CompressedTexture::Level &levelData = texture.levels[level];
+                    upload.surfaces.push_back({cubeMap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(i) : GL_TEXTURE_2D,
+                        static_cast<int>(level), levelData.width, levelData.height, Loader::getBlockGlFormat(texture.format), true,
+                        levelData.data.data(), Loader::getCompressedSize(texture.format, levelData.width, 1), (levelData.height + 3) / 4});
+                }
+            }
+            if (loadRet.has_value() && std::ranges::any_of(upload.surfaces, [this](const UploadSurface &surface) { return surface.rowBytes > staging.size(); }))
+                loadRet = UNEXPECTED_REF("Texture is too wide to upload through the staging buffer");
+
+            if (!loadRet.has_value()) {
+                // Unloading a texture cancels its decode, so it's always still there
+                CachedTexture &texture = *textures.get(handle);
+                logError("Failed to load uncached texture \"%s\"" NL_INDENT "%s", texture.path.c_str(), loadRet.error().c_str());
+                texture.id = getErrorTexture(texture.type);  // Only error once, then use the error texture
+                texture.loading = false;
+                it = pending.erase(it);
+                continue;
+            }
+
+            // Allocate the texture now, and fill it in over the next frames
+            if (pendingTexture.compressed)
+                upload.id = cubeMap
+                    ? Loader::createCompressedCubeMap(std::span<const Loader::CompressedTexture, 6>(upload.compressedImages.data(), 6))
+                    : Loader::createCompressedTexture(upload.compressedImages.front());
+            else
+                upload.id = cubeMap
+                    ? Loader::createCubeMap(std::span<const Loader::Image, 6>(upload.images.data(), 6))
+                    : Loader::createTexture(upload.images.front().width, upload.images.front().height, upload.images.front().channelCount);
+            uploads.push_back(std::move(upload));
+            it = pending.erase(it);
         }
-        return textures[texturePath] = texture.value();
     }
 
-    bool TextureManager::unloadTexture(const std::string &texturePath) {
-        if (!textures.contains(texturePath))
+    void TextureManager::copyUploads(const bool wait) {
+        size_t bytesLeft = wait ? std::numeric_limits<size_t>::max() : uploadBytesPerFrame;
+        bool copiedAny = false;
+
+        staging.bind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // Rows of RGB and single channel images aren't 4 byte aligned
+        for (TextureUpload &upload : uploads) {
+            if (upload.fence != 0)
+                continue;  // Already copied
+
+            glBindTexture(upload.target, upload.id);
+
+            bool stalled = false;
+            while (upload.surface < upload.surfaces.size()) {
+                const UploadSurface &surface = upload.surfaces[upload.surface];
+                size_t rows = std::min({static_cast<size_t>(surface.rowCount - upload.row), bytesLeft / surface.rowBytes, staging.size() / surface.rowBytes});
+                if (rows == 0) {
+                    // Always make some progress, even if a single row is over the per-frame budget
+                    if (copiedAny) {
+                        stalled = true;
+                        break;
+                    }
+                    rows = 1;
+                }
+
+                const size_t bytes = rows * surface.rowBytes;
+                const std::optional<size_t> offset = staging.allocate(bytes);
+                if (!offset.has_value()) {
+                    if (!wait) {
+                        stalled = true;  // Out of staging space until earlier copies finish
+                        break;
+                    }
+                    staging.fence();
+                    staging.retire(true);
+                    continue;
+                }
+
+                std::memcpy(staging.data(offset.value()), surface.data + upload.row * surface.rowBytes, bytes);
+                // With a pixel unpack buffer bound, the data pointer is an offset into it
+                const auto *stagingOffset = reinterpret_cast<const void *>(offset.value());
+                if (surface.compressed) {
+                    // Each row of blocks is 4 pixels high, except possibly the last
+                    const int y = upload.row * 4;
+                    glCompressedTexSubImage2D(surface.target, surface.level, 0, y, surface.width,
+                        std::min(static_cast<int>(rows) * 4, surface.height - y), surface.format, static_cast<GLsizei>(bytes), stagingOffset);
+                } else {
+                    glTexSubImage2D(surface.target, surface.level, 0, upload.row, surface.width, static_cast<GLsizei>(rows),
+                        surface.format, GL_UNSIGNED_BYTE, stagingOffset);
+                }
+
+                upload.row += static_cast<int>(rows);
+                bytesLeft -= std::min(bytesLeft, bytes);
+                copiedAny = true;
+                if (upload.row == surface.rowCount) {
+                    upload.surface++;
+                    upload.row = 0;
+                }
+            }
+            if (stalled)
+                break;
+
+            upload.fence = staging.fence();
+            // The pixels live in the staging buffer now
+            upload.surfaces.clear();
+            upload.images.clear();
+            upload.compressedImages.clear();
+        }
+        staging.fence();  // Covers textures that were only partially copied
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        StagingBuffer::unbind();
+    }
+
+    void TextureManager::finishUploads() {
+        staging.retire();
+        for (auto it = uploads.begin(); it != uploads.end();) {
+            if (it->fence == 0 || it->fence > staging.retiredFence()) {
+                ++it;
+                continue;
+            }
+
+            GLenum target = it->target;
+            if (it->convertOnGpu) {
+                // The panorama has been copied, so project it onto its cubemap (which generates the cubemap's mips)
+                glBindTexture(GL_TEXTURE_2D, it->id);
+                int width = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+                const unsigned int cubeMap = Loader::equirectangularToCubeMapGpu(it->id, Loader::getCubeMapFaceSize(width), *equirectangularShader);
+                glDeleteTextures(1, &it->id);
+                it->id = cubeMap;
+                target = GL_TEXTURE_CUBE_MAP;
+            }
+
+            CachedTexture &texture = *textures.get(it->handle);
+            texture.gpuBytes = Loader::estimateTextureBytes(it->id, target);
+            logDebug("Loaded texture \"%s\" (%zu KiB)", getKey(texture.path, texture.maxResolution, texture.usage).c_str(), texture.gpuBytes / 1024);
+            usage_.gpuBytes += texture.gpuBytes;
+            texture.id = it->id;
+            texture.lastUsedFrame = frame;
+            texture.loading = false;
+            it = uploads.erase(it);
+        }
+    }
+
+    void TextureManager::waitForPending() {
+        startUploads(true);
+        copyUploads(true);
+        finishUploads();
+        while (!uploads.empty()) {
+            staging.retire(true);
+            finishUploads();
+        }
+    }
+
+    bool TextureManager::unloadTexture(const TextureHandle handle) {
+        CachedTexture *texture = textures.get(handle);
+        if (texture == nullptr)
             return false;
-        glDeleteTextures(1, &textures[texturePath]);
-        textures.erase(texturePath);
+        cancel(handle);
+        release(*texture);
+        handles.erase(getKey(texture->path, texture->maxResolution, texture->usage));
+        textures.remove(handle);
         return true;
     }
 
+    bool TextureManager::unloadTexture(const std::string &texturePath, const int maxResolution, const Loader::TextureUsage usage) {
+        const auto it = handles.find(getKey(texturePath, maxResolution, usage));
+        return it != handles.end() && unloadTexture(it->second);
+    }
+
+    void TextureManager::beginFrame() {
+        finishUploads();
+        startUploads(false);
+        copyUploads(false);
+        frame++;
+        if (budget.exceededBy(usage_))
+            evict();
+    }
+
+    void TextureManager::evict() {
+        std::vector<CachedTexture *> candidates;
+        textures.forEach([this, &candidates](TextureHandle, CachedTexture &texture) {
+            if (texture.gpuBytes > 0 && !texture.embedded && frame - texture.lastUsedFrame >= budget.minIdleFrames)
+                candidates.push_back(&texture);
+        });
+        std::ranges::sort(candidates, {}, &CachedTexture::lastUsedFrame);
 
+        for (CachedTexture *texture : candidates) {
+            if (!budget.exceededBy(usage_))
+                return;
+            logDebug("Evicting texture \"%s\" (%zu KiB, unused for %llu frames)", getKey(texture->path, texture->maxResolution, texture->usage).c_str(),
+                texture->gpuBytes / 1024, static_cast<unsigned long long>(frame - texture->lastUsedFrame));
+            release(*texture);
+        }
+    }
+
+    size_t TextureManager::count() const {
+        size_t resident = 0;
+        textures.forEach([&resident](TextureHandle, const CachedTexture &texture) {
+            if (texture.id != 0)
+                resident++;
+        });
+        return resident;
+    }
 }
@@ -1,48 +1,244 @@
 #ifndef MANAGER_TEXTURE_H
 #define MANAGER_TEXTURE_H
 
+#include <deque>
 #include <expected>
+#include <future>
 #include <string>
 #include <unordered_map>
+#include <vector>
+
+#include <engine/loader/texture.h>
+#include <engine/render/staging_buffer.h>
+
+#include "cache_budget.h"
+#include "handle.h"
 
 #define ERROR_TEXTURE_PATH "resources/assets/textures/error.png"
+// Size of the persistently mapped buffer texture data is copied through. Larger textures are copied over several frames
+#define TEXTURE_STAGING_BYTES (32 * 1024 * 1024)
+
+namespace Engine {
+    class ComputeShader;
+}
 
 namespace Engine::Manager {
     enum class TextureType {
         TEXTURE_2D,
-        CUBEMAP
+        CUBEMAP,
+        EQUIRECTANGULAR_CUBEMAP  // A cubemap projected from a single equirectangular panorama
     };
 
+    struct TextureTag;
+    typedef Handle<TextureTag> TextureHandle;
+
     /*!
-     * Class that stores and manages OpenGL texture IDs to avoid loading the same texture multiple times
+     * Class that stores and manages OpenGL texture IDs to avoid loading the same texture multiple times.
+     * Each texture path is resolved to a `TextureHandle` once, and everything after that is array indexing
      */
     class TextureManager {
     private:
-        std::unordered_map<std::string, unsigned int> textures;
+        struct CachedTexture {
+            std::string path;
+            TextureType type = TextureType::TEXTURE_2D;
+            int maxResolution = 0;
+            Loader::TextureUsage usage = Loader::TextureUsage::DIFFUSE;
+            unsigned int id = 0;  // 0 until resident, and again once evicted
+            size_t gpuBytes = 0;
+            uint64_t lastUsedFrame = 0;
+            bool loading = false;  // Whether it's being decoded or uploaded
+            bool embedded = false;  // Registered from memory with `addTexture`, so it can't be loaded again once freed
+        };
+        HandlePool<TextureTag, CachedTexture> textures;
+        // Only used to resolve handles, see `getKey`
+        std::unordered_map<std::string, TextureHandle> handles;
+
+        // Each task yields one or more images: cubemaps from six files get a task per face, while a panorama is a single task for all six
+        template<typename T>
+        using ImageTasks = std::vector<std::future<std::expected<std::vector<T>, std::string>>>;
+        // Textures being decoded (or loaded from the texture cache) on the shared thread pool, waiting to be uploaded
+        struct PendingTexture {
+            TextureType type;
+            bool compressed;
+            bool convertOnGpu;  // Whether the single decoded panorama is projected onto a cubemap by `equirectangularShader`
+            // Only the list matching `compressed` is used
+            ImageTasks<Loader::Image> images;
+            ImageTasks<Loader::CompressedTexture> compressedImages;
+        };
+        std::unordered_map<TextureHandle, PendingTexture> pending;
+
+        // A single mip level of a single face, copied in rows
+        struct UploadSurface {
+            unsigned int target;  // `GL_TEXTURE_2D` or a cubemap face
+            int level, width, height;
+            unsigned int format;
+            bool compressed;
+            const unsigned char *data;
+            size_t rowBytes;  // The size of a row of pixels, or of a row of blocks when compressed
+            int rowCount;
+        };
+        // Decoded textures being copied into their (already allocated) OpenGL texture through the staging buffer
+        struct TextureUpload {
+            TextureHandle handle;
+            unsigned int target;  // `GL_TEXTURE_2D` or `GL_TEXTURE_CUBE_MAP`
+            bool convertOnGpu;  // Whether `id` is a panorama to project onto a cubemap once copied
+            unsigned int id = 0;
+            std::vector<Loader::Image> images;
+            std::vector<Loader::CompressedTexture> compressedImages;
+            std::vector<UploadSurface> surfaces;  // Point into the images
+            size_t surface = 0;  // The surface being copied
+            int row = 0;  // The next row of that surface to copy
+            // Fence placed after the last copy, once every row has been copied. The texture is resident once it's signalled
+            uint64_t fence = 0;
+        };
+        std::deque<TextureUpload> uploads;
+        StagingBuffer staging;
+
+        uint64_t frame = 0;
+        MemoryUsage usage_;
+
+        /*!
+         * @brief Free a texture's OpenGL texture, keeping its handle so it can be loaded again
+         */
+        void release(CachedTexture &texture);
+        /*!
+         * @brief Stop decoding or uploading a texture
+         */
+        void cancel(TextureHandle handle);
+        void evict();
+        /*!
+         * @brief Start decoding a resolved texture, unless it's already resident or loading
+         */
+        void load(TextureHandle handle, CachedTexture &texture);
+        /*!
+         * @brief Allocate textures for every pending texture that has finished decoding, and queue them for copying
+         * @param wait Whether to wait for textures that are still decoding
+         */
+        void startUploads(bool wait);
+        /*!
+         * @brief Copy queued textures through the staging buffer, up to `uploadBytesPerFrame`
+         * @param wait Whether to ignore the byte budget and wait for staging space, copying everything
+         */
+        void copyUploads(bool wait);
+        /*!
+         * @brief Make textures whose copies have finished on the GPU available
+         */
+        void finishUploads();
+        /*!
+         * @return The key a texture's handle is found under. Partially loaded mip chains, and textures filtered for another usage,
+         *  get a separate handle from the full diffuse texture
+         */
+        static std::string getKey(const std::string &texturePath, int maxResolution, Loader::TextureUsage usage);
+        /*!
+         * @return The error texture with the same target as textures of this type, so it can stand in for them
+         */
+        [[nodiscard]] unsigned int getErrorTexture(TextureType type) const;
 
     public:
         unsigned int errorTexture;
+        // A 1x1 magenta cubemap, standing in for cubemaps that are loading or failed to load
+        unsigned int errorCubemap;
+        CacheBudget budget;
+        // Maximum number of bytes copied into textures each frame. Spreads large textures over several frames
+        size_t uploadBytesPerFrame = 8 * 1024 * 1024;
+        // Whether to load block compressed textures from the texture cache (cooking them if needed) instead of decoding images
+        bool compressTextures = true;
+        // Use BC7 rather than BC1/BC3 for compressed colour textures. Forced on if S3TC isn't supported
+        bool highQualityCompression = false;
+        // If set, uncompressed equirectangular panoramas are projected onto their cubemap by this shader (equirectangular_to_cube.comp)
+        // rather than on the CPU. Compressed panoramas are always converted on the CPU, since their faces are cached
+        const ComputeShader *equirectangularShader = nullptr;
 
         TextureManager();
         ~TextureManager();
 
         /*!
-         * @brief Get the OpenGL texture ID associated with a texture path, loading it if necessary
+         * @brief Resolve a texture path to a handle, without loading it
          * @param texturePath The path to the texture
-         * @param type The type of texture to load. Defaults to a 2D texture
-         * @return The texture ID or an error message
+         * @param type The type of texture to load. Defaults to a 2D texture. Ignored if the texture already has a handle
+         * @param maxResolution If positive, only load the mip levels of a compressed 2D texture whose width and height are at most this,
+         *  as a smaller texture (see `Loader::loadCompressedTexture`). Ignored for uncompressed textures, cubemaps and embedded textures
+         * @param usage How the mip chain of a 2D texture is filtered (see `Loader::getMipOptions`). Ignored for cubemaps and embedded textures
+         * @return The texture's handle, which stays valid until it is unloaded. Null for an empty path
+         * @note Resolve handles once, when loading whatever uses the texture, rather than every frame
          */
-        std::expected<unsigned int, std::string> getTexture(const std::string &texturePath, TextureType type = TextureType::TEXTURE_2D);
+        TextureHandle getHandle(const std::string &texturePath, TextureType type = TextureType::TEXTURE_2D, int maxResolution = 0,
+            Loader::TextureUsage usage = Loader::TextureUsage::DIFFUSE);
         /*!
-         * @brief Unload a texture
-         * @param texturePath The path to the texture
-         * @return Whether the texture was successfully unloaded
+         * @brief Get the OpenGL texture ID of a texture, starting to load it if necessary
+         * @return The texture ID, or an error message if the handle is stale. Until the texture is resident, the error texture (or error cubemap) is returned
+         * @note Images are decoded on the shared thread pool, then copied in `beginFrame` through a staging buffer
+         * @note Texture IDs may be freed by eviction once they haven't been requested for `budget.minIdleFrames` frames,
+         *  so don't hold on to them across frames. The handle stays valid, and reloads the texture the next time it's requested
          */
-        bool unloadTexture(const std::string &texturePath);
+        std::expected<unsigned int, std::string> getTexture(TextureHandle handle);
         /*!
-         * @brief Unload all textures (except the error texture)
+         * @brief Resolve a texture path and get its OpenGL texture ID (see `getHandle` and `getTexture(TextureHandle)`)
+         * @note Hashes the path on every call, so prefer keeping the handle
+         */
+        std::expected<unsigned int, std::string> getTexture(const std::string &texturePath, TextureType type = TextureType::TEXTURE_2D, int maxResolution = 0,
+            Loader::TextureUsage usage = Loader::TextureUsage::DIFFUSE);
+        /*!
+         * @brief Start decoding a texture in the background, without waiting for it
+         * @note Decoding many textures up front lets them decode on all cores at once
+         */
+        void preload(TextureHandle handle);
+        TextureHandle preload(const std::string &texturePath, TextureType type = TextureType::TEXTURE_2D, int maxResolution = 0,
+            Loader::TextureUsage usage = Loader::TextureUsage::DIFFUSE);
+        /*!
+         * @brief Register an image that's already decoded (like a texture embedded in a scene) as a 2D texture, and start uploading it
+         * @param key What the texture is resolved by instead of a path (see `Loader::getEmbeddedTextureKey`)
+         * @param image Moved into the upload, so its pixels are only ever copied into the staging buffer
+         * @return The texture's handle. If the key is already registered, the image is dropped and the existing handle is returned
+         * @note There's nothing to reload the image from, so embedded textures are never evicted. Unload them once they're no longer needed
+         */
+        TextureHandle addTexture(const std::string &key, Loader::Image &&image);
+        /*!
+         * @return Whether a texture was registered with `addTexture`, so it can't be streamed or loaded again
+         */
+        [[nodiscard]] bool isEmbedded(TextureHandle handle) const;
+        /*!
+         * @brief Block until every pending texture is decoded and uploaded
+         */
+        void waitForPending();
+        [[nodiscard]] size_t pendingCount() const { return pending.size() + uploads.size(); }
+        /*!
+         * @brief Unload a texture, making its handle stale
+         * @return Whether the handle was valid
+         */
+        bool unloadTexture(TextureHandle handle);
+        /*!
+         * @param maxResolution The resolution the texture was requested with
+         * @param usage The usage the texture was requested with
+         */
+        bool unloadTexture(const std::string &texturePath, int maxResolution = 0, Loader::TextureUsage usage = Loader::TextureUsage::DIFFUSE);
+        /*!
+         * @return Whether a texture is still being decoded or uploaded
+         */
+        [[nodiscard]] bool isLoading(TextureHandle handle) const;
+        [[nodiscard]] bool isLoading(const std::string &texturePath, int maxResolution = 0, Loader::TextureUsage usage = Loader::TextureUsage::DIFFUSE) const;
+        /*!
+         * @brief Unload all textures (except the error textures), making every handle stale
          */
         void clear();
+
+        /*!
+         * @brief Continue uploading textures, advance the frame counter and evict least recently used textures if over budget
+         * @note Should be called once per frame
+         */
+        void beginFrame();
+        /*!
+         * @return The estimated memory used by cached textures (excluding the error textures)
+         */
+        [[nodiscard]] MemoryUsage usage() const { return usage_; }
+        /*!
+         * @return The number of resident textures
+         */
+        [[nodiscard]] size_t count() const;
+        /*!
+         * @return The number of resolved handles, including textures that aren't resident
+         */
+        [[nodiscard]] size_t handleCount() const { return textures.count(); }
     };
 
 }
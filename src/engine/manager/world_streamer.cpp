@@ -0,0 +1,155 @@
+#include "world_streamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <glm/glm.hpp>
+
+#include <engine/logging.h>
+
+#include "material.h"
+
+
+namespace Engine::Manager {
+    std::expected<void, std::string> WorldStreamer::load(const std::string &scenePath, MaterialManager &materialManager) {
+        std::expected<Loader::WorldIndex, std::string> newIndex = Loader::loadWorldIndex(scenePath, config.cellSize);
+        if (!newIndex.has_value())
+            return std::unexpected(FW_UNEXP(newIndex, "Failed to load world index"));
+
+        cells.clear();  // Waits for any pending loads
+        residentBytes = 0;
+        // Materials copy their textures into arrays, so anything still using them keeps working
+        for (const TextureHandle texture : embeddedTextures)
+            textureManager.unloadTexture(texture);
+        embeddedTextures.clear();
+
+        const std::vector<Loader::Material> oldMaterials = std::move(index.materials);
+        index = std::move(newIndex.value());
+        // Registered before the materials, which refer to them
+        for (Loader::EmbeddedTexture &texture : index.embeddedTextures)
+            embeddedTextures.push_back(textureManager.addTexture(texture.key, std::move(texture.image)));
+        index.embeddedTextures.clear();
+        // Cells copy the indexed materials, ids included, when they're uploaded
+        materialManager.registerMaterials(index.materials);
+        // Nothing draws the old world anymore. Unregistered last, so textures it shares with the new world stay resident
+        materialManager.unregisterMaterials(oldMaterials);
+        cells.resize(index.cells.size());
+        logDebug("Loaded world \"%s\" with %zu cells", scenePath.c_str(), cells.size());
+        return {};
+    }
+
+    void WorldStreamer::unload(const size_t cellIndex) {
+        StreamedCell &cell = cells[cellIndex];
+        if (cell.state != CellState::RESIDENT)
+            return;
+        residentBytes -= cell.scene->gpuBytes();
+        cell.scene.reset();
+        cell.state = CellState::UNLOADED;
+    }
+
+    void WorldStreamer::update(const glm::vec3 &cameraPosition) {
+        const float unloadRadius = config.loadRadius + config.unloadHysteresis;
+
+        for (size_t i = 0; i < cells.size(); i++)
+            cells[i].distance = index.cells[i].bounds.distanceTo(cameraPosition);
+
+        // Handle cells nearest to the camera first
+        std::vector<size_t> order(cells.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::ranges::sort(order, {}, [this](const size_t i) { return cells[i].distance; });
+
+#pragma region Upload finished loads
+        unsigned int uploads = 0;
+        for (const size_t i : order) {
+            StreamedCell &cell = cells[i];
+            if (cell.state != CellState::LOADING || uploads >= config.maxUploadsPerFrame)
+                continue;
+            if (cell.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;
+
+            std::expected<Loader::CellData, std::string> cellData = cell.pending.get();
+            cell.state = CellState::UNLOADED;
+            if (!cellData.has_value()) {
+                logError("Failed to stream in cell (%d, %d)" NL_INDENT "%s",
+                    index.cells[i].x, index.cells[i].z, cellData.error().c_str());
+                cell.failed = true;
+                continue;
+            }
+            // The camera moved away while we were loading
+            if (cell.distance > unloadRadius)
+                continue;
+
+            // Make room by dropping cells farther away than this one
+            for (auto it = order.rbegin(); it != order.rend() && residentBytes + index.cells[i].gpuBytes > config.gpuBudgetBytes; ++it)
+                if (cells[*it].distance > cell.distance)
+                    unload(*it);
+            if (residentBytes + index.cells[i].gpuBytes > config.gpuBudgetBytes)
+                continue;
+
+            cell.scene = std::make_unique<Loader::Scene>(Loader::uploadCell(cellData.value(), index.materials));
+            residentBytes += cell.scene->gpuBytes();
+            cell.state = CellState::RESIDENT;
+            uploads++;
+        }
+#pragma endregion
+
+#pragma region Unload far cells
+        for (size_t i = 0; i < cells.size(); i++)
+            if (cells[i].distance > unloadRadius)
+                unload(i);
+#pragma endregion
+
+#pragma region Start new loads
+        size_t loading = loadingCellCount();
+        // Only cells nearer than the one being considered count against the budget,
+        // since farther ones are dropped to make room for it once it's uploaded
+        size_t nearerBytes = 0;
+        for (const size_t i : order) {
+            StreamedCell &cell = cells[i];
+            if (cell.distance > config.loadRadius || loading >= config.maxConcurrentLoads)
+                break;  // Sorted by distance, so nothing after this is in range either
+            if (cell.state == CellState::RESIDENT)
+                nearerBytes += cell.scene->gpuBytes();
+            else if (cell.state == CellState::LOADING)
+                nearerBytes += index.cells[i].gpuBytes;
+            if (cell.state != CellState::UNLOADED || cell.failed)
+                continue;
+            // A smaller cell behind this one might still fit
+            if (nearerBytes + index.cells[i].gpuBytes > config.gpuBudgetBytes)
+                continue;
+
+            cell.pending = std::async(std::launch::async, Loader::loadCell, index.cells[i], index.materials.size());
+            cell.state = CellState::LOADING;
+            nearerBytes += index.cells[i].gpuBytes;
+            loading++;
+        }
+#pragma endregion
+    }
+
+    std::expected<void, std::string> WorldStreamer::draw(const MaterialManager &materialManager, const GraphicsShader &shader, RingBuffer &constants) const {
+        // Cells are already in world space, so they all share one transform
+        auto transformRet = Loader::bindTransform(constants, glm::mat4(1.0f));
+        if (!transformRet.has_value())
+            return std::unexpected(FW_UNEXP(transformRet, "Failed to bind the world's transform"));
+
+        materialManager.bind(shader);
+        for (const StreamedCell &cell : cells)
+            if (cell.state == CellState::RESIDENT)
+                cell.scene->DrawMeshes(shader);
+        return {};
+    }
+
+    void WorldStreamer::requestTextureDetail(MaterialManager &materialManager, const glm::vec3 &cameraPosition, const float pixelScale) const {
+        for (const StreamedCell &cell : cells)
+            if (cell.state == CellState::RESIDENT)
+                materialManager.requestDetail(*cell.scene, glm::mat4(1.0f), cameraPosition, pixelScale);
+    }
+
+    size_t WorldStreamer::residentCellCount() const {
+        return std::ranges::count_if(cells, [](const StreamedCell &cell) { return cell.state == CellState::RESIDENT; });
+    }
+
+    size_t WorldStreamer::loadingCellCount() const {
+        return std::ranges::count_if(cells, [](const StreamedCell &cell) { return cell.state == CellState::LOADING; });
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef MANAGER_WORLD_STREAMER_H
+#define MANAGER_WORLD_STREAMER_H
+
+#include <expected>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include <engine/loader/world.h>
+
+#include "texture.h"
+
+namespace Engine {
+    class GraphicsShader;
+}
+class RingBuffer;
+
+namespace Engine::Manager {
+    class MaterialManager;
+
+    struct StreamingConfig {
+        // Width and depth of each cell. Changing this re-partitions the world
+        float cellSize = 16.0f;
+        // Cells closer than this to the camera are loaded
+        float loadRadius = 32.0f;
+        // Cells are only unloaded once they're this much further than `loadRadius`, so they don't thrash at the border
+        float unloadHysteresis = 8.0f;
+        // Farthest cells are unloaded (and no more are loaded) once resident cells exceed this
+        size_t gpuBudgetBytes = 256 * 1024 * 1024;
+        unsigned int maxConcurrentLoads = 4;
+        // Uploads happen on the render thread, so limit them to avoid hitches when many cells finish at once
+        unsigned int maxUploadsPerFrame = 2;
+    };
+
+    /*!
+     * Streams the cells of a partitioned world in and out around the camera.
+     * Cells are read from disk on worker threads, and uploaded on the render thread in `update`.
+     */
+    class WorldStreamer {
+    private:
+        enum class CellState {
+            UNLOADED,
+            LOADING,
+            RESIDENT
+        };
+        struct StreamedCell {
+            CellState state = CellState::UNLOADED;
+            std::future<std::expected<Loader::CellData, std::string>> pending;
+            std::unique_ptr<Loader::Scene> scene;
+            float distance = 0.0f;
+            bool failed = false;  // Don't retry cells that failed to load
+        };
+
+        Loader::WorldIndex index{};
+        std::vector<StreamedCell> cells;
+        size_t residentBytes = 0;
+
+        TextureManager &textureManager;
+        // Scoped to the world: unloaded with it, since nothing else can load them
+        std::vector<TextureHandle> embeddedTextures;
+
+        void unload(size_t cellIndex);
+
+    public:
+        StreamingConfig config;
+
+        /*!
+         * @param textureManager Where the world's embedded textures are registered. Should be the one the world's material manager uses
+         */
+        explicit WorldStreamer(TextureManager &textureManager, const StreamingConfig &config = {})
+            : textureManager(textureManager), config(config) {}
+
+        /*!
+         * @brief Load the index of a world, partitioning it first if needed, and unload any previous world
+         * @param scenePath The source scene of the world
+         * @param materialManager Where the world's materials are registered, and the previous world's are unregistered from
+         */
+        std::expected<void, std::string> load(const std::string &scenePath, MaterialManager &materialManager);
+
+        /*!
+         * @brief Start loading cells near the camera, upload finished cells and unload far away ones
+         * @note Should be called once per frame, on the render thread
+         */
+        void update(const glm::vec3 &cameraPosition);
+        /*!
+         * @brief Draw every resident cell
+         * @param materialManager The material manager the world was loaded with, bound once for every cell
+         * @param constants Where the transform every cell shares is written, once per call
+         */
+        std::expected<void, std::string> draw(const MaterialManager &materialManager, const GraphicsShader &shader, RingBuffer &constants) const;
+        /*!
+         * @brief Request the texture detail every resident cell needs from where it is on screen (see `MaterialManager::requestDetail`)
+         */
+        void requestTextureDetail(MaterialManager &materialManager, const glm::vec3 &cameraPosition, float pixelScale) const;
+
+        [[nodiscard]] size_t cellCount() const { return cells.size(); }
+        [[nodiscard]] size_t residentCellCount() const;
+        [[nodiscard]] size_t loadingCellCount() const;
+        [[nodiscard]] size_t residentGpuBytes() const { return residentBytes; }
+    };
+}
+
+#endif
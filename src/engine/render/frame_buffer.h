@@ -1,21 +1,28 @@
 #ifndef FRAME_BUFFER_H
 #define FRAME_BUFFER_H
 
+#include <vector>
 
+
+/*!
+ * A framebuffer drawing to existing textures, like the ones from a `RenderTargetPool`.
+ * It doesn't own its textures, so they must outlive it.
+ */
 class FrameBuffer {
 private:
     unsigned int ID{};
 
 public:
-    unsigned int ColorTextureID{};
-    unsigned int DepthStencilTextureID{};
-
-    FrameBuffer(int width, int height);
+    /*!
+     * @param colorTextures Attached as GL_COLOR_ATTACHMENT0 onwards, and drawn to in that order
+     * @param depthTexture The texture on the depth attachment, or 0 for none
+     * @param depthStencil Whether the depth texture also has stencil, so goes on the depth-stencil attachment
+     */
+    explicit FrameBuffer(const std::vector<unsigned int> &colorTextures, unsigned int depthTexture = 0, bool depthStencil = true);
     ~FrameBuffer();
 
-    void resize(int width, int height) const;
-
     void bind() const;
+    [[nodiscard]] unsigned int id() const { return ID; }
 
     // Non-copyable
     FrameBuffer(const FrameBuffer&) = delete;
@@ -0,0 +1,241 @@
+#include "frame_graph.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <gl/glew.h>
+
+#include <engine/logging.h>
+
+
+unsigned int FrameGraph::PassResources::texture(const std::string &name) const {
+    const Resource *resource = graph.find(name);
+    return resource ? resource->texture : 0;
+}
+
+RenderTargetDesc FrameGraph::PassResources::desc(const std::string &name) const {
+    const Resource *resource = graph.find(name);
+    return resource ? resource->desc : RenderTargetDesc{0, 0, 0};
+}
+
+const FrameGraph::Resource *FrameGraph::find(const std::string &name) const {
+    const auto it = resourceIds.find(name);
+    return it != resourceIds.end() ? &resources[it->second] : nullptr;
+}
+
+void FrameGraph::beginFrame() {
+    resources.clear();
+    resourceIds.clear();
+    passes.clear();
+    order.clear();
+    compiled = false;
+}
+
+void FrameGraph::createTexture(const std::string &name, const RenderTargetDesc &desc) {
+    if (resourceIds.try_emplace(name, resources.size()).second)
+        resources.push_back({.name = name, .desc = desc, .imported = false});
+    else
+        logWarn("Frame graph resource \"%s\" was declared twice, keeping the first", name.c_str());
+}
+
+void FrameGraph::importBackbuffer(const std::string &name, const int width, const int height) {
+    if (resourceIds.try_emplace(name, resources.size()).second)
+        resources.push_back({.name = name, .desc = {width, height, GL_RGBA8}, .imported = true});
+    else
+        logWarn("Frame graph resource \"%s\" was declared twice, keeping the first", name.c_str());
+}
+
+void FrameGraph::addPass(const std::string &name, const std::vector<std::string> &reads, const std::vector<std::string> &writes, Execute execute) {
+    passes.push_back({.name = name, .readNames = reads, .writeNames = writes, .execute = std::move(execute)});
+    compiled = false;
+}
+
+void FrameGraph::cull() {
+    // Work back from the passes drawing to the screen, keeping every pass that writes something a kept pass reads
+    std::vector<size_t> stack;
+    for (size_t i = 0; i < passes.size(); i++) {
+        if (std::ranges::any_of(passes[i].writes, [&](const size_t resource) { return resources[resource].imported; })) {
+            passes[i].culled = false;
+            stack.push_back(i);
+        }
+    }
+    while (!stack.empty()) {
+        const size_t pass = stack.back();
+        stack.pop_back();
+        for (const size_t resource : passes[pass].reads) {
+            for (const size_t writer : resources[resource].writers) {
+                if (passes[writer].culled) {
+                    passes[writer].culled = false;
+                    stack.push_back(writer);
+                }
+            }
+        }
+    }
+}
+
+std::expected<void, std::string> FrameGraph::sort() {
+    std::vector<std::vector<size_t>> successors(passes.size());
+    std::vector<size_t> dependencies(passes.size(), 0);
+    const auto addEdge = [&](const size_t from, const size_t to) {
+        successors[from].push_back(to);
+        dependencies[to]++;
+    };
+    for (const Resource &resource : resources) {
+        std::vector<size_t> writers;
+        for (const size_t writer : resource.writers)
+            if (!passes[writer].culled)
+                writers.push_back(writer);
+        if (writers.empty())
+            continue;
+        for (size_t i = 1; i < writers.size(); i++)
+            addEdge(writers[i - 1], writers[i]);
+        for (const size_t reader : resource.readers)
+            if (!passes[reader].culled && std::ranges::find(writers, reader) == writers.end())
+                addEdge(writers.back(), reader);
+    }
+
+    // Passes that could run at the same point keep the order they were declared in
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<>> ready;
+    size_t kept = 0;
+    for (size_t i = 0; i < passes.size(); i++) {
+        if (passes[i].culled)
+            continue;
+        kept++;
+        if (dependencies[i] == 0)
+            ready.push(i);
+    }
+    while (!ready.empty()) {
+        const size_t pass = ready.top();
+        ready.pop();
+        order.push_back(pass);
+        for (const size_t next : successors[pass])
+            if (--dependencies[next] == 0)
+                ready.push(next);
+    }
+
+    if (order.size() != kept) {
+        const auto stuck = std::ranges::find_if(passes, [&](const Pass &pass) {
+            return !pass.culled && std::ranges::find(order, static_cast<size_t>(&pass - passes.data())) == order.end();
+        });
+        return UNEXPECTED_REF("Frame graph passes depend on each other in a cycle, including \"" + stuck->name + "\"");
+    }
+    return {};
+}
+
+void FrameGraph::allocate() {
+    for (size_t position = 0; position < order.size(); position++) {
+        const Pass &pass = passes[order[position]];
+        for (const std::vector<size_t> *used : {&pass.reads, &pass.writes}) {
+            for (const size_t resource : *used) {
+                resources[resource].firstUse = std::min(resources[resource].firstUse, position);
+                resources[resource].lastUse = std::max(resources[resource].lastUse, position);
+            }
+        }
+    }
+
+    // Walk through the passes in order, holding each target from its first use to its last,
+    // so a later target of the same size and format gets the texture of one that's done with
+    for (size_t position = 0; position < order.size(); position++) {
+        const Pass &pass = passes[order[position]];
+        for (const std::vector<size_t> *used : {&pass.reads, &pass.writes})
+            for (const size_t index : *used)
+                if (Resource &resource = resources[index]; !resource.imported && resource.texture == 0)
+                    resource.texture = pool.acquire(resource.desc);
+        for (const std::vector<size_t> *used : {&pass.reads, &pass.writes})
+            for (const size_t index : *used)
+                if (const Resource &resource = resources[index]; !resource.imported && resource.lastUse == position)
+                    pool.release(resource.texture);
+    }
+}
+
+std::expected<unsigned int, std::string> FrameGraph::getFramebuffer(const Pass &pass) {
+    std::vector<unsigned int> colorTargets;
+    unsigned int depthTarget = 0;
+    for (const size_t index : pass.writes) {
+        const Resource &resource = resources[index];
+        if (resource.imported)
+            continue;
+        if (!Engine::Render::isDepthFormat(resource.desc.internalFormat))
+            colorTargets.push_back(resource.texture);
+        else if (depthTarget == 0)
+            depthTarget = resource.texture;
+        else
+            return UNEXPECTED_REF("Pass \"" + pass.name + "\" writes to more than one depth target");
+    }
+    if (colorTargets.empty() && depthTarget == 0)
+        return 0;
+    if (colorTargets.size() + (depthTarget != 0 ? 1 : 0) != pass.writes.size())
+        return UNEXPECTED_REF("Pass \"" + pass.name + "\" writes to both textures and the backbuffer");
+
+    auto framebuffer = pool.getFramebuffer(colorTargets, depthTarget);
+    if (!framebuffer.has_value())
+        return std::unexpected(FW_UNEXP(framebuffer, "Failed to get a framebuffer for pass \"" + pass.name + "\""));
+    return framebuffer.value()->id();
+}
+
+std::expected<void, std::string> FrameGraph::compile() {
+    compiled = false;
+    order.clear();
+    for (Resource &resource : resources) {
+        resource.writers.clear();
+        resource.readers.clear();
+        resource.firstUse = SIZE_MAX;
+        resource.lastUse = 0;
+        resource.texture = 0;
+    }
+
+    for (size_t i = 0; i < passes.size(); i++) {
+        Pass &pass = passes[i];
+        pass.culled = true;
+        pass.reads.clear();
+        pass.writes.clear();
+        for (const std::string &name : pass.readNames) {
+            const auto it = resourceIds.find(name);
+            if (it == resourceIds.end())
+                return UNEXPECTED_REF("Pass \"" + pass.name + "\" reads undeclared resource \"" + name + "\"");
+            pass.reads.push_back(it->second);
+            resources[it->second].readers.push_back(i);
+        }
+        for (const std::string &name : pass.writeNames) {
+            const auto it = resourceIds.find(name);
+            if (it == resourceIds.end())
+                return UNEXPECTED_REF("Pass \"" + pass.name + "\" writes undeclared resource \"" + name + "\"");
+            pass.writes.push_back(it->second);
+            resources[it->second].writers.push_back(i);
+        }
+    }
+
+    cull();
+    auto sortRet = sort();
+    if (!sortRet.has_value())
+        return std::unexpected(FW_UNEXP(sortRet, "Failed to order frame graph passes"));
+    allocate();
+    for (const size_t index : order) {
+        auto framebuffer = getFramebuffer(passes[index]);
+        if (!framebuffer.has_value())
+            return std::unexpected(FW_UNEXP(framebuffer, "Failed to allocate frame graph targets"));
+        passes[index].framebuffer = framebuffer.value();
+    }
+    compiled = true;
+    return {};
+}
+
+void FrameGraph::execute() const {
+    if (!compiled)
+        return;
+    const PassResources passResources(*this);
+    for (const size_t index : order) {
+        const Pass &pass = passes[index];
+        const RenderTargetDesc &target = resources[pass.writes.front()].desc;
+        glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+        glViewport(0, 0, target.width, target.height);
+        pass.execute(passResources);
+    }
+}
+
+std::vector<std::string> FrameGraph::getPassOrder() const {
+    std::vector<std::string> names;
+    for (const size_t index : order)
+        names.push_back(passes[index].name);
+    return names;
+}
@@ -0,0 +1,125 @@
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "render_target_pool.h"
+
+/*!
+ * Describes a frame's rendering as passes that read and write named resources, then works out how to run it.
+ * Passes that nothing visible depends on are culled, the rest are ordered by their dependencies,
+ * and transient render targets are acquired from a pool when they're first used and released after their last use,
+ * so targets of the same size and format whose lifetimes don't overlap share a texture.
+ * The graph is declared again every frame, between `beginFrame` and `compile`.
+ */
+class FrameGraph {
+public:
+    /*!
+     * What a pass can look up while it runs.
+     */
+    class PassResources {
+    private:
+        const FrameGraph &graph;
+
+    public:
+        explicit PassResources(const FrameGraph &graph) : graph(graph) {}
+
+        /*!
+         * @return The texture behind a transient resource this pass reads or writes, or 0 for imported ones
+         */
+        [[nodiscard]] unsigned int texture(const std::string &name) const;
+        [[nodiscard]] RenderTargetDesc desc(const std::string &name) const;
+    };
+    typedef std::function<void(const PassResources &)> Execute;
+
+private:
+    struct Resource {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported;
+        // Passes in declaration order
+        std::vector<size_t> writers, readers;
+        // Positions in `order` of the first and last pass using it
+        size_t firstUse = SIZE_MAX, lastUse = 0;
+        unsigned int texture = 0;
+    };
+    struct Pass {
+        std::string name;
+        std::vector<std::string> readNames, writeNames;
+        std::vector<size_t> reads, writes;
+        Execute execute;
+        bool culled = true;
+        unsigned int framebuffer = 0;  // 0 for passes that draw to the default framebuffer
+    };
+
+    std::vector<Resource> resources;
+    std::unordered_map<std::string, size_t> resourceIds;
+    std::vector<Pass> passes;
+    std::vector<size_t> order;  // Passes left after culling, in the order they run
+
+    RenderTargetPool &pool;
+    bool compiled = false;
+
+    [[nodiscard]] const Resource *find(const std::string &name) const;
+    void cull();
+    std::expected<void, std::string> sort();
+    void allocate();
+    std::expected<unsigned int, std::string> getFramebuffer(const Pass &pass);
+
+public:
+    /*!
+     * @param pool Where transient targets come from. Its `beginFrame` should be called before this graph's
+     */
+    explicit FrameGraph(RenderTargetPool &pool) : pool(pool) {}
+
+    /*!
+     * @brief Forget last frame's passes and resources
+     */
+    void beginFrame();
+
+    /*!
+     * @brief Declare a render target that only lives for this frame, acquired from the pool when a pass needs it
+     * @note Targets can share a texture with earlier ones, so the first pass writing one should clear it
+     */
+    void createTexture(const std::string &name, const RenderTargetDesc &desc);
+    /*!
+     * @brief Declare the default framebuffer. Passes writing to it are what the frame is for, so they are never culled
+     */
+    void importBackbuffer(const std::string &name, int width, int height);
+    /*!
+     * @brief Declare a pass. Passes writing textures draw into a framebuffer with them attached, in the order they're listed
+     * @param reads The resources the pass samples, or draws on top of
+     * @param writes The resources the pass draws to. Either only textures (any number of color targets, and at most one depth target), or only the backbuffer
+     * @note Passes reading a resource run after every pass writing it, and passes writing the same resource run in the order they were declared.
+     * A pass that draws on top of a resource should list it in both
+     */
+    void addPass(const std::string &name, const std::vector<std::string> &reads, const std::vector<std::string> &writes, Execute execute);
+
+    /*!
+     * @brief Cull, order and allocate the declared passes
+     * @return An error message if a pass uses an undeclared resource, the passes depend on each other in a cycle,
+     * or a framebuffer couldn't be made
+     */
+    std::expected<void, std::string> compile();
+    /*!
+     * @brief Run the compiled passes, each with its framebuffer bound and the viewport covering it
+     */
+    void execute() const;
+
+    [[nodiscard]] size_t passCount() const { return passes.size(); }
+    [[nodiscard]] size_t culledPassCount() const { return passes.size() - order.size(); }
+    /*!
+     * @return The names of the passes that run, in order
+     */
+    [[nodiscard]] std::vector<std::string> getPassOrder() const;
+
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+};
+
+#endif
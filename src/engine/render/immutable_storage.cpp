@@ -0,0 +1,20 @@
+#include "immutable_storage.h"
+
+#include <gl/glew.h>
+
+
+namespace Engine::Render {
+    bool growStorageBuffer(unsigned int &buffer, size_t &capacity, const size_t count, const size_t elementBytes,
+            const size_t initialCapacity, const size_t headerBytes) {
+        if (buffer != 0 && count <= capacity)
+            return false;
+
+        const size_t newCapacity = growCapacity(capacity, count, initialCapacity);
+        glDeleteBuffers(1, &buffer);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(headerBytes + newCapacity * elementBytes), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        capacity = newCapacity;
+        return true;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef IMMUTABLE_STORAGE_H
+#define IMMUTABLE_STORAGE_H
+
+#include <algorithm>
+#include <cstddef>
+
+// Immutable storage can't be resized, so buffers and texture arrays using it grow geometrically and are recreated
+namespace Engine::Render {
+    /*!
+     * @param capacity The current capacity, or 0 if nothing was allocated yet
+     * @param initialCapacity What doubling starts from when nothing was allocated yet
+     * @return The capacity doubled until it holds `count`
+     */
+    template<typename T>
+    T growCapacity(const T capacity, const T count, const T initialCapacity) {
+        T newCapacity = capacity > 0 ? capacity : std::max(initialCapacity, T{1});
+        while (newCapacity < count)
+            newCapacity *= 2;
+        return newCapacity;
+    }
+
+    /*!
+     * @brief Replace a shader storage buffer with a larger one if it doesn't exist yet or can't hold `count` elements
+     * @param capacity In elements, updated when the buffer is replaced
+     * @param headerBytes Bytes before the first element
+     * @return Whether the buffer was replaced, in which case it's bound to GL_SHADER_STORAGE_BUFFER and its old contents are gone
+     */
+    bool growStorageBuffer(unsigned int &buffer, size_t &capacity, size_t count, size_t elementBytes,
+        size_t initialCapacity, size_t headerBytes = 0);
+}
+
+#endif
@@ -0,0 +1,85 @@
+#include "instance_buffer.h"
+
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+
+#include <engine/render/immutable_storage.h>
+
+
+InstanceBuffer::~InstanceBuffer() {
+    glDeleteBuffers(1, &SSBO);
+}
+
+size_t InstanceBuffer::add(const glm::mat4 &transform) {
+    transforms.push_back(transform);
+    dirty = true;
+    return transforms.size() - 1;
+}
+
+bool InstanceBuffer::set(const size_t index, const glm::mat4 &transform) {
+    if (index >= transforms.size())
+        return false;
+    transforms[index] = transform;
+    dirty = true;
+    return true;
+}
+
+bool InstanceBuffer::remove(const size_t index) {
+    if (index >= transforms.size())
+        return false;
+    transforms[index] = transforms.back();
+    transforms.pop_back();
+    dirty = true;
+    return true;
+}
+
+void InstanceBuffer::clear() {
+    transforms.clear();
+    dirty = true;
+}
+
+void InstanceBuffer::reserveGpu(const size_t instanceCount) {
+    Engine::Render::growStorageBuffer(SSBO, capacity, instanceCount, sizeof(InstanceData), 16);
+}
+
+void InstanceBuffer::upload(const glm::mat4 &baseTransform) {
+    if (!dirty)
+        return;
+    dirty = false;
+    if (transforms.empty())
+        return;
+
+    reserveGpu(transforms.size());
+
+    std::vector<InstanceData> data;
+    data.reserve(transforms.size());
+    for (const glm::mat4 &transform : transforms) {
+        const glm::mat4 model = baseTransform * transform;
+        data.push_back({model, glm::mat3x4(glm::transpose(glm::inverse(glm::mat3(model))))});
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.size() * sizeof(InstanceData), data.data());
+}
+
+void InstanceBuffer::bind() const {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, SSBO);
+}
+
+InstanceBuffer::InstanceBuffer(InstanceBuffer &&other) noexcept
+    : SSBO(other.SSBO), capacity(other.capacity), dirty(other.dirty), transforms(std::move(other.transforms)) {
+    other.SSBO = 0;
+    other.capacity = 0;
+}
+InstanceBuffer &InstanceBuffer::operator=(InstanceBuffer &&other) noexcept {
+    if (this != &other) {
+        glDeleteBuffers(1, &SSBO);
+        SSBO = other.SSBO;
+        capacity = other.capacity;
+        dirty = other.dirty;
+        transforms = std::move(other.transforms);
+        other.SSBO = 0;
+        other.capacity = 0;
+    }
+    return *this;
+}
@@ -0,0 +1,76 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/mat3x4.hpp>
+
+// Must match the binding in vert_instanced.vert
+#define INSTANCE_BUFFER_BINDING 1
+
+/*!
+ * Per-instance data as laid out in the instance SSBO (std430).
+ * The normal matrix is stored as a mat3x4, since std430 pads each mat3 column to a vec4 anyway.
+ */
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3x4 normalMatrix;
+};
+static_assert(sizeof(InstanceData) == 112, "InstanceData must match the std430 layout in vert_instanced.vert");
+
+/*!
+ * A persistent shader storage buffer holding the transforms of every instance of a scene.
+ * Transforms are kept on the CPU and only re-uploaded (along with their normal matrices) when they change.
+ */
+class InstanceBuffer {
+private:
+    unsigned int SSBO{};
+    size_t capacity = 0;  // In instances
+    bool dirty = false;
+
+    std::vector<glm::mat4> transforms;
+
+    void reserveGpu(size_t instanceCount);
+
+public:
+    InstanceBuffer() = default;
+    ~InstanceBuffer();
+
+    /*!
+     * @brief Add an instance
+     * @return The index of the new instance
+     */
+    size_t add(const glm::mat4 &transform);
+    /*!
+     * @brief Replace the transform of an existing instance
+     * @return Whether the index was valid
+     */
+    bool set(size_t index, const glm::mat4 &transform);
+    /*!
+     * @brief Remove an instance by swapping the last instance into its place
+     * @note This invalidates the index of the last instance, which becomes `index`
+     * @return Whether the index was valid
+     */
+    bool remove(size_t index);
+    void clear();
+
+    [[nodiscard]] size_t count() const { return transforms.size(); }
+    [[nodiscard]] const glm::mat4 &transform(const size_t index) const { return transforms[index]; }
+
+    /*!
+     * @brief Upload any changed transforms to the GPU, computing the model and normal matrices
+     * @param baseTransform Multiplied on the left of every instance transform, so it's applied to vertices after it (usually the root node transform, like `Scene::Draw`)
+     */
+    void upload(const glm::mat4 &baseTransform);
+    void bind() const;
+
+    // Non-copyable
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+    // Moveable
+    InstanceBuffer(InstanceBuffer&& other) noexcept;
+    InstanceBuffer& operator=(InstanceBuffer&& other) noexcept;
+};
+
+
+#endif
@@ -0,0 +1,269 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <gl/glew.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <engine/loader/shader/compute_shader.h>
+#include <engine/render/immutable_storage.h>
+#include <engine/util/thread_pool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The cluster index buffer starts with its length
+#define LIGHT_INDEX_HEADER_BYTES 4
+#define CLUSTERS_PER_SLICE (CLUSTER_GRID_X * CLUSTER_GRID_Y)
+static_assert(CLUSTER_GRID_X % 4 == 0, "Rows of clusters are tested 4 at a time");
+
+using Engine::Manager::LightData;
+using Engine::Manager::LightType;
+
+/*!
+ * The view space bounding sphere of a light, and the range of clusters it could reach.
+ */
+struct LightBounds {
+    glm::vec3 center;
+    float radius;
+    int sliceBegin, sliceEnd;  // Inclusive
+    int tileXBegin, tileXEnd;
+    int tileYBegin, tileYEnd;
+};
+
+bool isGlobalLight(const LightData &light) {
+    return light.type == LightType::DIRECTIONAL || std::isinf(light.range);
+}
+
+int getTile(const float ndc, const int tileCount) {
+    return std::clamp(static_cast<int>(std::floor((ndc + 1.0f) * 0.5f * static_cast<float>(tileCount))), 0, tileCount - 1);
+}
+
+LightClusters::LightClusters() : clusterLights(CLUSTER_COUNT), clusters(CLUSTER_COUNT) {}
+
+LightClusters::~LightClusters() {
+    // Only delete what was created, so the CPU path works without a GL context
+    if (clusterSSBO != 0)
+        glDeleteBuffers(1, &clusterSSBO);
+    if (indexSSBO != 0)
+        glDeleteBuffers(1, &indexSSBO);
+    if (boundsSSBO != 0)
+        glDeleteBuffers(1, &boundsSSBO);
+}
+
+void LightClusters::setProjection(const float fovY, const float aspectRatio, const float clipNear, const float clipFar) {
+    if (fovY == this->fovY && aspectRatio == this->aspectRatio && clipNear == this->clipNear && clipFar == this->clipFar)
+        return;
+    this->fovY = fovY;
+    this->aspectRatio = aspectRatio;
+    this->clipNear = clipNear;
+    this->clipFar = clipFar;
+    tanHalfFovY = std::tan(fovY * 0.5f);
+    tanHalfFovX = tanHalfFovY * aspectRatio;
+
+    // Exponential slices keep clusters roughly cube shaped, rather than very thin up close and very deep far away
+    for (int z = 0; z <= CLUSTER_GRID_Z; z++)
+        sliceDepths[z] = clipNear * std::pow(clipFar / clipNear, static_cast<float>(z) / CLUSTER_GRID_Z);
+
+    bounds.resize(CLUSTER_COUNT);
+    for (auto *component : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+        component->resize(CLUSTER_COUNT);
+    for (int z = 0; z < CLUSTER_GRID_Z; z++) {
+        const float nearDepth = sliceDepths[z], farDepth = sliceDepths[z + 1];
+        for (int y = 0; y < CLUSTER_GRID_Y; y++) {
+            const float bottom = (static_cast<float>(y) / CLUSTER_GRID_Y * 2.0f - 1.0f) * tanHalfFovY;
+            const float top = (static_cast<float>(y + 1) / CLUSTER_GRID_Y * 2.0f - 1.0f) * tanHalfFovY;
+            for (int x = 0; x < CLUSTER_GRID_X; x++) {
+                const float left = (static_cast<float>(x) / CLUSTER_GRID_X * 2.0f - 1.0f) * tanHalfFovX;
+                const float right = (static_cast<float>(x + 1) / CLUSTER_GRID_X * 2.0f - 1.0f) * tanHalfFovX;
+                // The tile's edges spread out with depth, so the box has to cover both ends of the slice
+                const glm::vec3 minimum(std::min(left * nearDepth, left * farDepth), std::min(bottom * nearDepth, bottom * farDepth), -farDepth);
+                const glm::vec3 maximum(std::max(right * nearDepth, right * farDepth), std::max(top * nearDepth, top * farDepth), -nearDepth);
+
+                const size_t cluster = x + y * CLUSTER_GRID_X + z * CLUSTERS_PER_SLICE;
+                bounds[cluster] = {glm::vec4(minimum, 0.0f), glm::vec4(maximum, 0.0f)};
+                minX[cluster] = minimum.x;
+                minY[cluster] = minimum.y;
+                minZ[cluster] = minimum.z;
+                maxX[cluster] = maximum.x;
+                maxY[cluster] = maximum.y;
+                maxZ[cluster] = maximum.z;
+            }
+        }
+    }
+    boundsDirty = true;
+}
+
+void LightClusters::findGlobalLights(const std::vector<LightData> &lights) {
+    globalLights.clear();
+    for (size_t i = 0; i < lights.size(); i++)
+        if (isGlobalLight(lights[i]))
+            globalLights.push_back(static_cast<uint32_t>(i));
+}
+
+void LightClusters::assign(const std::vector<LightData> &lights, const glm::mat4 &view) {
+    findGlobalLights(lights);
+
+    // Narrow each light down to the box of clusters around it, so each one is only tested against its neighbours
+    std::vector<LightBounds> lightBounds;
+    std::vector<uint32_t> lightIndices;
+    lightBounds.reserve(lights.size());
+    lightIndices.reserve(lights.size());
+    for (size_t i = 0; i < lights.size(); i++) {
+        const LightData &light = lights[i];
+        if (isGlobalLight(light) || light.range <= 0.0f)
+            continue;
+        const glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        const float radius = light.range;
+        const float depth = -center.z;
+        if (depth + radius < clipNear || depth - radius > clipFar)
+            continue;
+
+        const float nearDepth = std::max(depth - radius, clipNear);
+        const float farDepth = depth + radius;
+        // The first slice ending past the sphere's near side, and the last starting before its far side
+        const int sliceBegin = std::clamp(static_cast<int>(std::lower_bound(sliceDepths + 1, sliceDepths + CLUSTER_GRID_Z + 1, nearDepth) - sliceDepths) - 1, 0, CLUSTER_GRID_Z - 1);
+        const int sliceEnd = std::clamp(static_cast<int>(std::upper_bound(sliceDepths, sliceDepths + CLUSTER_GRID_Z, farDepth) - sliceDepths) - 1, 0, CLUSTER_GRID_Z - 1);
+
+        // Project the sphere's bounding box. Each side is furthest out where it is closest to the camera
+        const float left = center.x - radius, right = center.x + radius;
+        const float bottom = center.y - radius, top = center.y + radius;
+        const float ndcLeft = left / (left < 0.0f ? nearDepth : farDepth) / tanHalfFovX;
+        const float ndcRight = right / (right > 0.0f ? nearDepth : farDepth) / tanHalfFovX;
+        const float ndcBottom = bottom / (bottom < 0.0f ? nearDepth : farDepth) / tanHalfFovY;
+        const float ndcTop = top / (top > 0.0f ? nearDepth : farDepth) / tanHalfFovY;
+        if (ndcRight < -1.0f || ndcLeft > 1.0f || ndcTop < -1.0f || ndcBottom > 1.0f)
+            continue;
+
+        // Padded by a tile, since the cluster bounds are built differently and could round the other way at the edges
+        lightBounds.push_back({
+            center, radius, sliceBegin, sliceEnd,
+            std::max(getTile(ndcLeft, CLUSTER_GRID_X) - 1, 0), std::min(getTile(ndcRight, CLUSTER_GRID_X) + 1, CLUSTER_GRID_X - 1),
+            std::max(getTile(ndcBottom, CLUSTER_GRID_Y) - 1, 0), std::min(getTile(ndcTop, CLUSTER_GRID_Y) + 1, CLUSTER_GRID_Y - 1),
+        });
+        lightIndices.push_back(static_cast<uint32_t>(i));
+    }
+
+    // Each slice only writes to its own clusters, so they can be filled in parallel
+    Engine::ThreadPool::shared().parallelFor(CLUSTER_GRID_Z, [&](const size_t slice) {
+        const auto z = static_cast<int>(slice);
+        for (size_t cluster = slice * CLUSTERS_PER_SLICE; cluster < (slice + 1) * CLUSTERS_PER_SLICE; cluster++)
+            clusterLights[cluster].clear();
+
+        for (size_t i = 0; i < lightBounds.size(); i++) {
+            const LightBounds &light = lightBounds[i];
+            if (z < light.sliceBegin || z > light.sliceEnd)
+                continue;
+            const float radiusSquared = light.radius * light.radius;
+            for (int y = light.tileYBegin; y <= light.tileYEnd; y++) {
+                const size_t row = y * CLUSTER_GRID_X + slice * CLUSTERS_PER_SLICE;
+#ifdef __SSE2__
+                // Squared distance from the sphere's center to 4 boxes at once
+                const __m128 centerX = _mm_set1_ps(light.center.x), centerY = _mm_set1_ps(light.center.y), centerZ = _mm_set1_ps(light.center.z);
+                const __m128 zero = _mm_setzero_ps();
+                for (int x = light.tileXBegin & ~3; x <= light.tileXEnd; x += 4) {
+                    const size_t first = row + x;
+                    const __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[first]), centerX), zero), _mm_max_ps(_mm_sub_ps(centerX, _mm_loadu_ps(&maxX[first])), zero));
+                    const __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[first]), centerY), zero), _mm_max_ps(_mm_sub_ps(centerY, _mm_loadu_ps(&maxY[first])), zero));
+                    const __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[first]), centerZ), zero), _mm_max_ps(_mm_sub_ps(centerZ, _mm_loadu_ps(&maxZ[first])), zero));
+                    const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int hits = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_set1_ps(radiusSquared)));
+                    // Only the tiles within the light's range, for the same results as the scalar path
+                    for (int lane = 0; hits != 0; lane++, hits >>= 1)
+                        if ((hits & 1) != 0 && x + lane >= light.tileXBegin && x + lane <= light.tileXEnd)
+                            clusterLights[first + lane].push_back(lightIndices[i]);
+                }
+#else
+                for (int x = light.tileXBegin; x <= light.tileXEnd; x++) {
+                    const size_t cluster = row + x;
+                    const float dx = std::max(minX[cluster] - light.center.x, 0.0f) + std::max(light.center.x - maxX[cluster], 0.0f);
+                    const float dy = std::max(minY[cluster] - light.center.y, 0.0f) + std::max(light.center.y - maxY[cluster], 0.0f);
+                    const float dz = std::max(minZ[cluster] - light.center.z, 0.0f) + std::max(light.center.z - maxZ[cluster], 0.0f);
+                    if (dx * dx + dy * dy + dz * dz <= radiusSquared)
+                        clusterLights[cluster].push_back(lightIndices[i]);
+                }
+#endif
+            }
+        }
+    });
+
+    indices.assign(globalLights.begin(), globalLights.end());
+    for (size_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+        clusters[cluster] = {static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(clusterLights[cluster].size())};
+        indices.insert(indices.end(), clusterLights[cluster].begin(), clusterLights[cluster].end());
+    }
+}
+
+ClusterHeader LightClusters::getHeader(const float screenWidth, const float screenHeight) const {
+    const float depthScale = CLUSTER_GRID_Z / std::log(clipFar / clipNear);
+    return {
+        .screenSize = {screenWidth, screenHeight},
+        .depthScale = depthScale,
+        .depthBias = -std::log(clipNear) * depthScale,
+        .clipNear = clipNear,
+        .clipFar = clipFar,
+        .globalLightCount = static_cast<uint32_t>(globalLights.size()),
+    };
+}
+
+void LightClusters::reserveGpu(const size_t indexCount) {
+    if (clusterSSBO == 0) {
+        glGenBuffers(1, &clusterSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterSSBO);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(ClusterHeader) + CLUSTER_COUNT * sizeof(glm::uvec2), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTER_BUFFER_BINDING, clusterSSBO);
+    }
+    if (Engine::Render::growStorageBuffer(indexSSBO, indexCapacity, indexCount, sizeof(uint32_t), 1024, LIGHT_INDEX_HEADER_BYTES))
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_BUFFER_BINDING, indexSSBO);
+}
+
+void LightClusters::upload(const int screenWidth, const int screenHeight) {
+    reserveGpu(indices.size());
+
+    const ClusterHeader header = getHeader(static_cast<float>(screenWidth), static_cast<float>(screenHeight));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(ClusterHeader), &header);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(ClusterHeader), CLUSTER_COUNT * sizeof(glm::uvec2), clusters.data());
+
+    const auto indexCount = static_cast<uint32_t>(indices.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(indexCount), &indexCount);
+    if (!indices.empty())
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_HEADER_BYTES, indices.size() * sizeof(uint32_t), indices.data());
+}
+
+void LightClusters::dispatch(const Engine::ComputeShader &shader, const std::vector<LightData> &lights,
+        const glm::mat4 &view, const int screenWidth, const int screenHeight) {
+    findGlobalLights(lights);
+    const size_t localLightCount = lights.size() - globalLights.size();
+    reserveGpu(globalLights.size() + CLUSTER_COUNT * std::min<size_t>(localLightCount, GPU_CLUSTER_AVERAGE_LIGHTS));
+
+    if (boundsDirty || boundsSSBO == 0) {
+        if (boundsSSBO == 0) {
+            glGenBuffers(1, &boundsSSBO);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsSSBO);
+            glBufferStorage(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(ClusterBounds), nullptr, GL_DYNAMIC_STORAGE_BIT);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTER_BOUNDS_BINDING, boundsSSBO);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsSSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, CLUSTER_COUNT * sizeof(ClusterBounds), bounds.data());
+        boundsDirty = false;
+    }
+
+    // The global lights are listed up front, and the clusters claim their ranges after them
+    const ClusterHeader header = getHeader(static_cast<float>(screenWidth), static_cast<float>(screenHeight));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(ClusterHeader), &header);
+    const auto globalCount = static_cast<uint32_t>(globalLights.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(globalCount), &globalCount);
+    if (!globalLights.empty())
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_HEADER_BYTES, globalLights.size() * sizeof(uint32_t), globalLights.data());
+
+    shader.use();
+    shader.setMat4("view", view);
+    shader.setInt("indexCapacity", static_cast<int>(indexCapacity));
+    glDispatchCompute(1, 1, CLUSTER_GRID_Z);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,121 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include <engine/manager/light.h>
+
+namespace Engine {
+    class ComputeShader;
+}
+
+// Must match lights.glsl. The view frustum is split into X by Y screen tiles and Z exponentially deeper slices
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+// Must match the bindings in lights.glsl and light_clusters.comp
+#define LIGHT_CLUSTER_BUFFER_BINDING 4
+#define LIGHT_INDEX_BUFFER_BINDING 5
+#define LIGHT_CLUSTER_BOUNDS_BINDING 6
+// How many lights per cluster the index buffer has room for when clustering on the GPU, which can't grow it
+#define GPU_CLUSTER_AVERAGE_LIGHTS 32
+
+/*!
+ * The start of the cluster SSBO (std430), followed by the offset and count of every cluster's lights.
+ */
+struct ClusterHeader {
+    glm::vec2 screenSize;
+    float depthScale;  // Slice = log(depth) * depthScale + depthBias
+    float depthBias;
+    float clipNear;
+    float clipFar;
+    uint32_t globalLightCount;
+    uint32_t padding;
+};
+static_assert(sizeof(ClusterHeader) == 32, "ClusterHeader must match the std430 layout in lights.glsl");
+
+/*!
+ * The view space bounding box of a cluster, as laid out in the bounds SSBO (std430).
+ */
+struct ClusterBounds {
+    glm::vec4 min;
+    glm::vec4 max;
+};
+static_assert(sizeof(ClusterBounds) == 32, "ClusterBounds must match the std430 layout in light_clusters.comp");
+
+/*!
+ * Clustered forward lighting. Every frame, each light is listed in the clusters its range reaches,
+ * so fragments only shade the lights in their own cluster instead of every light in the level.
+ * Lights without a finite range (like directional lights) are listed once, and reach every cluster.
+ * Clustering runs either on the CPU (`assign`, then `upload`) or in a compute shader (`dispatch`).
+ */
+class LightClusters {
+private:
+    // The projection the bounds were built for
+    float fovY = 0.0f, aspectRatio = 0.0f, clipNear = 0.0f, clipFar = 0.0f;
+    std::vector<ClusterBounds> bounds;
+    // The bounds again, one array per component, so the CPU can test 4 clusters at once
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    float sliceDepths[CLUSTER_GRID_Z + 1]{};
+    float tanHalfFovX = 0.0f, tanHalfFovY = 0.0f;
+
+    std::vector<uint32_t> globalLights;
+    std::vector<std::vector<uint32_t>> clusterLights;  // Reused every frame to keep their allocations
+    std::vector<glm::uvec2> clusters;  // Offset into `indices` and count of each cluster
+    std::vector<uint32_t> indices;
+
+    unsigned int clusterSSBO{}, indexSSBO{}, boundsSSBO{};
+    size_t indexCapacity = 0;
+    bool boundsDirty = true;
+
+    void reserveGpu(size_t indexCount);
+    void findGlobalLights(const std::vector<Engine::Manager::LightData> &lights);
+    [[nodiscard]] ClusterHeader getHeader(float screenWidth, float screenHeight) const;
+
+public:
+    LightClusters();
+    ~LightClusters();
+
+    /*!
+     * @brief Rebuild the cluster bounds if the projection changed
+     * @param fovY Vertical field of view, in radians
+     */
+    void setProjection(float fovY, float aspectRatio, float clipNear, float clipFar);
+
+    /*!
+     * @brief Work out which lights reach each cluster on the CPU, using every core
+     * @param lights The lights, in the order they are in the light buffer
+     * @param view The view matrix to cluster for
+     * @note Doesn't touch OpenGL, so the results can be read back with `getClusters` and `getIndices`
+     */
+    void assign(const std::vector<Engine::Manager::LightData> &lights, const glm::mat4 &view);
+    /*!
+     * @brief Upload the results of `assign` for the fragment shaders
+     */
+    void upload(int screenWidth, int screenHeight);
+    /*!
+     * @brief Cluster the lights already in the light buffer on the GPU instead
+     * @param shader The light_clusters.comp compute shader
+     * @note Past GPU_CLUSTER_AVERAGE_LIGHTS lights per cluster on average, the last clusters to be filled lose lights
+     */
+    void dispatch(const Engine::ComputeShader &shader, const std::vector<Engine::Manager::LightData> &lights,
+        const glm::mat4 &view, int screenWidth, int screenHeight);
+
+    [[nodiscard]] const std::vector<glm::uvec2> &getClusters() const { return clusters; }
+    /*!
+     * @return The light indices, starting with the global lights, then each cluster's lights
+     */
+    [[nodiscard]] const std::vector<uint32_t> &getIndices() const { return indices; }
+    [[nodiscard]] const std::vector<ClusterBounds> &getBounds() const { return bounds; }
+    [[nodiscard]] size_t getGlobalLightCount() const { return globalLights.size(); }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "render_target_pool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <gl/glew.h>
+
+#include <engine/logging.h>
+
+
+namespace Engine::Render {
+    bool isDepthFormat(const unsigned int internalFormat) {
+        switch (internalFormat) {
+            case GL_DEPTH_COMPONENT16: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32: case GL_DEPTH_COMPONENT32F:
+            case GL_DEPTH24_STENCIL8: case GL_DEPTH32F_STENCIL8:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+static bool hasStencil(const unsigned int internalFormat) {
+    return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+/*!
+ * @return Roughly how many bytes a pixel of a render target format takes. Drivers pad 3 channel formats to 4
+ */
+static size_t getBytesPerPixel(const unsigned int internalFormat) {
+    switch (internalFormat) {
+        case GL_R8: return 1;
+        case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+        case GL_RGB16F: case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+        case GL_RGB32F: case GL_RGBA32F: return 16;
+        default: return 4;
+    }
+}
+
+RenderTargetPool::RenderTargetPool(const int screenWidth, const int screenHeight)
+    : screenWidth(screenWidth), screenHeight(screenHeight), pendingWidth(screenWidth), pendingHeight(screenHeight) {}
+
+RenderTargetPool::~RenderTargetPool() {
+    framebuffers.clear();
+    for (const auto &[desc, pooled] : targets)
+        for (const Target &target : pooled)
+            glDeleteTextures(1, &target.id);
+}
+
+void RenderTargetPool::requestResize(const int width, const int height) {
+    if (width == pendingWidth && height == pendingHeight)
+        return;
+    pendingWidth = width;
+    pendingHeight = height;
+    pendingFrames = 0;
+}
+
+void RenderTargetPool::freeTarget(const unsigned int id) {
+    // Framebuffers can't outlive their attachments
+    std::erase_if(framebuffers, [&](const auto &framebuffer) {
+        return std::ranges::find(framebuffer.first, id) != framebuffer.first.end();
+    });
+    glDeleteTextures(1, &id);
+    descs.erase(id);
+}
+
+void RenderTargetPool::beginFrame() {
+    frame++;
+    if ((pendingWidth != screenWidth || pendingHeight != screenHeight) && ++pendingFrames >= RENDER_TARGET_RESIZE_SETTLE_FRAMES) {
+        logDebug("Resizing screen render targets from %dx%d to %dx%d", screenWidth, screenHeight, pendingWidth, pendingHeight);
+        screenWidth = pendingWidth;
+        screenHeight = pendingHeight;
+    }
+
+    for (auto it = targets.begin(); it != targets.end();) {
+        std::erase_if(it->second, [&](Target &target) {
+            target.inUse = false;
+            if (frame - target.lastUsedFrame <= RENDER_TARGET_UNUSED_FRAMES)
+                return false;
+            freeTarget(target.id);
+            return true;
+        });
+        it = it->second.empty() ? targets.erase(it) : std::next(it);
+    }
+}
+
+unsigned int RenderTargetPool::acquire(const RenderTargetDesc &desc) {
+    std::vector<Target> &pooled = targets[desc];
+    // Prefer the target used most recently, so the others can go unused long enough to be freed
+    Target *best = nullptr;
+    for (Target &target : pooled)
+        if (!target.inUse && (!best || target.lastUsedFrame > best->lastUsedFrame))
+            best = &target;
+
+    if (!best) {
+        unsigned int id = 0;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexStorage2D(GL_TEXTURE_2D, 1, desc.internalFormat, desc.width, desc.height);
+        // Targets aren't necessarily drawn at the size of the screen, so they might need to be interpolated
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        descs.emplace(id, desc);
+        best = &pooled.emplace_back(Target{id, frame, false});
+    }
+    best->inUse = true;
+    best->lastUsedFrame = frame;
+    return best->id;
+}
+
+void RenderTargetPool::release(const unsigned int id) {
+    const auto desc = descs.find(id);
+    if (desc == descs.end())
+        return;
+    for (Target &target : targets[desc->second])
+        if (target.id == id)
+            target.inUse = false;
+}
+
+std::expected<const FrameBuffer *, std::string> RenderTargetPool::getFramebuffer(const std::vector<unsigned int> &colorTargets, const unsigned int depthTarget) {
+    std::vector<unsigned int> key = colorTargets;
+    key.push_back(depthTarget);
+    if (const auto it = framebuffers.find(key); it != framebuffers.end())
+        return &it->second;
+
+    for (const unsigned int id : key)
+        if (id != 0 && !descs.contains(id))
+            return UNEXPECTED_REF("Texture " + std::to_string(id) + " isn't a target from this pool");
+    const bool depthStencil = depthTarget != 0 && hasStencil(descs.at(depthTarget).internalFormat);
+    try {
+        return &framebuffers.try_emplace(std::move(key), colorTargets, depthTarget, depthStencil).first->second;
+    } catch (const std::runtime_error &error) {
+        return UNEXPECTED_REF(error.what());
+    }
+}
+
+size_t RenderTargetPool::count() const {
+    return descs.size();
+}
+
+size_t RenderTargetPool::gpuBytes() const {
+    size_t bytes = 0;
+    for (const auto &[desc, pooled] : targets)
+        bytes += pooled.size() * static_cast<size_t>(desc.width) * static_cast<size_t>(desc.height) * getBytesPerPixel(desc.internalFormat);
+    return bytes;
+}
@@ -0,0 +1,118 @@
+#ifndef RENDER_TARGET_POOL_H
+#define RENDER_TARGET_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_buffer.h"
+
+// Pooled targets that haven't been acquired for this many frames are freed
+#define RENDER_TARGET_UNUSED_FRAMES 3
+// A new screen size only takes effect once it has stayed the same for this many frames, so dragging the window doesn't reallocate every frame
+#define RENDER_TARGET_RESIZE_SETTLE_FRAMES 3
+
+/*!
+ * The size and format of a render target texture.
+ */
+struct RenderTargetDesc {
+    int width;
+    int height;
+    unsigned int internalFormat;  // GL_RGB8, GL_RGBA16F, GL_DEPTH24_STENCIL8...
+
+    bool operator==(const RenderTargetDesc &) const = default;
+};
+
+struct RenderTargetDescHash {
+    size_t operator()(const RenderTargetDesc &desc) const {
+        return std::hash<uint64_t>{}((static_cast<uint64_t>(desc.width) << 40) ^ (static_cast<uint64_t>(desc.height) << 20) ^ desc.internalFormat);
+    }
+};
+
+namespace Engine::Render {
+    /*!
+     * @return Whether a format goes on a framebuffer's depth attachment rather than a color attachment
+     */
+    bool isDepthFormat(unsigned int internalFormat);
+}
+
+/*!
+ * Render target textures with immutable storage, kept between frames and handed out by size and format.
+ * Released targets are reused by the next request for the same size and format, so they're only allocated when a new size is first needed.
+ * Also caches a framebuffer for every combination of targets drawn to together.
+ */
+class RenderTargetPool {
+private:
+    struct Target {
+        unsigned int id;
+        uint64_t lastUsedFrame;
+        bool inUse;
+    };
+
+    std::unordered_map<RenderTargetDesc, std::vector<Target>, RenderTargetDescHash> targets;
+    std::unordered_map<unsigned int, RenderTargetDesc> descs;  // Of every target, by texture
+    // Framebuffers by their color attachments, then their depth attachment (or 0)
+    std::map<std::vector<unsigned int>, FrameBuffer> framebuffers;
+    uint64_t frame = 0;
+
+    int screenWidth, screenHeight;
+    int pendingWidth, pendingHeight;
+    unsigned int pendingFrames = 0;  // Frames the pending size has stayed the same
+
+    void freeTarget(unsigned int id);
+
+public:
+    RenderTargetPool(int screenWidth, int screenHeight);
+    ~RenderTargetPool();
+
+    /*!
+     * @brief Ask for screen sized targets to change size. Only the last size asked for is used, once it has settled (see `beginFrame`)
+     */
+    void requestResize(int width, int height);
+    /*!
+     * @brief Apply a settled resize, free targets that have gone unused for a while, and release every target for reuse
+     * @note Should be called once per frame, before any target is acquired
+     */
+    void beginFrame();
+    /*!
+     * @return The size screen sized targets should be this frame, which lags behind the window while it's being resized
+     */
+    [[nodiscard]] int width() const { return screenWidth; }
+    [[nodiscard]] int height() const { return screenHeight; }
+
+    /*!
+     * @return A target of this size and format that isn't in use, allocating one if needed
+     */
+    unsigned int acquire(const RenderTargetDesc &desc);
+    /*!
+     * @brief Let a target be acquired again this frame
+     * @note Whatever was drawn to it is kept, but the next user should expect it to hold garbage
+     */
+    void release(unsigned int id);
+
+    /*!
+     * @param colorTargets Attached as GL_COLOR_ATTACHMENT0 onwards, and drawn to in that order
+     * @param depthTarget The target on the depth attachment, or 0 for none
+     * @return A framebuffer with these targets attached, or an error message if that combination isn't complete
+     */
+    std::expected<const FrameBuffer *, std::string> getFramebuffer(const std::vector<unsigned int> &colorTargets, unsigned int depthTarget = 0);
+
+    /*!
+     * @return The number of targets in the pool, including ones not in use
+     */
+    [[nodiscard]] size_t count() const;
+    /*!
+     * @return An estimate of the pool's GPU memory
+     */
+    [[nodiscard]] size_t gpuBytes() const;
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+};
+
+#endif
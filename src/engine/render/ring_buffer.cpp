@@ -0,0 +1,122 @@
+#include "ring_buffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <gl/glew.h>
+
+#include <engine/logging.h>
+
+
+RingBuffer::RingBuffer(const size_t frameCapacity) {
+    GLint uniformAlignment = 0, storageAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+    alignment = static_cast<size_t>(std::max({uniformAlignment, storageAlignment, 1}));
+    // Every region starts aligned too
+    this->frameCapacity = (frameCapacity + alignment - 1) / alignment * alignment;
+    createStorage();
+}
+
+RingBuffer::~RingBuffer() {
+    destroyStorage();
+}
+
+void RingBuffer::createStorage() {
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const auto totalBytes = static_cast<GLsizeiptr>(frameCapacity * FRAMES_IN_FLIGHT);
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, totalBytes, nullptr, flags);
+    mapped = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalBytes, flags));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!mapped)
+        throw std::runtime_error("Failed to map ring buffer");
+}
+
+void RingBuffer::destroyStorage() {
+    for (void *&fence : fences) {
+        if (fence)
+            glDeleteSync(static_cast<GLsync>(fence));
+        fence = nullptr;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    mapped = nullptr;
+}
+
+void RingBuffer::reserve(const size_t frameCapacity) {
+    requestedCapacity = std::max(requestedCapacity, frameCapacity);
+}
+
+void RingBuffer::beginFrame() {
+    if (inFrame)
+        endFrame();
+    if (requestedCapacity > frameCapacity) {
+        // Draws still reading the old buffer keep it alive until they finish, so there's nothing to wait for
+        logDebug("Growing ring buffer regions from %zu to %zu KiB", frameCapacity / 1024, requestedCapacity / 1024);
+        destroyStorage();
+        frameCapacity = (requestedCapacity + alignment - 1) / alignment * alignment;
+        createStorage();
+    }
+    region = (region + 1) % FRAMES_IN_FLIGHT;
+    head = 0;
+    demand = 0;
+    inFrame = true;
+
+    const auto fence = static_cast<GLsync>(fences[region]);
+    if (!fence)
+        return;
+    // Flushing makes sure the fence actually reaches the GPU
+    GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        logDebug("Waiting for the GPU to finish a frame before reusing its constants");
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+    }
+    if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+        logWarn("Gave up waiting for the GPU to finish with ring buffer region %u", region);
+    glDeleteSync(fence);
+    fences[region] = nullptr;
+}
+
+void RingBuffer::endFrame() {
+    if (!inFrame)
+        return;
+    inFrame = false;
+    if (demand > frameCapacity) {
+        logWarn("A frame needed %zu KiB of constants, but only had %zu KiB. Growing the ring buffer", demand / 1024, frameCapacity / 1024);
+        reserve(std::max(demand, frameCapacity * 2));
+    }
+    if (head == 0)
+        return;  // Nothing to protect
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+std::optional<RingAllocation> RingBuffer::allocate(const size_t size) {
+    if (!inFrame)
+        return std::nullopt;
+    demand = (demand + alignment - 1) / alignment * alignment + size;
+    peakBytes = std::max(peakBytes, demand);
+    const size_t offset = (head + alignment - 1) / alignment * alignment;
+    if (offset + size > frameCapacity)
+        return std::nullopt;
+
+    head = offset + size;
+    const size_t bufferOffset = region * frameCapacity + offset;
+    return RingAllocation{bufferOffset, size, mapped + bufferOffset};
+}
+
+void RingBuffer::bind(const unsigned int target, const unsigned int binding, const RingAllocation &allocation) const {
+    glBindBufferRange(target, binding, buffer, static_cast<GLintptr>(allocation.offset), static_cast<GLsizeiptr>(allocation.size));
+}
+
+void RingBuffer::copy(const RingAllocation &allocation, const unsigned int destination, const size_t destinationOffset) const {
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.offset),
+        static_cast<GLintptr>(destinationOffset), static_cast<GLsizeiptr>(allocation.size));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
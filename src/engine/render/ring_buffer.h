@@ -0,0 +1,107 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+// How many frames the CPU can get ahead of the GPU. Each has its own region of the ring
+#define FRAMES_IN_FLIGHT 3
+
+/*!
+ * A region of a ring buffer, valid until the end of the frame it was allocated in.
+ */
+struct RingAllocation {
+    size_t offset;
+    size_t size;
+    unsigned char *data;  // Writes are visible to the GPU without flushing
+};
+
+/*!
+ * A persistently mapped buffer of per-frame and per-draw constants, split into one region per frame in flight.
+ * Each frame's allocations are handed out in order from its region, which is only written to again
+ * once the GPU has signalled the fence placed after that frame, so writes never wait on draws still reading older data.
+ * Allocations can be bound as uniform or shader storage buffer ranges.
+ */
+class RingBuffer {
+private:
+    unsigned int buffer{};
+    unsigned char *mapped = nullptr;
+    size_t frameCapacity;
+    size_t alignment = 256;  // The larger of the uniform and shader storage buffer offset alignments
+
+    unsigned int region = 0;  // The current frame's region
+    size_t head = 0;  // Offset of the next allocation, within the region
+    size_t demand = 0;  // Bytes the current frame asked for, including allocations that didn't fit
+    size_t peakBytes = 0;
+    size_t requestedCapacity = 0;  // Per region, applied by the next `beginFrame`
+    void *fences[FRAMES_IN_FLIGHT]{};  // GLsync, placed after the last frame that used each region
+    bool inFrame = false;
+
+    void createStorage();
+    void destroyStorage();
+
+public:
+    /*!
+     * @param frameCapacity The bytes each frame can allocate. No single allocation can be larger than this
+     */
+    explicit RingBuffer(size_t frameCapacity);
+    ~RingBuffer();
+
+    /*!
+     * @brief Move on to the next frame's region, waiting for the GPU to finish with it if it's still in use.
+     * If a frame ran out of memory, or more was reserved, the buffer is reallocated larger first
+     * @note Allocations from earlier frames must not be bound after this
+     */
+    void beginFrame();
+    /*!
+     * @brief Place a fence after every command using this frame's allocations
+     */
+    void endFrame();
+    /*!
+     * @brief Make every frame's region at least this large, from the next `beginFrame` on
+     */
+    void reserve(size_t frameCapacity);
+
+    /*!
+     * @brief Allocate a region of the current frame's memory
+     * @param size The size of the region in bytes
+     * @return The region, or nothing if the frame is out of memory
+     */
+    std::optional<RingAllocation> allocate(size_t size);
+    /*!
+     * @brief Allocate a region and copy a value into it
+     */
+    template<typename T>
+    std::optional<RingAllocation> push(const T &value) {
+        std::optional<RingAllocation> allocation = allocate(sizeof(T));
+        if (allocation.has_value())
+            std::memcpy(allocation->data, &value, sizeof(T));
+        return allocation;
+    }
+
+    /*!
+     * @brief Bind an allocation to an indexed binding point
+     * @param target GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER
+     */
+    void bind(unsigned int target, unsigned int binding, const RingAllocation &allocation) const;
+    /*!
+     * @brief Copy an allocation into another buffer on the GPU, for data that outlives the frame
+     */
+    void copy(const RingAllocation &allocation, unsigned int destination, size_t destinationOffset) const;
+
+    [[nodiscard]] unsigned int id() const { return buffer; }
+    [[nodiscard]] size_t capacity() const { return frameCapacity; }
+    /*!
+     * @return The most bytes any frame has asked for so far, including alignment padding and allocations that didn't fit
+     */
+    [[nodiscard]] size_t peak() const { return peakBytes; }
+
+    // Non-copyable
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+};
+
+
+#endif
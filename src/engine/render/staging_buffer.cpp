@@ -0,0 +1,84 @@
+#include "staging_buffer.h"
+
+#include <stdexcept>
+#include <gl/glew.h>
+
+// Keeps every allocation suitably aligned for any pixel type
+#define STAGING_ALIGNMENT 16
+
+
+StagingBuffer::StagingBuffer(const size_t capacity) : capacity(capacity) {
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &PBO);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, flags);
+    mapped = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(capacity), flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!mapped)
+        throw std::runtime_error("Failed to map staging buffer");
+}
+
+StagingBuffer::~StagingBuffer() {
+    for (const Fence &fence : fences)
+        glDeleteSync(static_cast<GLsync>(fence.sync));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &PBO);
+}
+
+std::optional<size_t> StagingBuffer::allocate(const size_t size) {
+    size_t offset = (head + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    if (offset + size > capacity)
+        offset = 0;  // Wrap around, skipping the end of the buffer
+
+    // Skipped bytes stay in use until this allocation is retired
+    const size_t consumed = offset >= head ? offset + size - head : capacity - head + size;
+    if (size > capacity || usedBytes + consumed > capacity)
+        return std::nullopt;
+
+    head = offset + size;
+    usedBytes += consumed;
+    unfencedBytes += consumed;
+    return offset;
+}
+
+uint64_t StagingBuffer::fence() {
+    if (unfencedBytes == 0)
+        return lastFence;
+
+    fences.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), unfencedBytes, ++lastFence});
+    unfencedBytes = 0;
+    return lastFence;
+}
+
+void StagingBuffer::retire(const bool wait) {
+    bool first = true;
+    while (!fences.empty()) {
+        const Fence &fence = fences.front();
+        // Only the first wait may block. Flushing makes sure the fence actually reaches the GPU
+        const GLuint64 timeout = wait && first ? 1'000'000'000 : 0;
+        const GLenum status = glClientWaitSync(static_cast<GLsync>(fence.sync), GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+
+        glDeleteSync(static_cast<GLsync>(fence.sync));
+        usedBytes -= fence.bytes;
+        lastRetired = fence.id;
+        fences.pop_front();
+        first = false;
+    }
+
+    // Start from the beginning again when nothing is in flight, so large allocations don't have to wrap
+    if (usedBytes == 0)
+        head = 0;
+}
+
+void StagingBuffer::bind() const {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+}
+
+void StagingBuffer::unbind() {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,76 @@
+#ifndef STAGING_BUFFER_H
+#define STAGING_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+/*!
+ * A persistently mapped pixel unpack buffer, used as a ring of staging memory for texture uploads.
+ * Regions are handed out in order, and only reused once the GPU has signalled the fence placed after them.
+ */
+class StagingBuffer {
+private:
+    struct Fence {
+        void *sync;  // GLsync
+        size_t bytes;
+        uint64_t id;
+    };
+
+    unsigned int PBO{};
+    unsigned char *mapped = nullptr;
+    size_t capacity;
+
+    size_t head = 0;  // Offset of the next allocation
+    size_t usedBytes = 0;  // Allocated and not yet retired, including padding skipped when wrapping
+    size_t unfencedBytes = 0;  // Allocated since the last fence
+    std::deque<Fence> fences;
+    uint64_t lastFence = 0;
+    uint64_t lastRetired = 0;
+
+public:
+    /*!
+     * @param capacity The size of the buffer in bytes. No single allocation can be larger than this
+     */
+    explicit StagingBuffer(size_t capacity);
+    ~StagingBuffer();
+
+    /*!
+     * @brief Allocate a region of the buffer
+     * @param size The size of the region in bytes
+     * @return The offset of the region within the buffer, or nothing if there isn't enough free space right now
+     */
+    std::optional<size_t> allocate(size_t size);
+    /*!
+     * @return A pointer to write to the region at `offset`. Writes are visible to the GPU without flushing
+     */
+    [[nodiscard]] unsigned char *data(const size_t offset) const { return mapped + offset; }
+
+    /*!
+     * @brief Place a fence after every command using the regions allocated since the last fence
+     * @return The ID of the fence, which can be compared against `retiredFence`
+     */
+    uint64_t fence();
+    /*!
+     * @brief Free the regions whose fences have been signalled
+     * @param wait Whether to block until at least the oldest fence is signalled
+     */
+    void retire(bool wait = false);
+    /*!
+     * @return The ID of the newest fence that has been signalled. Everything before it has finished on the GPU
+     */
+    [[nodiscard]] uint64_t retiredFence() const { return lastRetired; }
+    [[nodiscard]] size_t size() const { return capacity; }
+    [[nodiscard]] bool idle() const { return fences.empty() && unfencedBytes == 0; }
+
+    void bind() const;
+    static void unbind();
+
+    // Non-copyable
+    StagingBuffer(const StagingBuffer&) = delete;
+    StagingBuffer& operator=(const StagingBuffer&) = delete;
+};
+
+
+#endif
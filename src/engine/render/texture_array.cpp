@@ -0,0 +1,110 @@
+#include "texture_array.h"
+
+#include <algorithm>
+#include <gl/glew.h>
+
+#include <engine/render/immutable_storage.h>
+
+
+TextureArray::TextureArray(const int width, const int height, const int levels, const unsigned int internalFormat, const size_t layerBytes)
+    : width(width), height(height), levels(levels), internalFormat(internalFormat), layerBytes(layerBytes) {
+    reserve(4);
+}
+
+TextureArray::~TextureArray() {
+    glDeleteTextures(1, &textureID);
+}
+
+bool TextureArray::matches(const int width, const int height, const int levels, const unsigned int internalFormat) const {
+    return this->width == width && this->height == height && this->levels == levels && this->internalFormat == internalFormat;
+}
+
+void TextureArray::reserve(const unsigned int layers) {
+    if (layers <= capacity)
+        return;
+
+    const unsigned int newCapacity = Engine::Render::growCapacity(capacity, layers, 1u);
+
+    unsigned int newTexture;
+    glGenTextures(1, &newTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, newTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internalFormat, width, height, static_cast<GLsizei>(newCapacity));
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Copy the existing layers over to the larger array
+    if (layerCount > 0) {
+        for (int level = 0; level < levels; level++)
+            glCopyImageSubData(textureID, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                newTexture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                std::max(width >> level, 1), std::max(height >> level, 1), static_cast<GLsizei>(layerCount));
+    }
+    glDeleteTextures(1, &textureID);
+    textureID = newTexture;
+    capacity = newCapacity;
+}
+
+unsigned int TextureArray::addLayer(const unsigned int sourceTexture, const unsigned int sourceTarget, const unsigned int sourceLayer, const int sourceFirstLevel) {
+    unsigned int layer;
+    if (!freeLayers.empty()) {
+        layer = freeLayers.back();
+        freeLayers.pop_back();
+    } else {
+        reserve(layerCount + 1);
+        layer = layerCount++;
+    }
+
+    for (int level = 0; level < levels; level++)
+        glCopyImageSubData(sourceTexture, sourceTarget, sourceFirstLevel + level, 0, 0, static_cast<GLint>(sourceLayer),
+            textureID, GL_TEXTURE_2D_ARRAY, level, 0, 0, static_cast<GLint>(layer),
+            std::max(width >> level, 1), std::max(height >> level, 1), 1);
+    return layer;
+}
+
+void TextureArray::removeLayer(const unsigned int layer) {
+    freeLayers.push_back(layer);
+    if (count() > 0)
+        return;
+
+    // Nothing references the array anymore, so give its memory back
+    glDeleteTextures(1, &textureID);
+    textureID = 0;
+    capacity = 0;
+    layerCount = 0;
+    freeLayers.clear();
+}
+
+void TextureArray::bind(const unsigned int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+}
+
+TextureArray::TextureArray(TextureArray &&other) noexcept
+    : textureID(other.textureID), width(other.width), height(other.height), levels(other.levels),
+      internalFormat(other.internalFormat), layerBytes(other.layerBytes), capacity(other.capacity), layerCount(other.layerCount),
+      freeLayers(std::move(other.freeLayers)) {
+    other.textureID = 0;
+    other.capacity = 0;
+    other.layerCount = 0;
+}
+
+TextureArray &TextureArray::operator=(TextureArray &&other) noexcept {
+    if (this != &other) {
+        glDeleteTextures(1, &textureID);
+        textureID = other.textureID;
+        width = other.width;
+        height = other.height;
+        levels = other.levels;
+        internalFormat = other.internalFormat;
+        layerBytes = other.layerBytes;
+        capacity = other.capacity;
+        layerCount = other.layerCount;
+        freeLayers = std::move(other.freeLayers);
+        other.textureID = 0;
+        other.capacity = 0;
+        other.layerCount = 0;
+    }
+    return *this;
+}
@@ -0,0 +1,68 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <cstddef>
+#include <vector>
+
+/*!
+ * A `GL_TEXTURE_2D_ARRAY` of textures sharing the same size, format and mip count.
+ * Layers are copied in from existing textures on the GPU, and the array grows as needed.
+ * Removed layers are reused, and the storage is freed once every layer is removed.
+ */
+class TextureArray {
+private:
+    unsigned int textureID{};
+    int width, height, levels;
+    unsigned int internalFormat;
+    size_t layerBytes;
+    unsigned int capacity = 0;
+    unsigned int layerCount = 0;  // Including free layers
+    std::vector<unsigned int> freeLayers;
+
+    void reserve(unsigned int layers);
+
+public:
+    /*!
+     * @param layerBytes The size of a single layer including its mip chain, used for memory accounting
+     */
+    TextureArray(int width, int height, int levels, unsigned int internalFormat, size_t layerBytes);
+    ~TextureArray();
+
+    /*!
+     * @return Whether a texture with these properties can be added to this array
+     */
+    [[nodiscard]] bool matches(int width, int height, int levels, unsigned int internalFormat) const;
+    /*!
+     * @brief Copy mip levels of a texture into a new layer
+     * @param sourceTexture A 2D texture or texture array whose levels from `sourceFirstLevel` match this array (see `matches`)
+     * @param sourceTarget `GL_TEXTURE_2D` or `GL_TEXTURE_2D_ARRAY`
+     * @param sourceLayer The layer to copy, if the source is an array
+     * @param sourceFirstLevel The source level copied into this array's first level. Skipping levels copies a smaller version of the source
+     * @return The index of the new layer
+     */
+    unsigned int addLayer(unsigned int sourceTexture, unsigned int sourceTarget, unsigned int sourceLayer = 0, int sourceFirstLevel = 0);
+    /*!
+     * @brief Free a layer, to be reused by the next added layer
+     */
+    void removeLayer(unsigned int layer);
+    void bind(unsigned int unit) const;
+
+    [[nodiscard]] unsigned int id() const { return textureID; }
+    [[nodiscard]] int getWidth() const { return width; }
+    [[nodiscard]] int getHeight() const { return height; }
+    [[nodiscard]] int getLevels() const { return levels; }
+    [[nodiscard]] unsigned int getInternalFormat() const { return internalFormat; }
+    [[nodiscard]] size_t getLayerBytes() const { return layerBytes; }
+    [[nodiscard]] unsigned int count() const { return layerCount - static_cast<unsigned int>(freeLayers.size()); }
+    [[nodiscard]] size_t gpuBytes() const { return layerBytes * capacity; }
+
+    // Non-copyable
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+    // Moveable
+    TextureArray(TextureArray&& other) noexcept;
+    TextureArray& operator=(TextureArray&& other) noexcept;
+};
+
+
+#endif
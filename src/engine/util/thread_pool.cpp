@@ -0,0 +1,80 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+
+namespace Engine {
+    ThreadPool::ThreadPool(unsigned int threadCount) {
+        if (threadCount == 0)
+            threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+        workers.reserve(threadCount);
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        workers.clear();  // jthreads join on destruction
+    }
+
+    void ThreadPool::workerLoop() {
+        while (true) {
+            std::move_only_function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;  // Only reachable when stopping
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+    void ThreadPool::parallelFor(const size_t count, const std::function<void(size_t)> &body) {
+        if (count == 0)
+            return;
+
+        // Shared with the helper tasks, which may only start after we've returned
+        struct State {
+            const std::function<void(size_t)> *body;
+            size_t count;
+            std::atomic<size_t> next = 0;
+            std::atomic<size_t> done = 0;
+        };
+        const auto state = std::make_shared<State>(&body, count);
+        auto work = [state] {
+            // `body` is only touched after claiming an iteration, which means the caller is still waiting
+            for (size_t i = state->next++; i < state->count; i = state->next++) {
+                (*state->body)(i);
+                if (++state->done == state->count)
+                    state->done.notify_all();
+            }
+        };
+
+        const size_t helperCount = std::min(workers.size(), count - 1);
+        {
+            std::lock_guard lock(mutex);
+            for (size_t i = 0; i < helperCount; i++)
+                tasks.emplace(work);
+        }
+        condition.notify_all();
+
+        work();
+        for (size_t done = state->done; done < count; done = state->done)
+            state->done.wait(done);
+    }
+
+    ThreadPool &ThreadPool::shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Engine {
+    /*!
+     * A fixed set of worker threads running submitted tasks in FIFO order.
+     * @attention Tasks must not block on other tasks of the same pool, since every worker could end up waiting.
+     */
+    class ThreadPool {
+    private:
+        std::vector<std::jthread> workers;
+        std::queue<std::move_only_function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+
+        void workerLoop();
+
+    public:
+        /*!
+         * @param threadCount The number of workers. 0 uses one less than the number of hardware threads (at least 1),
+         *  leaving a core for the render thread
+         */
+        explicit ThreadPool(unsigned int threadCount = 0);
+        /*!
+         * @brief Finishes all queued tasks, then joins the workers
+         */
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        template<typename F>
+        std::future<std::invoke_result_t<std::decay_t<F>>> submit(F &&task) {
+            std::packaged_task<std::invoke_result_t<std::decay_t<F>>()> packaged(std::forward<F>(task));
+            auto future = packaged.get_future();
+            {
+                std::lock_guard lock(mutex);
+                tasks.emplace(std::move(packaged));
+            }
+            condition.notify_one();
+            return future;
+        }
+
+        /*!
+         * @brief Run `body(i)` for every `i` in `[0, count)`, spread across the workers and the calling thread
+         * @note The calling thread keeps running iterations until there are none left, and only waits for iterations
+         *  already running on workers. So unlike waiting on `submit`ted tasks, this is safe to call from a task of this pool
+         * @attention `body` must not throw
+         */
+        void parallelFor(size_t count, const std::function<void(size_t)> &body);
+
+        [[nodiscard]] size_t threadCount() const { return workers.size(); }
+
+        /*!
+         * @brief The pool shared by the engine's loaders, created on first use
+         */
+        static ThreadPool &shared();
+    };
+}
+
+#endif
@@ -26,6 +26,29 @@ glm::mat4 Camera::getViewMatrix() const {
     return glm::lookAt(position, position + forward_, up_);
 }
 
+bool Camera::updateMatrices(const float aspectRatio) {
+    const bool projectionChanged = fov != matricesFov || clipNear != matricesClipNear || clipFar != matricesClipFar
+        || aspectRatio != matricesAspectRatio;
+    if (!viewChanged && position == matricesPosition && !projectionChanged)
+        return false;
+
+    if (anglesChanged) {
+        updateVectors();
+        anglesChanged = false;
+    }
+    matrices_.view = getViewMatrix();
+    if (projectionChanged)
+        matrices_.projection = getProjectionMatrix(aspectRatio);
+
+    viewChanged = false;
+    matricesPosition = position;
+    matricesFov = fov;
+    matricesClipNear = clipNear;
+    matricesClipFar = clipFar;
+    matricesAspectRatio = aspectRatio;
+    return true;
+}
+
 void CameraController::look(const SDL_MouseMotionEvent &event) const {
     const auto xOffset = static_cast<float>(event.xrel) * sensitivity;
     const auto yOffset = static_cast<float>(-event.yrel) * sensitivity;
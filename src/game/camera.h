@@ -2,6 +2,7 @@
 #define CAMERA_H
 #include <SDL_events.h>
 #include <glm/fwd.hpp>
+#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 #include <glm/ext/matrix_clip_space.hpp>
 
@@ -14,6 +15,13 @@ Radians constexpr DEFAULT_YAW = -90.0f;
 Radians constexpr DEFAULT_PITCH = 0.0f;
 Radians constexpr DEFAULT_ROLL = 0.0f;
 
+/*!
+ * The camera's matrices, as laid out in the Matrices uniform block (std140).
+ */
+struct CameraMatrices {
+    glm::mat4 projection;
+    glm::mat4 view;
+};
 
 class Camera {
 public:
@@ -40,8 +48,16 @@ public:
         return glm::perspective(glm::radians(fov), aspectRatio, clipNear, clipFar);
     }
 
+    /*!
+     * @brief Recompute the view and projection matrices if anything they depend on changed since the last call
+     * @return Whether they changed
+     */
+    bool updateMatrices(float aspectRatio);
+    [[nodiscard]] const CameraMatrices &matrices() const { return matrices_; }
+
 private:
     bool anglesChanged = false;
+    bool viewChanged = true;  // Since the last `updateMatrices`
     Radians yaw_;
     Radians pitch_;
     Radians roll_;
@@ -50,15 +66,21 @@ private:
     glm::vec3 up_;
     glm::vec3 right_;
 
+    CameraMatrices matrices_{};
+    // What the matrices were last computed from
+    glm::vec3 matricesPosition{};
+    Degrees matricesFov = 0.0f;
+    float matricesClipNear = 0.0f, matricesClipFar = 0.0f, matricesAspectRatio = 0.0f;
+
     void updateVectors();
 
 public:
     Radians yaw() const { return yaw_; }
-    void setYaw(const Radians yaw) { yaw_ = yaw; anglesChanged = true; }
+    void setYaw(const Radians yaw) { yaw_ = yaw; anglesChanged = true; viewChanged = true; }
     Radians pitch() const { return pitch_; }
-    void setPitch(const Radians pitch) { pitch_ = pitch; anglesChanged = true; }
+    void setPitch(const Radians pitch) { pitch_ = pitch; anglesChanged = true; viewChanged = true; }
     Radians roll() const { return roll_; }
-    void setRoll(const Radians roll) { roll_ = roll; anglesChanged = true; }
+    void setRoll(const Radians roll) { roll_ = roll; anglesChanged = true; viewChanged = true; }
 
 #define UPDATE_IF_CHANGED() if (anglesChanged) { updateVectors(); anglesChanged = false; }
     glm::vec3 forward() { UPDATE_IF_CHANGED(); return forward_; }
@@ -1,7 +1,6 @@
 #include <memory>
 #include <gl/glew.h>
 #include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <imgui.h>
 
@@ -9,7 +8,8 @@
 #include "engine/loader/shader/compute_shader.h"
 #include "engine/game.h"
 #include "engine/render/overlay.h"
-#include "engine/render/frame_buffer.h"
+#include "engine/render/frame_graph.h"
+#include "engine/render/render_target_pool.h"
 
 #include "camera.h"
 #include "gui.h"
@@ -24,11 +24,69 @@ unsigned int uboMatrices;
 #define PLAYER LEVEL.player
 #define CAMERA PLAYER.camera
 
-std::unique_ptr<FrameBuffer> frameBuffer;
+std::unique_ptr<RenderTargetPool> renderTargets;
+std::unique_ptr<FrameGraph> frameGraph;
+
+void applyCacheBudgets(const Settings &settings, LevelState &level) {
+    level.textureManager.budget.gpuBytes = static_cast<size_t>(settings.textureBudgetMiB) * 1024 * 1024;
+    level.materialManager.gpuBudgetBytes = static_cast<size_t>(settings.materialTextureBudgetMiB) * 1024 * 1024;
+    level.modelManager.budget.gpuBytes = static_cast<size_t>(settings.sceneBudgetMiB) * 1024 * 1024;
+}
+
+void addLights(LevelState &level) {
+    using Engine::Manager::LightType;
+    level.lightManager.addLight({
+        .type = LightType::DIRECTIONAL,
+        .direction = {-0.2f, -1.0f, -0.3f},
+        .ambient = glm::vec3(0.5f),
+        .diffuse = glm::vec3(0.4f),
+        .specular = glm::vec3(0.5f),
+    });
+    level.lightManager.addLight({
+        .position = {1.2f, 1.0f, 2.0f},
+        .type = LightType::POINT,
+        .ambient = glm::vec3(0.05f),
+        .diffuse = glm::vec3(0.8f),
+        .constant = 1.0f,
+        .specular = glm::vec3(1.0f),
+        .linear = 0.09f,
+        .quadratic = 0.032f,
+    });
+    level.flashlight = level.lightManager.addLight({
+        .position = level.player.camera.position,
+        .type = LightType::SPOT,
+        .direction = level.player.camera.forward(),
+        .cutOff = glm::cos(glm::radians(12.5f)),
+        .ambient = glm::vec3(0.0f),
+        .outerCutOff = glm::cos(glm::radians(15.0f)),
+        .diffuse = glm::vec3(1.0f),
+        .constant = 1.0f,
+        .specular = glm::vec3(1.0f),
+        .linear = 0.09f,
+        .quadratic = 0.032f,
+    });
+}
+
+/*!
+ * @return The lit shader variant to draw with under the current settings
+ * @param alphaTest Whether what's being drawn could have transparent texels to discard
+ */
+Engine::ShaderVariantKey getLitShaderKey(const Settings &settings, const bool alphaTest) {
+    if (settings.wireframe)
+        return WIREFRAME;
+    Engine::ShaderVariantKey key = alphaTest ? static_cast<Engine::ShaderVariantKey>(ALPHA_TEST) : 0;
+    switch (settings.debugView) {
+        case DebugView::NONE: break;
+        case DebugView::NORMALS: key |= DEBUG_NORMALS; break;
+        case DebugView::LIGHT_COUNT: key |= DEBUG_LIGHT_COUNT; break;
+    }
+    return key;
+}
 
 bool setupGame(StatePackage &statePackage, SDL_Window *sdlWindow, SDL_GLContext glContext) {
     DebugGUI::init(*sdlWindow, glContext);
-    frameBuffer = std::make_unique<FrameBuffer>(statePackage.windowSize->width, statePackage.windowSize->height);
+    renderTargets = std::make_unique<RenderTargetPool>(statePackage.windowSize->width, statePackage.windowSize->height);
+    frameGraph = std::make_unique<FrameGraph>(*renderTargets);
 
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
@@ -37,27 +95,61 @@ bool setupGame(StatePackage &statePackage, SDL_Window *sdlWindow, SDL_GLContext
     SDL_SetRelativeMouseMode(SDL_TRUE);
 
     gameState = std::make_unique<GameState>(statePackage);
+    applyCacheBudgets(gameState->settings, LEVEL);
+
+    // Issue every compile before checking any, so the driver builds them all at once
+    const auto bindMatrices = [](const Engine::GraphicsShader &shader) {
+        shader.use();
+        auto matricesBinding = shader.bindUniformBlock("Matrices", 0);
+        if (!matricesBinding.has_value())
+            logError("Failed to bind matrices uniform block" NL_INDENT "%s", matricesBinding.error().c_str());
+    };
+    const std::vector<std::string> litDefines = {"MATERIAL_TEXTURE_ARRAYS " + std::to_string(LEVEL.materialManager.maxArrayCount())};
+    LEVEL.litShaders = std::make_unique<Engine::ShaderVariants>(std::vector<std::pair<std::string, unsigned int>>{
+        {"resources/assets/shaders/vert.vert", GL_VERTEX_SHADER}, {"resources/assets/shaders/frag.frag", GL_FRAGMENT_SHADER},
+    }, LIT_SHADER_FEATURES, bindMatrices, litDefines);
+    LEVEL.instancedLitShaders = std::make_unique<Engine::ShaderVariants>(std::vector<std::pair<std::string, unsigned int>>{
+        {"resources/assets/shaders/vert_instanced.vert", GL_VERTEX_SHADER}, {"resources/assets/shaders/frag.frag", GL_FRAGMENT_SHADER},
+    }, LIT_SHADER_FEATURES, bindMatrices, litDefines);
+    // The variants drawn with the default settings. Debug views are built the first time they're picked
+    LEVEL.litShaders->prepare({getLitShaderKey(gameState->settings, true)});
+    LEVEL.instancedLitShaders->prepare({getLitShaderKey(gameState->settings, false)});
+    std::vector<Engine::PendingProgram> shaderBuilds = Engine::ShaderProgram::startBuilds({
+        {{"resources/assets/shaders/sb_vert.vert", GL_VERTEX_SHADER}, {"resources/assets/shaders/sb_frag.frag", GL_FRAGMENT_SHADER}},
+        {{"resources/assets/shaders/light_clusters.comp", GL_COMPUTE_SHADER}},
+    });
+    bindMatrices(LEVEL.shaders.emplace_back(std::move(shaderBuilds[0])));
+    LEVEL.lightClusterShader = std::make_unique<Engine::ComputeShader>(std::move(shaderBuilds[1]));
+
+    // Stream in everything the camera could possibly see
+    LEVEL.world.config.loadRadius = CAMERA.clipFar;
+    auto worldRet = LEVEL.world.load("resources/assets/models/map.obj", LEVEL.materialManager);
+    if (!worldRet.has_value()) {
+        logError("Failed to load world" NL_INDENT "%s", worldRet.error().c_str());
+        return false;
+    }
 
-    LEVEL.shaders.emplace_back("resources/assets/shaders/vert.vert", "resources/assets/shaders/frag.frag");
-    LEVEL.shaders[0].use();
-    auto matricesBinding = LEVEL.shaders[0].bindUniformBlock("Matrices", 0);
-    if (!matricesBinding.has_value())
-        logError("Failed to bind matrices uniform block" NL_INDENT "%s", matricesBinding.error().c_str());
+    // Registering the world's materials already started decoding their textures on all cores
+    LEVEL.skyboxTexture = LEVEL.textureManager.preload("resources/assets/textures/skybox/sky.png", Engine::Manager::TextureType::CUBEMAP);
 
-    LEVEL.shaders.emplace_back("resources/assets/shaders/sb_vert.vert", "resources/assets/shaders/sb_frag.frag");
-    LEVEL.shaders[1].use();
-    matricesBinding = LEVEL.shaders[1].bindUniformBlock("Matrices", 0);
-    if (!matricesBinding.has_value())
-        logError("Failed to bind matrices uniform block" NL_INDENT "%s", matricesBinding.error().c_str());
+    // A row of error models, drawn with a single instanced draw call per mesh
+    for (int i = 0; i < 5; i++)
+        LEVEL.modelManager.addInstance(LEVEL.modelManager.errorScene,
+            glm::translate(glm::mat4(1.0f), glm::vec3(static_cast<float>(i - 2) * 1.5f, 1.0f, -2.0f)));
 
+    addLights(LEVEL);
+
+    // Only written on the GPU, by copying from the frame's constants whenever the camera changes
     glGenBuffers(1, &uboMatrices);
     glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-    glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), nullptr, GL_STATIC_DRAW);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, 2 * sizeof(glm::mat4));
+    glBufferStorage(GL_UNIFORM_BUFFER, sizeof(CameraMatrices), nullptr, 0);
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, sizeof(CameraMatrices));
 
     return true;
 }
 void shutdownGame(StatePackage &statePackage) {
+    frameGraph.reset();
+    renderTargets.reset();
     gameState.reset();
 }
 
@@ -83,97 +175,127 @@ bool renderUpdate(const double deltaTime, StatePackage &statePackage) {
     constexpr auto CAMERA_SPEED = 2.5f;
     CAMERA.position += inputDir * CAMERA_SPEED * static_cast<float>(deltaTime);
 
-    frameBuffer->bind();
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glClearColor(0.5f, 0.0f, 0.5f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glPolygonMode(GL_FRONT_AND_BACK, gameState->settings.wireframe ? GL_LINE : GL_FILL);
-    // TODO: Allow backface culling to be toggled per object
-    // Don't cull if in wireframe mode
-    if (gameState->settings.wireframe)
-        glDisable(GL_CULL_FACE);
-    else
-        glEnable(GL_CULL_FACE);
-
-    // TODO: Let these be managed by the camera class, so we only ever have to update the matrices when the camera moves/zooms
-    glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4),
-        glm::value_ptr(CAMERA.getProjectionMatrix(statePackage.windowSize->aspectRatio())));
-    glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4),
-        glm::value_ptr(CAMERA.getViewMatrix()));
-
-    LEVEL.shaders[0].use();
-
-    LEVEL.shaders[0].setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-    LEVEL.shaders[0].setVec3("dirLight.ambient", 0.5f, 0.5f, 0.5f);
-    LEVEL.shaders[0].setVec3("pointLights.diffuse", 0.4f, 0.4f, 0.4f);
-    LEVEL.shaders[0].setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-
-    LEVEL.shaders[0].setVec3("pointLights[0].position", 1.2f, 1.0f, 2.0f);
-    LEVEL.shaders[0].setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-    LEVEL.shaders[0].setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-    LEVEL.shaders[0].setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-    LEVEL.shaders[0].setFloat("pointLights[0].constant", 1.0f);
-    LEVEL.shaders[0].setFloat("pointLights[0].linear", 0.09f);
-    LEVEL.shaders[0].setFloat("pointLights[0].quadratic", 0.032f);
-
-    LEVEL.shaders[0].setVec3("spotLight.position", CAMERA.position);
-    LEVEL.shaders[0].setVec3("spotLight.direction", CAMERA.forward());
-    LEVEL.shaders[0].setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-    LEVEL.shaders[0].setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-    LEVEL.shaders[0].setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-    LEVEL.shaders[0].setFloat("spotLight.constant", 1.0f);
-    LEVEL.shaders[0].setFloat("spotLight.linear", 0.09f);
-    LEVEL.shaders[0].setFloat("spotLight.quadratic", 0.032f);
-    LEVEL.shaders[0].setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-    LEVEL.shaders[0].setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-
-    LEVEL.shaders[0].setVec3("viewPos", CAMERA.position);
-
-    auto scene = LEVEL.modelManager.getScene("resources/assets/models/map.obj");
-    if (!scene.has_value())
-        logError("Failed to load scene" NL_INDENT "%s", scene.error().c_str());
-    auto drawRet = scene.value()->Draw(LEVEL.textureManager, LEVEL.shaders[0], glm::mat4(1.0f));
-    if (!drawRet.has_value())
-        logError("Failed to draw scene" NL_INDENT "%s", drawRet.error().c_str());
-
-    const glm::mat4 trans = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, -2.0f));
-    LEVEL.modelManager.errorScene->Draw(LEVEL.textureManager, LEVEL.shaders[0], trans);
-
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-#pragma region Skybox
-    // We render the skybox manually, since we don't need any of the fancy scene stuff
-    LEVEL.shaders[1].use();
-
-    std::expected<unsigned int, std::string> skyboxTex = LEVEL.textureManager.getTexture(
-        "resources/assets/textures/skybox/sky.png", Engine::Manager::TextureType::CUBEMAP);
-    if (!skyboxTex.has_value())
-        logError("Failed to load skybox texture" NL_INDENT "%s", skyboxTex.error().c_str());
-    LEVEL.skybox.draw(skyboxTex.value_or(LEVEL.textureManager.errorTexture), LEVEL.shaders[1]);
-#pragma endregion
-
-#pragma region Render overlays
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDisable(GL_DEPTH_TEST);
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    static ScreenOverlay overlay;
-    overlay.draw(frameBuffer->ColorTextureID);
-
-    DebugGUI::renderStart(*gameState, statePackage, deltaTime);
-
-    ImGui::Begin("Preview", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
-    ImGui::Text("Color buffer");
-    ImGui::Image(frameBuffer->ColorTextureID,
-        ImVec2(statePackage.windowSize->width / 4, statePackage.windowSize->height / 4),
-        ImVec2(0, 1), ImVec2(1, 0));
-    ImGui::End();
-
-    DebugGUI::renderEnd();
-#pragma endregion
+    LEVEL.frameConstants.beginFrame();
+    renderTargets->beginFrame();
+    // The scene is drawn at the render target size, which lags behind the window while it's being resized
+    const int sceneWidth = renderTargets->width(), sceneHeight = renderTargets->height();
+    LEVEL.textureManager.beginFrame();
+    LEVEL.materialManager.update();
+    LEVEL.modelManager.beginFrame();
+
+    if (CAMERA.updateMatrices(statePackage.windowSize->aspectRatio())) {
+        // Nothing else has been allocated this frame yet, so this always fits
+        const std::optional<RingAllocation> matrices = LEVEL.frameConstants.push(CAMERA.matrices());
+        if (matrices.has_value())
+            LEVEL.frameConstants.copy(matrices.value(), uboMatrices, 0);
+        else
+            logError("Out of per-frame constant memory for the camera matrices");
+    }
+    const glm::mat4 &view = CAMERA.matrices().view;
+
+    // Only uploads anything when the camera moved
+    LEVEL.lightManager.setTransform(LEVEL.flashlight, CAMERA.position, CAMERA.forward());
+    LEVEL.lightManager.update();
+    LEVEL.lightClusters.setProjection(glm::radians(CAMERA.fov), statePackage.windowSize->aspectRatio(), CAMERA.clipNear, CAMERA.clipFar);
+    if (gameState->settings.gpuLightClustering) {
+        LEVEL.lightClusters.dispatch(*LEVEL.lightClusterShader, LEVEL.lightManager.data(), view, sceneWidth, sceneHeight);
+    } else {
+        LEVEL.lightClusters.assign(LEVEL.lightManager.data(), view);
+        LEVEL.lightClusters.upload(sceneWidth, sceneHeight);
+    }
+    // The world can have cutout textures, while the instanced error models are opaque, so they skip the alpha test
+    const auto worldShader = LEVEL.litShaders->get(getLitShaderKey(gameState->settings, true));
+    const auto instanceShader = LEVEL.instancedLitShaders->get(getLitShaderKey(gameState->settings, false));
+    for (const auto &shader : {worldShader, instanceShader}) {
+        if (!shader.has_value())
+            continue;
+        shader.value()->use();
+        shader.value()->setVec3("viewPos", CAMERA.position);
+    }
+
+    LEVEL.world.update(CAMERA.position);
+    // Picked up by the material manager next frame
+    const float pixelScale = static_cast<float>(statePackage.windowSize->height) / (2.0f * std::tan(glm::radians(CAMERA.fov) / 2.0f));
+    LEVEL.world.requestTextureDetail(LEVEL.materialManager, CAMERA.position, pixelScale);
+    LEVEL.modelManager.requestTextureDetail(LEVEL.materialManager, CAMERA.position, pixelScale);
+
+    const int width = statePackage.windowSize->width, height = statePackage.windowSize->height;
+    frameGraph->beginFrame();
+    frameGraph->importBackbuffer("backbuffer", width, height);
+    frameGraph->createTexture("sceneColor", {sceneWidth, sceneHeight, GL_RGB8});
+    frameGraph->createTexture("sceneDepth", {sceneWidth, sceneHeight, GL_DEPTH24_STENCIL8});
+
+    frameGraph->addPass("Scene", {}, {"sceneColor", "sceneDepth"}, [&](const FrameGraph::PassResources &) {
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glClearColor(0.5f, 0.0f, 0.5f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glPolygonMode(GL_FRONT_AND_BACK, gameState->settings.wireframe ? GL_LINE : GL_FILL);
+        // TODO: Allow backface culling to be toggled per object
+        // Don't cull if in wireframe mode
+        if (gameState->settings.wireframe)
+            glDisable(GL_CULL_FACE);
+        else
+            glEnable(GL_CULL_FACE);
+
+        auto drawRet = worldShader.has_value()
+            ? LEVEL.world.draw(LEVEL.materialManager, *worldShader.value(), LEVEL.frameConstants)
+            : std::unexpected(FW_UNEXP(worldShader, "Failed to build world shader"));
+        if (!drawRet.has_value())
+            logError("Failed to draw world" NL_INDENT "%s", drawRet.error().c_str());
+
+        drawRet = instanceShader.has_value()
+            ? LEVEL.modelManager.drawInstances(LEVEL.materialManager, *instanceShader.value())
+            : std::unexpected(FW_UNEXP(instanceShader, "Failed to build instance shader"));
+        if (!drawRet.has_value())
+            logError("Failed to draw instances" NL_INDENT "%s", drawRet.error().c_str());
+
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    });
+
+    // We render the skybox manually, since we don't need any of the fancy scene stuff. It fills in wherever the scene left the far depth
+    frameGraph->addPass("Skybox", {"sceneColor", "sceneDepth"}, {"sceneColor", "sceneDepth"}, [&](const FrameGraph::PassResources &) {
+        LEVEL.shaders[0].use();
+
+        std::expected<unsigned int, std::string> skyboxTex = LEVEL.textureManager.getTexture(LEVEL.skyboxTexture);
+        if (!skyboxTex.has_value())
+            logError("Failed to load skybox texture" NL_INDENT "%s", skyboxTex.error().c_str());
+        LEVEL.skybox.draw(skyboxTex.value_or(LEVEL.textureManager.errorCubemap), LEVEL.shaders[0]);
+    });
+
+    frameGraph->addPass("Overlay", {"sceneColor"}, {"backbuffer"}, [&](const FrameGraph::PassResources &resources) {
+        glDisable(GL_DEPTH_TEST);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        static ScreenOverlay overlay;
+        overlay.draw(resources.texture("sceneColor"));
+    });
+
+    frameGraph->addPass("Debug GUI", {"sceneColor"}, {"backbuffer"}, [&](const FrameGraph::PassResources &resources) {
+        DebugGUI::renderStart(*gameState, statePackage, deltaTime);
+
+        ImGui::Begin("Preview", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+        ImGui::Text("Color buffer");
+        ImGui::Image(resources.texture("sceneColor"),
+            ImVec2(width / 4, height / 4),
+            ImVec2(0, 1), ImVec2(1, 0));
+        ImGui::Text("Passes: %zu run, %zu culled", frameGraph->passCount() - frameGraph->culledPassCount(), frameGraph->culledPassCount());
+        ImGui::Text("Render targets: %zu pooled at %dx%d, %zu MiB GPU", renderTargets->count(), sceneWidth, sceneHeight,
+            renderTargets->gpuBytes() / (1024 * 1024));
+        ImGui::End();
+
+        DebugGUI::renderEnd();
+    });
+
+    auto graphRet = frameGraph->compile();
+    if (!graphRet.has_value()) {
+        logError("Failed to build the frame graph" NL_INDENT "%s", graphRet.error().c_str());
+        return false;
+    }
+    frameGraph->execute();
+
+    LEVEL.frameConstants.endFrame();
 
     return true;
 }
@@ -195,10 +317,9 @@ bool handleEvent(const SDL_Event &event, StatePackage &statePackage) {
             break;
 
         case SDL_WINDOWEVENT:
-            if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-                // TODO: Move framebuffer handling to the engine
-                frameBuffer->resize(event.window.data1, event.window.data2);
-            }
+            // Applied once the size settles, so dragging the window doesn't reallocate the render targets every frame
+            if (event.window.event == SDL_WINDOWEVENT_RESIZED)
+                renderTargets->requestResize(event.window.data1, event.window.data2);
             break;
     }
 
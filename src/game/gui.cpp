@@ -78,6 +78,59 @@ namespace DebugGUI {
             ImGui::SetWindowCollapsed(true);
         }
         ImGui::Checkbox("Wireframe", &GAME_SETTINGS.wireframe);
+        ImGui::Checkbox("Cluster lights on GPU", &GAME_SETTINGS.gpuLightClustering);
+        int debugView = static_cast<int>(GAME_SETTINGS.debugView);
+        if (ImGui::Combo("Debug view", &debugView, "None\0Normals\0Light count\0"))
+            GAME_SETTINGS.debugView = static_cast<DebugView>(debugView);
+        ImGui::Text("Lights: %zu", gameState.level.lightManager.count());
+
+        if (ImGui::CollapsingHeader("Materials")) {
+            auto &materialManager = gameState.level.materialManager;
+            static int materialId = ERROR_MATERIAL_ID;
+            ImGui::SliderInt("Material", &materialId, 0, static_cast<int>(materialManager.idCount()) - 1);
+            if (const Engine::Loader::Material *material = materialManager.get(static_cast<unsigned int>(materialId)); material != nullptr) {
+                ImGui::Text("Diffuse: %s", material->diffusePath.empty() ? "(none)" : material->diffusePath.c_str());
+                ImGui::Text("Specular: %s", material->specularPath.empty() ? "(none)" : material->specularPath.c_str());
+                float shininess = material->shininess;
+                if (ImGui::SliderFloat("Shininess", &shininess, 1.0f, 256.0f, "%.0f", ImGuiSliderFlags_Logarithmic))
+                    materialManager.setShininess(static_cast<unsigned int>(materialId), shininess);
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Memory")) {
+            auto &textureManager = gameState.level.textureManager;
+            auto &modelManager = gameState.level.modelManager;
+
+            const auto textureUsage = textureManager.usage();
+            ImGui::Text("Textures: %zu cached, %zu decoding, %zu MiB GPU", textureManager.count(), textureManager.pendingCount(),
+                textureUsage.gpuBytes / (1024 * 1024));
+            if (ImGui::SliderInt("Texture budget (MiB)", &GAME_SETTINGS.textureBudgetMiB, 64, 4096))
+                textureManager.budget.gpuBytes = static_cast<size_t>(GAME_SETTINGS.textureBudgetMiB) * 1024 * 1024;
+
+            auto &materialManager = gameState.level.materialManager;
+            ImGui::Text("Materials: %zu (%zu waiting on textures), %zu texture arrays, %zu MiB GPU (%zu MiB in use)", materialManager.count(),
+                materialManager.unresolvedCount(), materialManager.arrayCount(), materialManager.gpuBytes() / (1024 * 1024),
+                materialManager.residentBytes() / (1024 * 1024));
+            if (ImGui::SliderInt("Material texture budget (MiB)", &GAME_SETTINGS.materialTextureBudgetMiB, 64, 4096))
+                materialManager.gpuBudgetBytes = static_cast<size_t>(GAME_SETTINGS.materialTextureBudgetMiB) * 1024 * 1024;
+            ImGui::Text("Textures streaming in detail: %zu", materialManager.streamingCount());
+
+            const auto sceneUsage = modelManager.usage();
+            ImGui::Text("Scenes: %zu cached, %zu MiB GPU, %zu KiB CPU", modelManager.count(),
+                sceneUsage.gpuBytes / (1024 * 1024), sceneUsage.cpuBytes / 1024);
+            if (ImGui::SliderInt("Scene budget (MiB)", &GAME_SETTINGS.sceneBudgetMiB, 64, 4096))
+                modelManager.budget.gpuBytes = static_cast<size_t>(GAME_SETTINGS.sceneBudgetMiB) * 1024 * 1024;
+
+            const auto &world = gameState.level.world;
+            ImGui::Text("World cells: %zu/%zu resident, %zu loading, %zu MiB GPU", world.residentCellCount(),
+                world.cellCount(), world.loadingCellCount(), world.residentGpuBytes() / (1024 * 1024));
+
+            ImGui::Text("Scene geometry kept in RAM: %zu KiB", modelManager.geometryBytes() / 1024);
+            ImGui::Text("Scene geometry freed after upload: %zu KiB", modelManager.releasedCpuBytes() / 1024);
+
+            const auto &frameConstants = gameState.level.frameConstants;
+            ImGui::Text("Per-frame constants: %zu/%zu KiB at peak", frameConstants.peak() / 1024, frameConstants.capacity() / 1024);
+        }
         ImGui::End();
     }
 
@@ -1,20 +1,52 @@
 #ifndef STATE_H
 #define STATE_H
 
+#include <memory>
 #include <vector>
 #include <engine/manager/texture.h>
+#include <engine/manager/material.h>
 #include <engine/manager/scene.h>
+#include <engine/manager/world_streamer.h>
+#include <engine/manager/light.h>
+#include <engine/render/light_clusters.h>
+#include <engine/render/ring_buffer.h>
+#include <engine/loader/shader/compute_shader.h>
+#include <engine/loader/shader/shader_variants.h>
 #include <engine/loader/shader/graphics_shader.h>
 
 #include "camera.h"
 #include "skybox.h"
 
+// Optional features of the lit shaders, one bit each. Must match the order of LIT_SHADER_FEATURES, and the variants in frag.frag
+enum LitShaderFeature : Engine::ShaderVariantKey {
+    ALPHA_TEST = 1 << 0,
+    WIREFRAME = 1 << 1,
+    DEBUG_NORMALS = 1 << 2,
+    DEBUG_LIGHT_COUNT = 1 << 3,
+};
+inline const std::vector<std::string> LIT_SHADER_FEATURES = {"ALPHA_TEST", "WIREFRAME", "DEBUG_NORMALS", "DEBUG_LIGHT_COUNT"};
+
+// Per-frame and per-draw constants each frame can write, like the camera matrices and model transforms. The ring grows if a frame needs more
+#define FRAME_CONSTANT_BYTES (256 * 1024)
+
+enum class DebugView {
+    NONE,
+    NORMALS,
+    LIGHT_COUNT,
+};
+
 struct Settings {
     // Mouse
     float sensitivity = 0.1f;
     // Graphics
     bool wireframe = false;
-    // TODO: Add multiple debug modes, like viewing polygons, normals, positions, albedo, disabling post-processing effects, etc
+    bool gpuLightClustering = false;  // Assign lights to clusters in a compute shader, rather than on the CPU
+    DebugView debugView = DebugView::NONE;
+    // Memory budgets for the asset caches, in MiB
+    int textureBudgetMiB = 1024;
+    int materialTextureBudgetMiB = 1024;  // The texture arrays materials draw from
+    int sceneBudgetMiB = 512;
+    // TODO: More debug views, like positions, albedo, disabling post-processing effects, etc
 };
 
 struct PlayerState {
@@ -27,10 +59,21 @@ struct PlayerState {
 struct LevelState {
     // TODO: Storing shaders in a random vector is odd. Should they have their own managers and be associated with each thing that needs them?
     std::vector<Engine::GraphicsShader> shaders;
+    // Built for each combination of LitShaderFeature as it's needed
+    std::unique_ptr<Engine::ShaderVariants> litShaders;
+    std::unique_ptr<Engine::ShaderVariants> instancedLitShaders;
+    std::unique_ptr<Engine::ComputeShader> lightClusterShader;
     Engine::Manager::TextureManager textureManager;
-    Engine::Manager::SceneManager modelManager;
+    Engine::Manager::MaterialManager materialManager{textureManager};
+    Engine::Manager::SceneManager modelManager{materialManager, textureManager};
+    Engine::Manager::WorldStreamer world{textureManager};
+    Engine::Manager::LightManager lightManager;
+    LightClusters lightClusters;
+    RingBuffer frameConstants{FRAME_CONSTANT_BYTES};
 
     std::vector<std::string> modelPaths;
+    Engine::Manager::TextureHandle skyboxTexture;
+    Engine::Manager::LightHandle flashlight;  // Follows the camera
 
     PlayerState player;
     Skybox skybox;